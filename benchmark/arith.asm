@@ -0,0 +1,31 @@
+; Arithmetic kernel: 1,000,000 iterations of sum += (i*3) / (i+1) with no
+; allocation at all, as a dispatch-only baseline.
+; memory[0] = i, memory[1] = sum
+
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 1
+loop:
+    LOAD 0
+    PUSH 1000000
+    CMP
+    JZ done
+    LOAD 0
+    PUSH 3
+    MUL
+    LOAD 0
+    PUSH 1
+    ADD
+    DIV
+    LOAD 1
+    ADD
+    STORE 1
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 1
+    HALT
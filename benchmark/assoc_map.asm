@@ -0,0 +1,75 @@
+; Map lookups on an association list ((key . value) . rest): the same 200
+; keys and 100000 lookups as table_map.asm, each a linear walk.
+; memory[0] = i, memory[1] = list, memory[2] = sum, memory[3] = cursor,
+; memory[4] = key
+
+    PUSH 0
+    STORE 1
+    PUSH 0
+    STORE 0
+fill:
+    LOAD 0
+    PUSH 200
+    CMP
+    JZ filled
+    LOAD 0              ; key i*7
+    PUSH 7
+    MUL
+    LOAD 0              ; value i
+    NEW_PAIR
+    LOAD 1
+    NEW_PAIR
+    STORE 1
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP fill
+filled:
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 2
+lookup:
+    LOAD 0
+    PUSH 100000
+    CMP
+    JZ done
+    LOAD 0              ; key (i%200)*7
+    LOAD 0
+    PUSH 200
+    DIV
+    PUSH 200
+    MUL
+    SUB
+    PUSH 7
+    MUL
+    STORE 4
+    LOAD 1
+    STORE 3
+walk:
+    LOAD 3
+    PAIR_LEFT
+    PAIR_LEFT
+    LOAD 4
+    SUB
+    JZ found
+    LOAD 3
+    PAIR_RIGHT
+    STORE 3
+    JMP walk
+found:
+    LOAD 2
+    LOAD 3
+    PAIR_LEFT
+    PAIR_RIGHT
+    ADD
+    STORE 2
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP lookup
+done:
+    LOAD 2              ; 500 * (0 + 1 + ... + 199) = 9950000
+    HALT
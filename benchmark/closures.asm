@@ -0,0 +1,62 @@
+; Closures: the VM has no closure opcodes, so a closure is modelled as
+; (code . env) with env = (captured . parent env). 100 rounds build a chain
+; of 500 closures and then invoke each one; the call reads its captured
+; value through the environment and adds it to the accumulator.
+; memory[0] = round, memory[1] = chain, memory[2] = i, memory[3] = sum
+
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 3
+round:
+    LOAD 0
+    PUSH 100
+    CMP
+    JZ done
+    PUSH 0
+    STORE 1
+    PUSH 0
+    STORE 2
+make:
+    LOAD 2
+    PUSH 500
+    CMP
+    JZ invoke
+    PUSH 1              ; code id
+    LOAD 2
+    LOAD 1
+    NEW_PAIR            ; env = (i . parent)
+    NEW_PAIR            ; closure = (code . env)
+    STORE 1
+    LOAD 2
+    PUSH 1
+    ADD
+    STORE 2
+    JMP make
+invoke:
+    LOAD 1
+    DUP
+    JZ next_round       ; end of chain (int 0)
+    CALL apply          ; [closure] -> [parent closure]
+    STORE 1
+    JMP invoke
+next_round:
+    POP
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP round
+done:
+    LOAD 3
+    HALT
+
+apply:                  ; [closure] -> [env.parent], sum += env.captured
+    PAIR_RIGHT          ; env
+    DUP
+    PAIR_LEFT
+    LOAD 3
+    ADD
+    STORE 3
+    PAIR_RIGHT
+    RET
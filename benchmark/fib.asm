@@ -0,0 +1,33 @@
+; Recursive CALL/RET: fib(22). Each frame keeps n and fib(n-1) in a pair,
+; so deep recursion also allocates. memory[1] is a scratch slot that is
+; only live between two instructions of the same frame.
+
+    PUSH 22
+    CALL fib
+    HALT
+
+fib:                    ; [n] -> [fib(n)]
+    DUP
+    PUSH 2
+    CMP
+    JNZ base
+    DUP
+    PUSH 1
+    SUB
+    CALL fib            ; [n, f1]
+    NEW_PAIR            ; [frame=(n . f1)]
+    DUP
+    PAIR_LEFT
+    PUSH 2
+    SUB
+    CALL fib            ; [frame, f2]
+    SET_LEFT            ; frame = (f2 . f1)
+    DUP
+    PAIR_LEFT
+    STORE 1
+    PAIR_RIGHT
+    LOAD 1
+    ADD
+    RET
+base:
+    RET
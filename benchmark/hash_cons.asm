@@ -0,0 +1,55 @@
+; Hash-consing: 500000 rounds each build the key (i%50 . (i%20 . 0)) and
+; keep it in a 1000-slot table, so up to 2000 key pairs are live at once.
+; Only 100 keys are distinct: CONS_SHARED builds each once and afterwards
+; finds it. Replace CONS_SHARED with NEW_PAIR to compare.
+; memory[0] = i, memory[1] = table
+
+    PUSH 1000
+    NEW_VECTOR
+    STORE 1
+    PUSH 0
+    STORE 0
+loop:
+    LOAD 0
+    PUSH 500000
+    CMP
+    JZ done
+    LOAD 1
+    LOAD 0              ; i % 1000
+    LOAD 0
+    PUSH 1000
+    DIV
+    PUSH 1000
+    MUL
+    SUB
+    LOAD 0              ; i % 50
+    LOAD 0
+    PUSH 50
+    DIV
+    PUSH 50
+    MUL
+    SUB
+    LOAD 0              ; i % 20
+    LOAD 0
+    PUSH 20
+    DIV
+    PUSH 20
+    MUL
+    SUB
+    PUSH 0
+    CONS_SHARED         ; (i%20 . 0)
+    CONS_SHARED         ; (i%50 . (i%20 . 0))
+    ARRAY_SET
+    POP
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 1              ; table[999] = (49 . (19 . 0))
+    PUSH 999
+    ARRAY_GET
+    PAIR_RIGHT
+    PAIR_LEFT
+    HALT
@@ -0,0 +1,39 @@
+; List building: 200 rounds of consing a 1,000-element list, keeping only
+; the most recent list alive in memory[1].
+; memory[0] = round, memory[2] = element counter
+
+    PUSH 0
+    STORE 0
+round:
+    LOAD 0
+    PUSH 200
+    CMP
+    JZ done
+    PUSH 0              ; empty list
+    STORE 1
+    PUSH 0
+    STORE 2
+cons:
+    LOAD 2
+    PUSH 1000
+    CMP
+    JZ next_round
+    LOAD 2
+    LOAD 1
+    NEW_PAIR            ; (i . list)
+    STORE 1
+    LOAD 2
+    PUSH 1
+    ADD
+    STORE 2
+    JMP cons
+next_round:
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP round
+done:
+    LOAD 1
+    PAIR_LEFT           ; 999
+    HALT
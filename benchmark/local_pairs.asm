@@ -0,0 +1,37 @@
+; Temporary pairs: each round packs i and i+1 into a pair and unpacks it
+; again in the same basic block, like a tuple return or a multiple
+; assignment. Escape analysis rewrites the NEW_PAIR to NEW_LOCAL_PAIR, so
+; the loop allocates nothing; run with --no-escape to compare.
+; memory[0] = i, memory[1] = sum of (right - left), memory[2] = left
+
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 1
+loop:
+    LOAD 0
+    PUSH 1000000
+    CMP
+    JZ done
+    LOAD 0
+    LOAD 0
+    PUSH 1
+    ADD
+    NEW_PAIR            ; (i . i+1)
+    DUP
+    PAIR_LEFT
+    STORE 2
+    PAIR_RIGHT
+    LOAD 2
+    SUB
+    LOAD 1
+    ADD
+    STORE 1
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 1
+    HALT
@@ -0,0 +1,70 @@
+; Persistent tree with transient garbage: a depth-15 tree kept in memory[1],
+; with four short-lived pairs from separate sites before every node, then
+; 100000 more rounds of garbage while the tree stays alive. The tree's
+; NEW_PAIR sites always survive and the garbage sites never do, which is
+; what --pretenure tells apart. The garbage goes through memory[2], so
+; escape analysis leaves it on the heap.
+
+    PUSH 15
+    CALL build
+    STORE 1
+    PUSH 0
+    STORE 0
+loop:
+    LOAD 0
+    PUSH 100000
+    CMP
+    JZ done
+    CALL garbage
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 1
+    PAIR_RIGHT
+    POP
+    LOAD 0
+    HALT
+
+; build: [d] -> [tree], as in tree_build.asm
+build:
+    CALL garbage
+    DUP
+    JZ leaf
+    PUSH 1
+    SUB
+    DUP
+    CALL build          ; [d-1, left]
+    NEW_PAIR            ; [node=(d-1, left)]
+    DUP
+    PAIR_LEFT           ; [node, d-1]
+    CALL build          ; [node, right]
+    SET_LEFT            ; node = (right, left)
+    RET
+leaf:
+    POP
+    PUSH 0
+    PUSH 0
+    NEW_PAIR
+    RET
+
+garbage:
+    PUSH 1
+    PUSH 2
+    NEW_PAIR
+    STORE 2
+    PUSH 3
+    PUSH 4
+    NEW_PAIR
+    STORE 2
+    PUSH 5
+    PUSH 6
+    NEW_PAIR
+    STORE 2
+    PUSH 7
+    PUSH 8
+    NEW_PAIR
+    STORE 2
+    RET
@@ -0,0 +1,56 @@
+; Request loop: each of 20000 requests builds a 50-cell list, walks it and
+; drops it, so everything a request allocates dies when it ends.
+; REGION_BEGIN/REGION_END put the cells in a region that is freed whole;
+; delete those two lines to compare with the collector reclaiming them.
+; memory[0] = request, memory[1] = cell, memory[2] = sum of all cells
+
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 2
+request:
+    LOAD 0
+    PUSH 20000
+    CMP
+    JZ done
+    REGION_BEGIN
+    PUSH 0
+    STORE 1
+    PUSH 0              ; empty list
+build:
+    LOAD 1
+    PUSH 50
+    CMP
+    JZ walk
+    LOAD 1
+    NEW_PAIR            ; (list . cell)
+    LOAD 1
+    PUSH 1
+    ADD
+    STORE 1
+    JMP build
+walk:
+    LOAD 1
+    JZ finish
+    DUP
+    PAIR_RIGHT
+    LOAD 2
+    ADD
+    STORE 2
+    PAIR_LEFT
+    LOAD 1
+    PUSH 1
+    SUB
+    STORE 1
+    JMP walk
+finish:
+    POP
+    REGION_END
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP request
+done:
+    LOAD 2
+    HALT
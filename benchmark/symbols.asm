@@ -0,0 +1,55 @@
+; Symbol lookups: a table keyed by four string literals, read 4 x 50000
+; times. STRING loads each literal from the constant pool (interned on
+; first use), so the loop allocates nothing, and a lookup hashes nothing:
+; strings carry their hash and compare by identity.
+; memory[0] = i, memory[1] = table, memory[2] = sum
+
+    TABLE_NEW
+    STRING "width"
+    PUSH 1
+    TABLE_PUT
+    STRING "height"
+    PUSH 2
+    TABLE_PUT
+    STRING "depth"
+    PUSH 3
+    TABLE_PUT
+    STRING "weight"
+    PUSH 4
+    TABLE_PUT
+    STORE 1
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 2
+loop:
+    LOAD 0
+    PUSH 50000
+    CMP
+    JZ done
+    LOAD 2
+    LOAD 1
+    STRING "width"
+    TABLE_GET
+    ADD
+    LOAD 1
+    STRING "height"
+    TABLE_GET
+    ADD
+    LOAD 1
+    STRING "depth"
+    TABLE_GET
+    ADD
+    LOAD 1
+    STRING "weight"
+    TABLE_GET
+    ADD
+    STORE 2
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 2              ; 50000 * (1 + 2 + 3 + 4) = 500000
+    HALT
@@ -0,0 +1,58 @@
+; Map lookups on a native hash table: 200 keys k*7 -> k, then 100000
+; lookups of (i%200)*7, summing the values found. assoc_map.asm does the
+; same with an association list of pairs.
+; memory[0] = i, memory[1] = table, memory[2] = sum
+
+    TABLE_NEW
+    STORE 1
+    PUSH 0
+    STORE 0
+fill:
+    LOAD 0
+    PUSH 200
+    CMP
+    JZ filled
+    LOAD 1
+    LOAD 0              ; key i*7
+    PUSH 7
+    MUL
+    LOAD 0              ; value i
+    TABLE_PUT
+    POP
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP fill
+filled:
+    PUSH 0
+    STORE 0
+    PUSH 0
+    STORE 2
+lookup:
+    LOAD 0
+    PUSH 100000
+    CMP
+    JZ done
+    LOAD 2
+    LOAD 1
+    LOAD 0              ; key (i%200)*7
+    LOAD 0
+    PUSH 200
+    DIV
+    PUSH 200
+    MUL
+    SUB
+    PUSH 7
+    MUL
+    TABLE_GET
+    ADD
+    STORE 2
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP lookup
+done:
+    LOAD 2              ; 500 * (0 + 1 + ... + 199) = 9950000
+    HALT
@@ -0,0 +1,47 @@
+; Tree building: a long-lived tree of depth 12 in memory[1], then 64
+; short-lived trees of depth 10 built by recursive CALL/RET.
+;
+; build: [d] -> [tree]. The pair (d-1, left) doubles as the new node: its
+; left field is overwritten with the right subtree once that is built.
+
+    PUSH 12
+    CALL build
+    STORE 1
+    PUSH 0
+    STORE 0
+loop:
+    LOAD 0
+    PUSH 64
+    CMP
+    JZ done
+    PUSH 10
+    CALL build
+    POP
+    LOAD 0
+    PUSH 1
+    ADD
+    STORE 0
+    JMP loop
+done:
+    LOAD 0
+    HALT
+
+build:
+    DUP
+    JZ leaf
+    PUSH 1
+    SUB
+    DUP
+    CALL build          ; [d-1, left]
+    NEW_PAIR            ; [node=(d-1, left)]
+    DUP
+    PAIR_LEFT           ; [node, d-1]
+    CALL build          ; [node, right]
+    SET_LEFT            ; node = (right, left)
+    RET
+leaf:
+    POP
+    PUSH 0
+    PUSH 0
+    NEW_PAIR
+    RET
@@ -13,27 +13,46 @@ typedef struct {
 static Instr table[] = {
     {"PUSH",  1,   1}, {"POP",   2,   0}, {"DUP",  3,   0},
     {"ADD",  16,  0}, {"SUB",  17,  0}, {"MUL",  18,  0},
-    {"DIV",  19,  0}, {"CMP",  20,  0},
+    {"DIV",  19,  0}, {"CMP",  20,  0}, {"SAME", 21,  0},
     {"JMP",  32,  1}, {"JZ",   33,  1}, {"JNZ",  34,  1},
-    {"STORE",48,  1}, {"LOAD", 49,  1},
+    {"STORE",48,  1}, {"LOAD", 49,  1}, {"CONST",50,  1},
+    {"STRING",50, 1},   /* STRING "text": CONST of a new or equal literal */
     {"CALL", 64,  1}, {"RET",  65,  0},
     {"NEW_PAIR", 80, 0}, {"PAIR_LEFT", 81, 0}, {"PAIR_RIGHT", 82, 0},
     {"SET_LEFT", 83, 0}, {"SET_RIGHT", 84, 0},
-    {"GC", 96, 0},
+    {"NEW_WEAK", 85, 0}, {"NEW_EPHEMERON", 86, 0},
+    {"WEAK_GET", 87, 0}, {"EPHEMERON_VALUE", 88, 0},
+    {"CONS_SHARED", 90, 0},
+    {"GC", 96, 0}, {"SNAPSHOT", 97, 0},
+    {"REGION_BEGIN", 98, 0}, {"REGION_END", 99, 0},
+    {"TRY", 112, 1}, {"END_TRY", 113, 0},
+    {"NEW_VECTOR", 128, 0}, {"NEW_BYTES", 129, 0}, {"ARRAY_GET", 130, 0},
+    {"ARRAY_SET", 131, 0}, {"ARRAY_LEN", 132, 0},
+    {"TABLE_NEW", 144, 0}, {"TABLE_GET", 145, 0}, {"TABLE_PUT", 146, 0},
+    {"TABLE_DELETE", 147, 0}, {"TABLE_SIZE", 148, 0},
     {"HALT", 255, 0},
     {NULL,    0,   0}
 };
 
 #define MAX_LABELS 512
 #define MAX_NAME   64
+#define MAX_STRINGS 512
 
 typedef struct {
     char name[MAX_NAME];
     int addr; /* index in int bytecode array */
 } Label;
 
-static Label labels[MAX_LABELS];
-static int label_count = 0;
+/* All assembler state lives here so several files can be assembled in one
+   process (or on several threads) without sharing a label table. */
+typedef struct {
+    Label labels[MAX_LABELS];
+    int label_count;
+    /* Constant pool: the distinct STRING literals, by CONST index */
+    char *strings[MAX_STRINGS];
+    int string_lengths[MAX_STRINGS];
+    int string_count;
+} Assembler;
 
 static void die(const char *msg) {
     fprintf(stderr, "%s\n", msg);
@@ -41,8 +60,11 @@ static void die(const char *msg) {
 }
 
 static void strip_comment(char *line) {
+    int quoted = 0;
     for (int i = 0; line[i]; i++) {
-        if (line[i] == ';' || line[i] == '#') {
+        if (line[i] == '"') quoted = !quoted;
+        else if (quoted && line[i] == '\\' && line[i + 1]) i++;
+        else if (!quoted && (line[i] == ';' || line[i] == '#')) {
             line[i] = '\0';
             return;
         }
@@ -91,26 +113,27 @@ static int find_instr(const char *mnemonic, Instr *out) {
     return 0;
 }
 
-static int find_label_addr(const char *name) {
-    for (int i = 0; i < label_count; i++) {
-        if (strcmp(labels[i].name, name) == 0) {
-            return labels[i].addr;
+static int find_label_addr(const Assembler *as, const char *name) {
+    for (int i = 0; i < as->label_count; i++) {
+        if (strcmp(as->labels[i].name, name) == 0) {
+            return as->labels[i].addr;
         }
     }
     return -1;
 }
 
-static void add_label(const char *name, int addr) {
-    if (find_label_addr(name) != -1) {
+static void add_label(Assembler *as, const char *name, int addr) {
+    if (find_label_addr(as, name) != -1) {
         fprintf(stderr, "Duplicate label: %s\n", name);
         exit(1);
     }
-    if (label_count >= MAX_LABELS) die("Too many labels");
+    if (as->label_count >= MAX_LABELS) die("Too many labels");
 
-    strncpy(labels[label_count].name, name, MAX_NAME - 1);
-    labels[label_count].name[MAX_NAME - 1] = '\0';
-    labels[label_count].addr = addr;
-    label_count++;
+    Label *label = &as->labels[as->label_count];
+    strncpy(label->name, name, MAX_NAME - 1);
+    label->name[MAX_NAME - 1] = '\0';
+    label->addr = addr;
+    as->label_count++;
 }
 
 /* Reads next whitespace-separated token from *p into tok.
@@ -139,7 +162,44 @@ static int parse_int_strict(const char *s, int *out) {
     return 1;
 }
 
-static void pass1_collect_labels(FILE *fp) {
+/* Parses a "..." literal at *p (escapes \n \t \" \\) into the constant
+   pool, sharing the entry of an equal literal. Returns its index. */
+static int add_string_literal(Assembler *as, char **p) {
+    char *s = ltrim(*p);
+    if (*s != '"') die("STRING expects a \"quoted\" literal");
+    s++;
+    char buf[512];
+    int n = 0;
+    for (; *s != '"'; s++) {
+        char c = *s;
+        if (c == '\0') die("Unterminated string literal");
+        if (c == '\\') {
+            s++;
+            if (*s == 'n') c = '\n';
+            else if (*s == 't') c = '\t';
+            else if (*s == '"' || *s == '\\') c = *s;
+            else die("Unknown escape in string literal");
+        }
+        if (n >= (int)sizeof(buf)) die("String literal too long");
+        buf[n++] = c;
+    }
+    *p = s + 1;
+    if (!is_blank(*p)) die("Junk after string literal");
+
+    for (int i = 0; i < as->string_count; i++) {
+        if (as->string_lengths[i] == n && memcmp(as->strings[i], buf, n) == 0) return i;
+    }
+    if (as->string_count >= MAX_STRINGS) die("Too many string literals");
+    char *copy = malloc(n + 1);
+    if (!copy) die("Out of memory");
+    memcpy(copy, buf, n);
+    copy[n] = '\0';
+    as->strings[as->string_count] = copy;
+    as->string_lengths[as->string_count] = n;
+    return as->string_count++;
+}
+
+static void pass1_collect_labels(Assembler *as, FILE *fp) {
     char line[512];
     int out_index = 0; /* index in emitted integer stream */
 
@@ -155,7 +215,7 @@ static void pass1_collect_labels(FILE *fp) {
             if (is_label_token(tok)) {
                 char lname[MAX_NAME];
                 label_name_from_token(tok, lname);
-                add_label(lname, out_index);
+                add_label(as, lname, out_index);
                 /* continue parsing rest of line (could have an instruction too) */
                 continue;
             }
@@ -184,7 +244,7 @@ static void pass1_collect_labels(FILE *fp) {
     }
 }
 
-static void pass2_emit(FILE *fp, FILE *out) {
+static void pass2_emit(Assembler *as, FILE *fp, FILE *out) {
     char line[512];
 
     while (fgets(line, sizeof(line), fp)) {
@@ -208,7 +268,9 @@ static void pass2_emit(FILE *fp, FILE *out) {
 
             fprintf(out, "%d ", ins.opcode);
 
-            if (ins.has_operand) {
+            if (strcmp(ins.mnemonic, "STRING") == 0) {
+                fprintf(out, "%d ", add_string_literal(as, &p));
+            } else if (ins.has_operand) {
                 char op[128];
                 if (!next_token(&p, op)) {
                     fprintf(stderr, "Missing operand for %s\n", ins.mnemonic);
@@ -221,7 +283,7 @@ static void pass2_emit(FILE *fp, FILE *out) {
                     fprintf(out, "%d ", val);
                 } else {
                     /* label operand */
-                    int addr = find_label_addr(op);
+                    int addr = find_label_addr(as, op);
                     if (addr == -1) {
                         fprintf(stderr, "Undefined label: %s\n", op);
                         exit(1);
@@ -236,6 +298,44 @@ static void pass2_emit(FILE *fp, FILE *out) {
     }
 }
 
+/* Writes "addr label" lines next to the bytecode (output.bc.sym) so the
+   VM profiler can name CALL targets and hot spots. */
+static void write_symbol_map(const Assembler *as, const char *bc_path) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.sym", bc_path);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("failed to open symbol map");
+        return;
+    }
+    for (int i = 0; i < as->label_count; i++) {
+        fprintf(fp, "%d %s\n", as->labels[i].addr, as->labels[i].name);
+    }
+    fclose(fp);
+}
+
+/* Writes the constant pool next to the bytecode (output.bc.str), one
+   "length bytes" line per CONST index, for load_constants(). */
+static void write_constant_pool(const Assembler *as, const char *bc_path) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.str", bc_path);
+    if (as->string_count == 0) {
+        remove(path);   /* No stale pool from an earlier build */
+        return;
+    }
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("failed to open constant pool");
+        exit(1);
+    }
+    for (int i = 0; i < as->string_count; i++) {
+        fprintf(fp, "%d ", as->string_lengths[i]);
+        fwrite(as->strings[i], 1, as->string_lengths[i], fp);
+        fputc('\n', fp);
+    }
+    fclose(fp);
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 3) {
         fprintf(stderr, "Usage: %s input.asm output.bc\n", argv[0]);
@@ -248,8 +348,9 @@ int main(int argc, char *argv[]) {
         perror("failed to open input.asm");
         return 1;
     }
-    label_count = 0;
-    pass1_collect_labels(in1);
+    Assembler *as = calloc(1, sizeof(Assembler));
+    if (!as) die("Out of memory");
+    pass1_collect_labels(as, in1);
     fclose(in1);
 
     /* PASS 2 */
@@ -260,9 +361,14 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    pass2_emit(in2, out);
+    pass2_emit(as, in2, out);
 
     fclose(in2);
     fclose(out);
+
+    write_symbol_map(as, argv[2]);
+    write_constant_pool(as, argv[2]);
+    for (int i = 0; i < as->string_count; i++) free(as->strings[i]);
+    free(as);
     return 0;
 }
@@ -0,0 +1,151 @@
+/* Bytecode macro benchmark runner: times the full load_bytecode -> vm_run
+ * pipeline (dispatch, allocation and collection) for assembled programs.
+ *
+ *   ./bc_bench --repeat 5 --history history.csv --label my-change benchmark/fib.bc ...
+ *
+ * Each program runs in a fresh VM per repeat, after escape analysis unless
+ * --no-escape is given. Wall time is the median over
+ * the repeats; hardware counters are read with perf_event where available.
+ * With --history, one CSV row per program is appended so results can be
+ * compared over time. */
+
+#include "vm.h"
+#include "loader.h"
+#include "perf_counters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_RUNS 64
+
+typedef struct {
+    double seconds;
+    long vm_instructions;
+    long gc_calls;
+    double gc_seconds;
+    PerfSample perf;
+} BcRun;
+
+static double now_seconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int by_seconds(const void *a, const void *b){
+    double x = ((const BcRun*)a)->seconds, y = ((const BcRun*)b)->seconds;
+    return (x > y) - (x < y);
+}
+
+static BcRun run_program(int *bytecode, const LocalPairs *local_pairs, const ConstantPool *constants,
+                         PerfCounters *counters){
+    BcRun run;
+    VM *vm = vm_new(bytecode);
+    if(!vm || vm_attach_local_pairs(vm, local_pairs) != 0 || vm_attach_constants(vm, constants) != 0){
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    perf_counters_start(counters);
+    double start = now_seconds();
+    vm_run(vm);
+    run.seconds = now_seconds() - start;
+    perf_counters_stop(counters, &run.perf);
+
+    run.vm_instructions = vm->instruction_count;
+    run.gc_calls = vm->gc_stats.total_gc_calls;
+    run.gc_seconds = vm->gc_stats.total_gc_time;
+
+    vm_free(vm);
+    return run;
+}
+
+static void format_counter(char *out, size_t size, long long value){
+    if(value < 0) snprintf(out, size, "n/a");
+    else snprintf(out, size, "%lld", value);
+}
+
+int main(int argc, char *argv[]){
+    int repeat = 5;
+    const char *history = NULL;
+    const char *label = "";
+    int first_program = argc;
+    int escape = 1;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--history") == 0 && i + 1 < argc) history = argv[++i];
+        else if(strcmp(argv[i], "--label") == 0 && i + 1 < argc) label = argv[++i];
+        else if(strcmp(argv[i], "--no-escape") == 0) escape = 0;
+        else{
+            first_program = i;
+            break;
+        }
+    }
+    if(first_program >= argc){
+        printf("Usage: %s [--repeat N] [--history file.csv] [--label name] [--no-escape] prog.bc...\n", argv[0]);
+        return 1;
+    }
+    if(repeat < 1) repeat = 1;
+    if(repeat > MAX_RUNS) repeat = MAX_RUNS;
+
+    PerfCounters counters;
+    perf_counters_open(&counters);
+
+    FILE *hist = NULL;
+    if(history){
+        hist = fopen(history, "a+");
+        if(!hist){
+            perror("failed to open history file");
+            return 1;
+        }
+        fseek(hist, 0, SEEK_END);
+        if(ftell(hist) == 0){
+            fprintf(hist, "timestamp,label,program,repeats,median_s,min_s,vm_instructions,"
+                          "gc_calls,gc_s,hw_instructions,cycles,cache_misses\n");
+        }
+    }
+
+    printf("%-24s %10s %10s %12s %6s %14s %12s %10s\n", "program", "median ms", "min ms",
+           "VM instrs", "GCs", "hw instrs", "cycles", "LLC miss");
+    long now = (long)time(NULL);
+    for(int p = first_program; p < argc; p++){
+        int code_size;
+        int *bytecode = load_bytecode(argv[p], &code_size);
+        if(!bytecode) continue;
+        LocalPairs *local_pairs = escape ? escape_analyze(bytecode, code_size) : NULL;
+        ConstantPool *constants = load_constants(argv[p]);
+
+        BcRun runs[MAX_RUNS];
+        run_program(bytecode, local_pairs, constants, &counters);   // warmup
+        for(int i = 0; i < repeat; i++){
+            runs[i] = run_program(bytecode, local_pairs, constants, &counters);
+        }
+        local_pairs_destroy(local_pairs);
+        constant_pool_destroy(constants);
+        qsort(runs, repeat, sizeof(BcRun), by_seconds);
+        BcRun *mid = &runs[repeat / 2];
+
+        const char *name = strrchr(argv[p], '/');
+        name = name ? name + 1 : argv[p];
+        char instr[32], cycles[32], misses[32];
+        format_counter(instr, sizeof(instr), mid->perf.instructions);
+        format_counter(cycles, sizeof(cycles), mid->perf.cycles);
+        format_counter(misses, sizeof(misses), mid->perf.cache_misses);
+        printf("%-24s %10.2f %10.2f %12ld %6ld %14s %12s %10s\n", name, mid->seconds * 1e3,
+               runs[0].seconds * 1e3, mid->vm_instructions, mid->gc_calls, instr, cycles, misses);
+
+        if(hist){
+            fprintf(hist, "%ld,%s,%s,%d,%.6f,%.6f,%ld,%ld,%.6f,%lld,%lld,%lld\n", now, label,
+                    name, repeat, mid->seconds, runs[0].seconds, mid->vm_instructions,
+                    mid->gc_calls, mid->gc_seconds, mid->perf.instructions, mid->perf.cycles,
+                    mid->perf.cache_misses);
+        }
+        free(bytecode);
+    }
+
+    if(hist) fclose(hist);
+    perf_counters_close(&counters);
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include "bitmap.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
+
+// Index of the first word at or after w that differs from `value`
+typedef int (*SkipFn)(const uint64_t *bits, int words, int w, uint64_t value);
+
+static int find_run_with(const uint64_t *bits, int words, int from, int *start, SkipFn skip){
+    int nbits = words * 64;
+    if(from >= nbits) return 0;
+
+    // Start of the run: first clear bit, skipping full words
+    int w = from >> 6;
+    uint64_t clear = ~bits[w] & (~0ULL << (from & 63));
+    while(!clear){
+        w = skip(bits, words, w + 1, ~0ULL);
+        if(w >= words) return 0;
+        clear = ~bits[w];
+    }
+    int first = w * 64 + __builtin_ctzll(clear);
+
+    // End of the run: next set bit, skipping empty words
+    uint64_t used = bits[w] & (~0ULL << (first & 63));
+    while(!used){
+        w = skip(bits, words, w + 1, 0);
+        if(w >= words){
+            *start = first;
+            return nbits - first;
+        }
+        used = bits[w];
+    }
+    *start = first;
+    return w * 64 + __builtin_ctzll(used) - first;
+}
+
+/* ----------------------------------------------------------------- scalar */
+
+static int sweep_scalar(uint64_t *alloc, uint64_t *mark, int words){
+    int live = 0;
+    for(int i = 0; i < words; i++){
+        uint64_t kept = alloc[i] & mark[i];
+        alloc[i] = kept;
+        mark[i] = 0;
+        live += __builtin_popcountll(kept);
+    }
+    return live;
+}
+
+static int count_scalar(const uint64_t *bits, int words){
+    int count = 0;
+    for(int i = 0; i < words; i++) count += __builtin_popcountll(bits[i]);
+    return count;
+}
+
+static int skip_scalar(const uint64_t *bits, int words, int w, uint64_t value){
+    while(w < words && bits[w] == value) w++;
+    return w;
+}
+
+static int find_run_scalar(const uint64_t *bits, int words, int from, int *start){
+    return find_run_with(bits, words, from, start, skip_scalar);
+}
+
+static const BitmapKernels scalar_kernels = {
+    "scalar", sweep_scalar, count_scalar, find_run_scalar
+};
+
+#ifdef BITMAP_X86
+
+/* ------------------------------------------------------------------- SSE2 */
+
+// Per-64-bit-lane popcount: SWAR nibble sums, then a byte sum via psadbw
+__attribute__((target("sse2")))
+static inline __m128i popcount_sse2(__m128i v){
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+    v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+    v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+    return _mm_sad_epu8(v, _mm_setzero_si128());
+}
+
+__attribute__((target("sse2")))
+static int sum_lanes_sse2(__m128i sums){
+    return (int)(_mm_cvtsi128_si64(sums) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums)));
+}
+
+__attribute__((target("sse2")))
+static int sweep_sse2(uint64_t *alloc, uint64_t *mark, int words){
+    __m128i sums = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 2 <= words; i += 2){
+        __m128i kept = _mm_and_si128(_mm_loadu_si128((const __m128i*)(alloc + i)),
+                                     _mm_loadu_si128((const __m128i*)(mark + i)));
+        _mm_storeu_si128((__m128i*)(alloc + i), kept);
+        _mm_storeu_si128((__m128i*)(mark + i), zero);
+        sums = _mm_add_epi64(sums, popcount_sse2(kept));
+    }
+    return sum_lanes_sse2(sums) + sweep_scalar(alloc + i, mark + i, words - i);
+}
+
+__attribute__((target("sse2")))
+static int count_sse2(const uint64_t *bits, int words){
+    __m128i sums = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 2 <= words; i += 2){
+        sums = _mm_add_epi64(sums, popcount_sse2(_mm_loadu_si128((const __m128i*)(bits + i))));
+    }
+    return sum_lanes_sse2(sums) + count_scalar(bits + i, words - i);
+}
+
+__attribute__((target("sse2")))
+static int skip_sse2(const uint64_t *bits, int words, int w, uint64_t value){
+    const __m128i target = _mm_set1_epi64x((long long)value);
+    for(; w + 2 <= words; w += 2){
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(bits + w)), target);
+        if(_mm_movemask_epi8(eq) != 0xffff) break;
+    }
+    return skip_scalar(bits, words, w, value);
+}
+
+static int find_run_sse2(const uint64_t *bits, int words, int from, int *start){
+    return find_run_with(bits, words, from, start, skip_sse2);
+}
+
+static const BitmapKernels sse2_kernels = {
+    "sse2", sweep_sse2, count_sse2, find_run_sse2
+};
+
+/* ------------------------------------------------------------------- AVX2 */
+
+// Per-64-bit-lane popcount: 4-bit table lookup with vpshufb, then vpsadbw
+__attribute__((target("avx2")))
+static inline __m256i popcount_avx2(__m256i v){
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi64(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static int sum_lanes_avx2(__m256i sums){
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return (int)(_mm_cvtsi128_si64(half) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half)));
+}
+
+__attribute__((target("avx2")))
+static int sweep_avx2(uint64_t *alloc, uint64_t *mark, int words){
+    __m256i sums = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 4 <= words; i += 4){
+        __m256i kept = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(alloc + i)),
+                                        _mm256_loadu_si256((const __m256i*)(mark + i)));
+        _mm256_storeu_si256((__m256i*)(alloc + i), kept);
+        _mm256_storeu_si256((__m256i*)(mark + i), zero);
+        sums = _mm256_add_epi64(sums, popcount_avx2(kept));
+    }
+    return sum_lanes_avx2(sums) + sweep_scalar(alloc + i, mark + i, words - i);
+}
+
+__attribute__((target("avx2")))
+static int count_avx2(const uint64_t *bits, int words){
+    __m256i sums = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 4 <= words; i += 4){
+        sums = _mm256_add_epi64(sums, popcount_avx2(_mm256_loadu_si256((const __m256i*)(bits + i))));
+    }
+    return sum_lanes_avx2(sums) + count_scalar(bits + i, words - i);
+}
+
+__attribute__((target("avx2")))
+static int skip_avx2(const uint64_t *bits, int words, int w, uint64_t value){
+    const __m256i target = _mm256_set1_epi64x((long long)value);
+    for(; w + 4 <= words; w += 4){
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(bits + w)), target);
+        if(_mm256_movemask_epi8(eq) != -1) break;
+    }
+    return skip_scalar(bits, words, w, value);
+}
+
+static int find_run_avx2(const uint64_t *bits, int words, int from, int *start){
+    return find_run_with(bits, words, from, start, skip_avx2);
+}
+
+static const BitmapKernels avx2_kernels = {
+    "avx2", sweep_avx2, count_avx2, find_run_avx2
+};
+
+#endif
+
+const BitmapKernels *bitmap_kernels_named(const char *name){
+    if(strcmp(name, "scalar") == 0) return &scalar_kernels;
+#ifdef BITMAP_X86
+    __builtin_cpu_init();
+    if(strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return &sse2_kernels;
+    if(strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return &avx2_kernels;
+#endif
+    return NULL;
+}
+
+const BitmapKernels *bitmap_kernels_best(void){
+#ifdef BITMAP_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return &avx2_kernels;
+    if(__builtin_cpu_supports("sse2")) return &sse2_kernels;
+#endif
+    return &scalar_kernels;
+}
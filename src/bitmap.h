@@ -0,0 +1,29 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+
+// Bit-parallel kernels over the per-page allocation and mark bitmaps of the
+// shared heap. Each kernel has a scalar version and, on x86-64, SSE2 and AVX2
+// versions; bitmap_kernels_best() picks the widest one the CPU supports.
+
+typedef struct {
+    const char *name;
+
+    // alloc &= mark, then mark = 0. Returns the number of surviving objects.
+    int (*sweep)(uint64_t *alloc, uint64_t *mark, int words);
+
+    // Number of set bits
+    int (*count)(const uint64_t *bits, int words);
+
+    // First run of clear bits at or after bit `from`. Stores its first bit
+    // in *start and returns its length, or returns 0 if there is none.
+    int (*find_run)(const uint64_t *bits, int words, int from, int *start);
+} BitmapKernels;
+
+const BitmapKernels *bitmap_kernels_best(void);
+
+// "scalar", "sse2" or "avx2"; NULL if unknown or unsupported on this CPU
+const BitmapKernels *bitmap_kernels_named(const char *name);
+
+#endif
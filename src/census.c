@@ -0,0 +1,98 @@
+#include "census.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *type_names[OBJ_TYPE_COUNT] = {"pair", "function", "closure", "weak", "ephemeron", "vector", "bytes", "table", "string"};
+
+Census *census_create(int code_size, int sample_rate){
+    Census *census = (Census*)calloc(1, sizeof(Census));
+    if(!census) return NULL;
+    census->sites = (SiteStats*)calloc(code_size + 1, sizeof(SiteStats));
+    if(!census->sites){
+        free(census);
+        return NULL;
+    }
+    census->code_size = code_size;
+    census->sample_rate = sample_rate > 0 ? sample_rate : CENSUS_DEFAULT_SAMPLE;
+    census->countdown = census->sample_rate;
+    return census;
+}
+
+void census_destroy(Census *census){
+    if(!census) return;
+    free(census->sites);
+    free(census);
+}
+
+static int site_slot(Census *census, int site){
+    if(site < 0 || site >= census->code_size) return census->code_size;
+    return site;
+}
+
+int census_sample(Census *census, int pc){
+    if(--census->countdown > 0) return SITE_NONE;
+    census->countdown = census->sample_rate;
+
+    int site = (pc >= 0 && pc < census->code_size) ? pc : SITE_NATIVE;
+    census->sites[site_slot(census, site)].allocated++;
+    return site;
+}
+
+void census_begin(Census *census){
+    for(int i=0;i<=census->code_size;i++){
+        census->sites[i].live = 0;
+        census->sites[i].live_bytes = 0;
+    }
+    memset(census->type_live, 0, sizeof(census->type_live));
+    memset(census->type_bytes, 0, sizeof(census->type_bytes));
+    census->collections++;
+}
+
+void census_record(Census *census, Obj *obj, int survived){
+    if(survived){
+        census->type_live[obj->type]++;
+        census->type_bytes[obj->type] += object_size(obj);
+    }
+    if(!(obj->flags & OBJ_FLAG_SAMPLED)) return;
+
+    SiteStats *s = &census->sites[site_slot(census, obj->site)];
+    if(survived){
+        s->survived++;
+        s->live++;
+        s->live_bytes += object_size(obj);
+    }
+    else{
+        s->died++;
+    }
+}
+
+void census_print(Census *census, FILE *out){
+    fprintf(out, "Heap census after %ld collection(s), sampling 1/%d allocations:\n",
+            census->collections, census->sample_rate);
+
+    fprintf(out, "  %-10s %12s %14s\n", "type", "live", "live bytes");
+    for(int t=0;t<OBJ_TYPE_COUNT;t++){
+        fprintf(out, "  %-10s %12ld %14ld\n", type_names[t],
+                census->type_live[t], census->type_bytes[t]);
+    }
+
+    fprintf(out, "\n  %-8s %10s %12s %14s %10s\n",
+            "site", "sampled", "est. live", "est. bytes", "survival");
+    for(int i=0;i<=census->code_size;i++){
+        SiteStats *s = &census->sites[i];
+        if(!s->allocated) continue;
+
+        char site[16];
+        if(i == census->code_size) snprintf(site, sizeof(site), "native");
+        else snprintf(site, sizeof(site), "pc %d", i);
+
+        long seen = s->survived + s->died;
+        long est_live = s->live * census->sample_rate;
+        fprintf(out, "  %-8s %10ld %12ld %14ld", site, s->allocated,
+                est_live, s->live_bytes * census->sample_rate);
+        if(seen) fprintf(out, " %9.1f%%\n", 100.0 * s->survived / seen);
+        else fprintf(out, " %10s\n", "-");
+    }
+}
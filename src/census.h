@@ -0,0 +1,43 @@
+#ifndef CENSUS_H
+#define CENSUS_H
+
+#include <stdio.h>
+#include "object.h"
+
+// Allocation-site tracking and heap census. One allocation in sample_rate
+// records its allocating pc in Obj.site; every sweep then tallies the live
+// objects per site and per ObjType without an extra heap walk.
+
+#define CENSUS_DEFAULT_SAMPLE 64
+
+typedef struct {
+    long allocated;     // Sampled allocations from this site
+    long survived;      // Sampled objects found alive by a sweep (per collection)
+    long died;          // Sampled objects freed by a sweep
+    long live;          // Sampled objects alive after the last collection
+    long live_bytes;    // object_size() of those objects
+} SiteStats;
+
+typedef struct Census {
+    int sample_rate;
+    int countdown;
+    int code_size;
+    SiteStats *sites;                   // code_size slots, then one for SITE_NATIVE
+    long type_live[OBJ_TYPE_COUNT];     // Exact live objects after the last collection
+    long type_bytes[OBJ_TYPE_COUNT];
+    long collections;
+} Census;
+
+Census *census_create(int code_size, int sample_rate);
+void census_destroy(Census *census);
+
+// Site to record for the next allocation, or SITE_NONE when not sampled
+int census_sample(Census *census, int pc);
+
+// Sweep hooks
+void census_begin(Census *census);
+void census_record(Census *census, Obj *obj, int survived);
+
+void census_print(Census *census, FILE *out);
+
+#endif
@@ -0,0 +1,105 @@
+#include "cons.h"
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint64_t value_bits(Value value){
+    if(value.type == VAL_OBJ) return (uint64_t)(uintptr_t)value.as.obj;
+    return (uint64_t)(uint32_t)value.as.i | 0x8000000000000000ULL;
+}
+
+static uint64_t mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static size_t hash_fields(Value left, Value right){
+    return (size_t)mix(mix(value_bits(left)) ^ value_bits(right));
+}
+
+static int same_value(Value a, Value b){
+    if(a.type != b.type) return 0;
+    return a.type == VAL_OBJ ? a.as.obj == b.as.obj : a.as.i == b.as.i;
+}
+
+static void put(Obj **slots, size_t capacity, Obj *pair){
+    size_t i = hash_fields(pair->as.pair.left, pair->as.pair.right) & (capacity - 1);
+    while(slots[i]) i = (i + 1) & (capacity - 1);
+    slots[i] = pair;
+}
+
+// Rehashes the table's pairs into capacity slots
+static void rehash(ConsTable *table, size_t capacity){
+    Obj **slots = (Obj**)calloc(capacity, sizeof(Obj*));
+    if(!slots){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < table->capacity; i++){
+        if(table->slots[i]) put(slots, capacity, table->slots[i]);
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+static ConsTable *cons_table_create(void){
+    ConsTable *table = (ConsTable*)calloc(1, sizeof(ConsTable));
+    if(!table) return NULL;
+    table->slots = (Obj**)calloc(CONS_TABLE_MIN_CAPACITY, sizeof(Obj*));
+    if(!table->slots){
+        free(table);
+        return NULL;
+    }
+    table->capacity = CONS_TABLE_MIN_CAPACITY;
+    return table;
+}
+
+void cons_table_destroy(ConsTable *table){
+    if(!table) return;
+    free(table->slots);
+    free(table);
+}
+
+Obj *cons_shared(VM *vm, Value left, Value right){
+    if(!vm->conses && !(vm->conses = cons_table_create())) return NULL;
+    ConsTable *table = vm->conses;
+    table->lookups++;
+    size_t i = hash_fields(left, right) & (table->capacity - 1);
+    for(Obj *pair; (pair = table->slots[i]); i = (i + 1) & (table->capacity - 1)){
+        if(same_value(pair->as.pair.left, left) && same_value(pair->as.pair.right, right)){
+            table->hits++;
+            return pair;
+        }
+    }
+
+    // The table only holds heap objects: a region would free the pair
+    vm->region.bypass++;
+    Obj *pair = new_pair(vm, left, right);
+    vm->region.bypass--;
+    if(!pair) return NULL;
+    pair->flags |= OBJ_FLAG_INTERNED;
+    // An emergency GC in new_pair may have rehashed the table
+    if((table->count + 1) * 2 > table->capacity) rehash(table, table->capacity * 2);
+    put(table->slots, table->capacity, pair);
+    table->count++;
+    return pair;
+}
+
+void cons_table_prune(ConsTable *table, Obj *(*survivor)(Obj *obj, void *arg), void *arg){
+    size_t live = 0;
+    for(size_t i = 0; i < table->capacity; i++){
+        if(!table->slots[i]) continue;
+        table->slots[i] = survivor(table->slots[i], arg);
+        if(table->slots[i]) live++;
+        else table->pruned++;
+    }
+    table->count = live;
+    // Addresses may have changed: rehash, shrinking to fit
+    size_t capacity = CONS_TABLE_MIN_CAPACITY;
+    while(capacity < live * 4) capacity *= 2;
+    rehash(table, capacity);
+}
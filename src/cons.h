@@ -0,0 +1,45 @@
+#ifndef CONS_H
+#define CONS_H
+
+#include <stddef.h>
+#include "object.h"
+
+// Hash-consing for CONS_SHARED (vm->conses).
+//
+// CONS_SHARED looks its two fields up in a per-VM table and returns the
+// pair already there, allocating one only on a miss. Fields compare by
+// value for ints and by identity for objects. Since the children of a
+// hash-consed pair are usually hash-consed too, equal structures end up
+// as the same pair, and comparing them is one pointer compare.
+// Hash-consed pairs carry OBJ_FLAG_INTERNED and may not be mutated. They
+// always live on the heap, even inside a region.
+//
+// The table is weak: it does not keep its pairs alive. Every collection
+// calls cons_table_prune() between marking and sweeping, which drops the
+// dead pairs and rehashes the rest, since a moving collector may have
+// changed both the pairs' and their fields' addresses.
+
+#define CONS_TABLE_MIN_CAPACITY 64
+
+typedef struct ConsTable {
+    Obj **slots;            // Open addressing on the fields; NULL = empty
+    size_t capacity;        // Power of two, at most half full
+    size_t count;
+    long lookups;
+    long hits;
+    long pruned;            // Dead pairs dropped by collections
+} ConsTable;
+
+struct VM;
+
+// The hash-consed pair (left . right): found, or allocated and entered.
+// NULL when the heap is out of memory.
+Obj *cons_shared(struct VM *vm, Value left, Value right);
+
+void cons_table_destroy(ConsTable *table);
+
+// Keeps the pairs for which survivor() returns an object, under that
+// (possibly moved) address, and drops the others
+void cons_table_prune(ConsTable *table, Obj *(*survivor)(Obj *obj, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,251 @@
+#include "escape.h"
+#include "opcodes.h"
+#include "vm.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Abstract operand stack of the block being analyzed
+typedef struct {
+    int *values;        // pc of the NEW_PAIR that pushed each entry, or -1
+    int depth;
+    char *escaped;      // By pc, for NEW_PAIRs
+    int regions;        // Code has REGION_BEGIN, so store barriers may raise
+} Block;
+
+// Words taken by an instruction (opcode and operand); 0 if unknown
+static int instruction_length(int opcode){
+    switch(opcode){
+        case OP_PUSH: case OP_JMP: case OP_JZ: case OP_JNZ:
+        case OP_STORE: case OP_LOAD: case OP_CALL: case OP_TRY:
+        case OP_CONST:
+            return 2;
+        case OP_POP: case OP_DUP: case OP_ADD: case OP_SUB: case OP_MUL:
+        case OP_DIV: case OP_CMP: case OP_SAME: case OP_HALT: case OP_RET:
+        case OP_NEW_PAIR: case OP_PAIR_LEFT: case OP_PAIR_RIGHT:
+        case OP_SET_LEFT: case OP_SET_RIGHT: case OP_NEW_WEAK:
+        case OP_NEW_EPHEMERON: case OP_WEAK_GET: case OP_EPHEMERON_VALUE:
+        case OP_CONS_SHARED: case OP_GC: case OP_SNAPSHOT: case OP_END_TRY:
+        case OP_REGION_BEGIN: case OP_REGION_END:
+        case OP_NEW_VECTOR: case OP_NEW_BYTES: case OP_ARRAY_GET:
+        case OP_ARRAY_SET: case OP_ARRAY_LEN: case OP_TABLE_NEW:
+        case OP_TABLE_GET: case OP_TABLE_PUT: case OP_TABLE_DELETE:
+        case OP_TABLE_SIZE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_jump(int opcode){
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ ||
+           opcode == OP_CALL || opcode == OP_TRY;
+}
+
+// Control leaves the block after these
+static int ends_block(int opcode){
+    return is_jump(opcode) || opcode == OP_RET || opcode == OP_HALT || opcode == OP_END_TRY;
+}
+
+static void push_value(Block *b, int value){
+    b->values[b->depth++] = value;
+}
+
+// Entries below the start of the block are never pairs made in it
+static int pop_value(Block *b){
+    return b->depth > 0 ? b->values[--b->depth] : -1;
+}
+
+static void escape(Block *b, int value){
+    if(value >= 0) b->escaped[value] = 1;
+}
+
+static void escape_stack(Block *b){
+    for(int i = 0; i < b->depth; i++) escape(b, b->values[i]);
+}
+
+// Marks code[] instruction starts and block leaders; 0 if code cannot be decoded
+static int find_blocks(const int *code, int size, char *start, char *leader){
+    for(int pc = 0; pc < size; ){
+        int length = instruction_length(code[pc]);
+        if(length == 0 || pc + length > size) return 0;
+        start[pc] = 1;
+        pc += length;
+    }
+    leader[0] = 1;
+    for(int pc = 0; pc < size; pc += instruction_length(code[pc])){
+        int opcode = code[pc];
+        if(is_jump(opcode)){
+            int target = code[pc + 1];
+            if(target < 0 || target >= size || !start[target]) return 0;
+            leader[target] = 1;
+        }
+        if(ends_block(opcode) && pc + instruction_length(opcode) < size){
+            leader[pc + instruction_length(opcode)] = 1;
+        }
+    }
+    return 1;
+}
+
+static void analyze_instruction(Block *b, int pc, int opcode){
+    switch(opcode){
+        case OP_PUSH: case OP_LOAD:
+            push_value(b, -1);
+            break;
+        case OP_POP:
+            pop_value(b);
+            break;
+        case OP_DUP:
+            push_value(b, b->depth > 0 ? b->values[b->depth - 1] : -1);
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+        case OP_SAME:
+            escape(b, pop_value(b));
+            escape(b, pop_value(b));
+            push_value(b, -1);
+            break;
+        case OP_STORE:
+            // May raise out of memory promoting a region object
+            if(b->regions) escape_stack(b);
+            escape(b, pop_value(b));
+            break;
+        case OP_JZ: case OP_JNZ:
+            escape(b, pop_value(b));
+            break;
+        case OP_NEW_PAIR:
+            // May raise out of memory: nothing on the stack may be local,
+            // and the operands become fields
+            escape_stack(b);
+            pop_value(b);
+            pop_value(b);
+            push_value(b, pc);
+            break;
+        case OP_PAIR_LEFT: case OP_PAIR_RIGHT:
+            pop_value(b);
+            push_value(b, -1);
+            break;
+        case OP_SET_LEFT: case OP_SET_RIGHT: {
+            // The region barrier may raise out of memory
+            if(b->regions) escape_stack(b);
+            escape(b, pop_value(b));
+            int pair = pop_value(b);
+            push_value(b, pair);
+            break;
+        }
+        case OP_WEAK_GET: case OP_EPHEMERON_VALUE: case OP_ARRAY_LEN:
+        case OP_TABLE_SIZE:
+            escape(b, pop_value(b));
+            push_value(b, -1);
+            break;
+        case OP_NEW_WEAK: case OP_NEW_VECTOR: case OP_NEW_BYTES:
+            escape_stack(b);
+            pop_value(b);
+            push_value(b, -1);
+            break;
+        case OP_TABLE_NEW: case OP_CONST:
+            escape_stack(b);
+            push_value(b, -1);
+            break;
+        case OP_NEW_EPHEMERON: case OP_CONS_SHARED: case OP_ARRAY_GET:
+        case OP_TABLE_GET: case OP_TABLE_DELETE:
+            escape_stack(b);
+            pop_value(b);
+            pop_value(b);
+            push_value(b, -1);
+            break;
+        case OP_ARRAY_SET: case OP_TABLE_PUT:
+            escape_stack(b);
+            pop_value(b);
+            pop_value(b);
+            pop_value(b);
+            push_value(b, -1);
+            break;
+        case OP_SNAPSHOT:
+            // Snapshots only describe heap objects
+            escape_stack(b);
+            break;
+        case OP_REGION_END:
+            // May raise out of memory promoting what the stack holds
+            escape_stack(b);
+            break;
+        default:
+            // GC, and the block ends handled by the caller
+            break;
+    }
+}
+
+LocalPairs *escape_analyze(int *code, int size){
+    if(size <= 0) return NULL;
+    LocalPairs *pairs = (LocalPairs*)malloc(sizeof(LocalPairs));
+    char *start = (char*)calloc(size, 1);
+    char *leader = (char*)calloc(size, 1);
+    char *escaped = (char*)calloc(size, 1);
+    int *values = (int*)malloc(size * sizeof(int));
+    int *slot_of = (int*)malloc(size * sizeof(int));
+    if(!pairs || !start || !leader || !escaped || !values || !slot_of ||
+       !find_blocks(code, size, start, leader)){
+        free(pairs);
+        pairs = NULL;
+        free(slot_of);
+    }
+    else{
+        Block b = {values, 0, escaped, 0};
+        for(int pc = 0; pc < size; pc++){
+            if(start[pc] && code[pc] == OP_REGION_BEGIN) b.regions = 1;
+        }
+        for(int pc = 0; pc < size; pc += instruction_length(code[pc])){
+            if(leader[pc]){
+                escape_stack(&b);
+                b.depth = 0;
+            }
+            analyze_instruction(&b, pc, code[pc]);
+            if(ends_block(code[pc])){
+                escape_stack(&b);
+                b.depth = 0;
+            }
+        }
+        escape_stack(&b);
+
+        pairs->slot_of = slot_of;
+        pairs->size = size;
+        pairs->sites = 0;
+        pairs->candidates = 0;
+        for(int pc = 0; pc < size; pc++){
+            slot_of[pc] = -1;
+            if(!start[pc] || code[pc] != OP_NEW_PAIR) continue;
+            pairs->candidates++;
+            if(escaped[pc]) continue;
+            code[pc] = OP_NEW_LOCAL_PAIR;
+            slot_of[pc] = pairs->sites++;
+        }
+    }
+    free(start);
+    free(leader);
+    free(escaped);
+    free(values);
+    return pairs;
+}
+
+void local_pairs_destroy(LocalPairs *pairs){
+    if(!pairs) return;
+    free(pairs->slot_of);
+    free(pairs);
+}
+
+int vm_attach_local_pairs(VM *vm, const LocalPairs *pairs){
+    Obj *scratch = NULL;
+    if(pairs && pairs->sites > 0){
+        scratch = (Obj*)calloc(pairs->sites, sizeof(Obj));
+        if(!scratch) return -1;
+        for(int i = 0; i < pairs->sites; i++){
+            scratch[i].type = OBJ_PAIR;
+            scratch[i].flags = OBJ_FLAG_LOCAL;
+            scratch[i].site = SITE_NONE;
+            scratch[i].as.pair.left = make_int_value(0);
+            scratch[i].as.pair.right = make_int_value(0);
+        }
+    }
+    free(vm->scratch);
+    vm->scratch = scratch;
+    vm->local_pairs = pairs;
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "object.h"
+
+// Load-time escape analysis for NEW_PAIR.
+//
+// The bytecode is split into basic blocks and each block is interpreted
+// over an abstract operand stack that records which NEW_PAIR produced each
+// entry. A pair escapes when it is stored (STORE, a field, an array), used
+// as anything but the pair operand of PAIR_LEFT/PAIR_RIGHT/SET_LEFT/
+// SET_RIGHT/POP/DUP, is still on the stack when the block ends (jump,
+// call, return, TRY, a jump target), or is on the stack when an
+// instruction that may raise runs (the handler would see it). The store
+// barriers of STORE and SET_LEFT/SET_RIGHT only raise when promoting a
+// region object, so they count only in code that has a REGION_BEGIN.
+//
+// Every NEW_PAIR whose pairs never escape is rewritten in place to
+// NEW_LOCAL_PAIR. Its pair lives in a scratch slot of the VM, one per
+// site: a block runs to completion before it can run again, so at most one
+// pair of a site is alive. Scratch pairs are never on a heap list; the
+// collector traces their fields when it finds them on the stack.
+
+typedef struct LocalPairs {
+    int *slot_of;       // By pc: scratch slot of a rewritten NEW_PAIR, else -1
+    int size;           // Words of code analyzed
+    int sites;          // NEW_PAIRs rewritten to NEW_LOCAL_PAIR
+    int candidates;     // NEW_PAIRs found
+} LocalPairs;
+
+// Analyzes and rewrites code[0..size). Returns NULL when out of memory or
+// when the code cannot be decoded (unknown opcode, jump into an operand);
+// code is then left unchanged. The result may be shared by several VMs.
+LocalPairs *escape_analyze(int *code, int size);
+void local_pairs_destroy(LocalPairs *pairs);
+
+struct VM;
+
+// Gives vm its scratch pairs for pairs (vm->local_pairs). Returns 0 on
+// success, -1 when out of memory.
+int vm_attach_local_pairs(struct VM *vm, const LocalPairs *pairs);
+
+#endif
@@ -0,0 +1,57 @@
+#include "finalize.h"
+#include "vm.h"
+#include <stdlib.h>
+#include <time.h>
+
+int finalizer_list_add(FinalizerList *list, FinalizerEntry entry){
+    if(list->count == list->capacity){
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        FinalizerEntry *grown = (FinalizerEntry*)realloc(list->entries, capacity * sizeof(FinalizerEntry));
+        if(!grown) return -1;
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    list->entries[list->count++] = entry;
+    return 0;
+}
+
+void finalizer_list_free(FinalizerList *list){
+    free(list->entries);
+    list->entries = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+int vm_register_finalizer(VM *vm, Obj *obj, Finalizer fn, void *data){
+    FinalizerEntry entry = {obj, fn, data};
+    return finalizer_list_add(&vm->finalizers, entry);
+}
+
+int vm_pending_finalizers(VM *vm){
+    return vm->finalize_queue.count - vm->finalize_head;
+}
+
+int vm_run_finalizers(VM *vm, int limit){
+    // A finalizer that triggers a collection may queue more; they wait
+    // for the next batch rather than nesting
+    if(vm->in_finalizer) return 0;
+    FinalizerList *queue = &vm->finalize_queue;
+    clock_t start = clock();
+    vm->in_finalizer = 1;
+    int ran = 0;
+    while(ran < limit && vm->finalize_head < queue->count){
+        // The entry stays queued (and rooted) while its finalizer runs
+        FinalizerEntry entry = queue->entries[vm->finalize_head];
+        entry.fn(vm, entry.obj, entry.data);
+        vm->finalize_head++;
+        ran++;
+    }
+    vm->in_finalizer = 0;
+    if(vm->finalize_head == queue->count){
+        queue->count = 0;
+        vm->finalize_head = 0;
+    }
+    vm->gc_stats.finalizers_run += ran;
+    vm->gc_stats.total_finalize_time += (double)(clock() - start) / CLOCKS_PER_SEC;
+    return ran;
+}
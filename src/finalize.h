@@ -0,0 +1,44 @@
+#ifndef FINALIZE_H
+#define FINALIZE_H
+
+#include "object.h"
+
+// Finalizers for objects that stand for external resources. A registered
+// object found dead by a collection is kept alive for one more cycle
+// (together with everything it reaches) and moved to its VM's finalization
+// queue. vm_run drains the queue in batches between instructions, so the
+// callbacks never run inside the GC pause. Each registration fires once;
+// the object is freed by a later collection unless the finalizer stored it
+// somewhere reachable. Registrations still pending at vm_free are dropped.
+
+#define FINALIZER_BATCH 32      // Finalizers run per instruction boundary
+
+struct VM;
+typedef void (*Finalizer)(struct VM *vm, Obj *obj, void *data);
+
+typedef struct {
+    Obj *obj;
+    Finalizer fn;
+    void *data;
+} FinalizerEntry;
+
+typedef struct {
+    FinalizerEntry *entries;
+    int count;
+    int capacity;
+} FinalizerList;
+
+// Registers fn to run once obj becomes unreachable; -1 if out of memory
+int vm_register_finalizer(struct VM *vm, Obj *obj, Finalizer fn, void *data);
+
+// Runs up to limit queued finalizers; returns how many ran
+int vm_run_finalizers(struct VM *vm, int limit);
+
+// Finalizers waiting in vm's queue
+int vm_pending_finalizers(struct VM *vm);
+
+// List helpers, also used by the collector
+int finalizer_list_add(FinalizerList *list, FinalizerEntry entry);
+void finalizer_list_free(FinalizerList *list);
+
+#endif
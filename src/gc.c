@@ -1,82 +1,399 @@
 #include "vm.h"
 #include "object.h"
+#include "heap.h"
+#include "immix.h"
 #include <stdio.h>
 #include <stdlib.h>
-<<<<<<< HEAD
-=======
 #include <time.h>
->>>>>>> dev_rishabh
 
-static void mark_object(Obj *obj);
-static void mark_value(Value val);
 static void sweep(VM *vm);
+static int sweep_list(VM *vm, Obj **head, Census *census);
+static int sweep_young(VM *vm, Census *census);
+static void clear_remembered(VM *vm);
+static void mark_heap(VM *vm, int minor);
+static void record_pause(GCStats *stats, double gc_time, int collected);
+
+// Generational mode only applies to the private malloc heap
+static int generational(VM *vm){
+    return vm->generational && !vm->shared && !vm->immix;
+}
 
 void gc(VM *vm){
+    if(vm->shared){
+        heap_collect(vm);
+        return;
+    }
+
+    if(vm->recorder) recorder_gc(vm->recorder);
+
     // Start timing
     clock_t start = clock();
     
     int before = vm->heap_size;
+    if (vm->trace) {
+        trace_event(vm->trace, "gc", TRACE_BEGIN, before);
+        trace_event(vm->trace, "mark", TRACE_BEGIN, before);
+    }
+    // Clears the block marks and picks the blocks to evacuate
+    if(vm->immix) immix_prepare(vm->immix);
     mark_roots(vm);
+    if (vm->trace) {
+        trace_event(vm->trace, "mark", TRACE_END, before);
+        trace_event(vm->trace, "sweep", TRACE_BEGIN, before);
+    }
     sweep(vm);
-<<<<<<< HEAD
-=======
     int after = vm->heap_size;
     int collected = before - after;
+    if (vm->trace) {
+        trace_event(vm->trace, "sweep", TRACE_END, collected);
+        trace_event(vm->trace, "gc", TRACE_END, collected);
+        trace_event(vm->trace, "heap", TRACE_COUNTER, after);
+    }
     
     // End timing
     clock_t end = clock();
     double gc_time = (double)(end - start) / CLOCKS_PER_SEC;
     
-    // Update statistics
-    vm->gc_stats.total_gc_calls++;
-    vm->gc_stats.total_objects_freed += collected;
-    vm->gc_stats.total_gc_time += gc_time;
+    record_pause(&vm->gc_stats, gc_time, collected);
+}
+
+// Generational minor collection: marks the young objects reachable from the
+// roots and the remembered set, frees the rest of the nursery and promotes
+// the survivors. The mature space is neither traced nor swept.
+void gc_minor(VM *vm){
+    if(!generational(vm)){
+        gc(vm);
+        return;
+    }
+    if(vm->recorder) recorder_gc(vm->recorder);
+    clock_t start = clock();
+    int before = vm->heap_size;
+    if (vm->trace) trace_event(vm->trace, "minor-gc", TRACE_BEGIN, before);
+    if (vm->remembered_count > vm->gc_stats.remembered_max) {
+        vm->gc_stats.remembered_max = vm->remembered_count;
+    }
+    mark_heap(vm, 1);
+    // Every survivor is promoted, so no mature object points at a young one
+    clear_remembered(vm);
+    vm->heap_size -= sweep_young(vm, NULL);
+    int collected = before - vm->heap_size;
+    if (vm->trace) {
+        trace_event(vm->trace, "minor-gc", TRACE_END, collected);
+        trace_event(vm->trace, "heap", TRACE_COUNTER, vm->heap_size);
+    }
+    vm->gc_stats.minor_gcs++;
+    record_pause(&vm->gc_stats, (double)(clock() - start) / CLOCKS_PER_SEC, collected);
+}
+
+// Remembers a mature object that now points at a young one, so the next
+// minor collection scans it as a root
+void gc_write_barrier(VM *vm, Obj *obj, Value value){
+    if(!vm->generational || value.type != VAL_OBJ || !value.as.obj) return;
+    if((obj->flags & (OBJ_FLAG_MATURE | OBJ_FLAG_REMEMBERED)) != OBJ_FLAG_MATURE) return;
+    if(value.as.obj->flags & OBJ_FLAG_MATURE) return;
+    if(vm->remembered_count == vm->remembered_capacity){
+        int capacity = vm->remembered_capacity ? vm->remembered_capacity * 2 : 256;
+        Obj **grown = (Obj**)realloc(vm->remembered, capacity * sizeof(Obj*));
+        if(!grown){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        vm->remembered = grown;
+        vm->remembered_capacity = capacity;
+    }
+    obj->flags |= OBJ_FLAG_REMEMBERED;
+    vm->remembered[vm->remembered_count++] = obj;
+}
+
+static void clear_remembered(VM *vm){
+    for(int i = 0; i < vm->remembered_count; i++){
+        vm->remembered[i]->flags &= ~OBJ_FLAG_REMEMBERED;
+    }
+    vm->remembered_count = 0;
+}
+
+static void record_pause(GCStats *stats, double gc_time, int collected){
+    stats->total_gc_calls++;
+    stats->total_objects_freed += collected;
+    stats->total_gc_time += gc_time;
     
     // Track min/max pause times
-    if (vm->gc_stats.total_gc_calls == 1) {
-        vm->gc_stats.min_gc_pause = gc_time;
-        vm->gc_stats.max_gc_pause = gc_time;
+    if (stats->total_gc_calls == 1) {
+        stats->min_gc_pause = gc_time;
+        stats->max_gc_pause = gc_time;
     } else {
-        if (gc_time < vm->gc_stats.min_gc_pause) {
-            vm->gc_stats.min_gc_pause = gc_time;
+        if (gc_time < stats->min_gc_pause) {
+            stats->min_gc_pause = gc_time;
         }
-        if (gc_time > vm->gc_stats.max_gc_pause) {
-            vm->gc_stats.max_gc_pause = gc_time;
+        if (gc_time > stats->max_gc_pause) {
+            stats->max_gc_pause = gc_time;
         }
     }
-    
->>>>>>> dev_rishabh
 }
 
-void mark_roots(VM *vm){
+// Allocation-driven collection policy shared by vm_run and native drivers
+void gc_collect_if_needed(VM *vm){
+    if(vm->shared){
+        // Shared heaps collect at safepoints; refills raise the request
+        if(heap_safepoint_pending(vm->shared)) heap_safepoint(vm);
+        return;
+    }
+    if(generational(vm)){
+        // Minor collections whenever the nursery fills; a major one once the
+        // mature space has doubled since the last
+        if(vm->young_size >= vm->nursery_size) gc_minor(vm);
+        if(vm->mature_size >= vm->major_threshold){
+            gc(vm);
+            vm->major_threshold = vm->mature_size * 2 + vm->nursery_size;
+        }
+        return;
+    }
+    if(vm->heap_size >= vm->gc_threshold) {
+        gc(vm);
+        vm->gc_threshold = vm->heap_size * 2 + 100; // Grow threshold
+    }
+}
+
+// Grey objects wait on a LIFO mark stack. Before being scanned they pass
+// through a small FIFO: entering it prefetches the object, and by the time
+// it leaves, `depth` other objects have been scanned, hiding the cache miss.
+// Children are pushed without being loaded and are marked when dequeued, so
+// the mark test also hits the prefetched line.
+typedef struct {
+    VM *vm;             // Decides between page bitmaps and Obj.marked
+    ImmixSpace *immix;  // Private Immix heap: fields may be evacuated
+    Obj **stack;
+    int count;
+    int capacity;
+    Obj *fifo[MARK_FIFO_SIZE];
+    int fifo_head;
+    int fifo_count;
+    int depth;          // FIFO entries in use; 0 scans straight off the stack
+    Obj *weaks;         // Weak refs reached so far, linked through as.weak.next
+    Obj *ephemerons;    // Ephemerons whose key is not yet known to be live
+    int budget;         // Stack entries before falling back to pointer reversal; 0 = no limit
+    int depth_first;    // COPY_ORDER_DEPTH: fields wait on `slots`, evacuated when popped
+    Obj ***slots;
+    int slot_count;
+    int slot_capacity;
+    long dsw_marked;    // Objects marked by pointer reversal
+    int minor;          // Generational minor collection: only young objects are marked
+} Marker;
+
+static void dsw_mark(Marker *m, Obj *root);
+
+static void marker_init(Marker *m, VM *vm){
+    m->vm = vm;
+    m->immix = vm->shared ? NULL : vm->immix;
+    m->stack = NULL;
+    m->count = 0;
+    m->capacity = 0;
+    m->fifo_head = 0;
+    m->fifo_count = 0;
+    m->weaks = NULL;
+    m->ephemerons = NULL;
+    m->budget = vm->mark_stack_budget > 0 ? vm->mark_stack_budget : 0;
+    m->depth_first = m->immix && vm->copy_order == COPY_ORDER_DEPTH;
+    m->slots = NULL;
+    m->slot_count = 0;
+    m->slot_capacity = 0;
+    m->dsw_marked = 0;
+    m->minor = 0;
+    m->depth = vm->mark_prefetch;
+    if(m->depth < 0) m->depth = 0;
+    if(m->depth > MARK_FIFO_SIZE) m->depth = MARK_FIFO_SIZE;
+}
+
+static void mark_push(Marker *m, Obj *obj){
+    if(obj == NULL) return;
+    if(m->budget && m->count == m->budget){
+        // Stack is at its budget: mark this subgraph without one
+        dsw_mark(m, obj);
+        return;
+    }
+    if(m->count == m->capacity){
+        int capacity = m->capacity ? m->capacity * 2 : 1024;
+        if(m->budget && capacity > m->budget) capacity = m->budget;
+        Obj **grown = (Obj**)realloc(m->stack, capacity * sizeof(Obj*));
+        if(!grown){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        m->stack = grown;
+        m->capacity = capacity;
+    }
+    m->stack[m->count++] = obj;
+}
+
+// With an Immix heap, the field's target may be evacuated; the field is
+// updated and the object's current address returned
+static Obj *visit_field(Marker *m, Obj **field){
+    Obj *obj = *field;
+    if(m->immix && !(obj->flags & OBJ_FLAG_LARGE)){
+        obj = immix_visit(m->immix, obj);
+        *field = obj;
+    }
+    return obj;
+}
+
+static void slot_push(Marker *m, Obj **field){
+    if(m->budget && m->slot_count == m->budget){
+        dsw_mark(m, visit_field(m, field));
+        return;
+    }
+    if(m->slot_count == m->slot_capacity){
+        int capacity = m->slot_capacity ? m->slot_capacity * 2 : 1024;
+        if(m->budget && capacity > m->budget) capacity = m->budget;
+        Obj ***grown = (Obj***)realloc(m->slots, capacity * sizeof(Obj**));
+        if(!grown){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        m->slots = grown;
+        m->slot_capacity = capacity;
+    }
+    m->slots[m->slot_count++] = field;
+}
+
+// Pushes the object a reference field points to. Breadth order evacuates
+// it now, next to its siblings; depth order pushes the field itself.
+static void mark_field(Marker *m, Obj **field){
+    if(*field == NULL) return;
+    if(m->depth_first) slot_push(m, field);
+    else mark_push(m, visit_field(m, field));
+}
+
+static void mark_value_field(Marker *m, Value *field){
+    if(field->type==VAL_OBJ){
+        mark_field(m, &field->as.obj);
+    }
+}
+
+// A root that may hold an object off the heap. Scratch pairs (escape.h)
+// are not heap objects, only their fields; region objects are traced
+// through the region instead.
+static void mark_root(Marker *m, Value *slot){
+    if(slot->type != VAL_OBJ || !slot->as.obj) return;
+    int flags = slot->as.obj->flags;
+    if(flags & OBJ_FLAG_LOCAL){
+        mark_root(m, &slot->as.obj->as.pair.left);
+        mark_root(m, &slot->as.obj->as.pair.right);
+    }
+    else if(!(flags & OBJ_FLAG_REGION)) mark_value_field(m, slot);
+}
+
+static void mark_root_field(Marker *m, Obj **field){
+    if(*field && !((*field)->flags & OBJ_FLAG_REGION)) mark_field(m, field);
+}
+
+// The heap objects a region object (region.h) points to live as long as
+// the region; so does the heap copy of a promoted one
+static void mark_region_object(Obj *object, void *arg){
+    Marker *m = (Marker*)arg;
+    if(object->flags & OBJ_FLAG_FORWARDED) mark_field(m, &object->next);
+    switch(object->type){
+        case OBJ_PAIR:
+            mark_root(m, &object->as.pair.left);
+            mark_root(m, &object->as.pair.right);
+            break;
+        case OBJ_CLOSURE:
+            mark_root_field(m, &object->as.closure.function);
+            mark_root_field(m, &object->as.closure.env);
+            break;
+        case OBJ_VECTOR:
+            for(int i = 0; i < object->as.vector.length; i++){
+                mark_root(m, &object->as.vector.items[i]);
+            }
+            break;
+        case OBJ_TABLE:
+            mark_root_field(m, &object->as.table.entries);
+            mark_root_field(m, &object->as.table.old);
+            break;
+        default:
+            break;
+    }
+}
+
+static void push_roots(Marker *m, VM *vm){
     // Mark all values on the stack
     for(int i=0;i<=vm->stack.sp;i++){
-        mark_value(vm->stack.data[i]);
+        mark_root(m, &vm->stack.data[i]);
     }
+    if(vm->region.depth > 0) region_for_each(&vm->region, mark_region_object, m);
     
     // Mark all values in VM memory (important for objects stored via STORE)
     for(int i=0;i<MEM_SIZE;i++){
         if(vm->valid[i]){
-            mark_value(vm->memory[i]);
+            mark_value_field(m, &vm->memory[i]);
         }
     }
-}
 
-static void mark_value(Value val){
-    if(val.type==VAL_OBJ){
-        mark_object(val.as.obj);
+    // Queued for finalization, so still referenced by the finalizer
+    for(int i = vm->finalize_head; i < vm->finalize_queue.count; i++){
+        mark_field(m, &vm->finalize_queue.entries[i].obj);
+    }
+
+    // Interned CONST strings stay cached for the next CONST
+    if(vm->constants){
+        for(int i = 0; i < vm->constant_pool->count; i++){
+            mark_field(m, &vm->constants[i]);
+        }
     }
 }
 
-static void mark_object(Obj *object){
-    if(object == NULL) return;
-    if(object->marked==1) return;
+// Sets the mark; returns 0 if the object was already marked
+static int try_mark(Marker *m, Obj *object){
+    VM *vm = m->vm;
+    // Minor collections take the mature space as live and never trace it
+    if(m->minor && (object->flags & OBJ_FLAG_MATURE)) return 0;
+    if(vm->immix && !(object->flags & OBJ_FLAG_LARGE)){
+        return immix_mark(vm->immix, object);
+    }
+    if(vm->shared && !(object->flags & OBJ_FLAG_LARGE)){
+        // Every object reachable from a shared VM lives in its pages
+        return heap_mark(object);
+    }
+    if(object->marked) return 0;
     object->marked = 1;
-    
+    return 1;
+}
+
+static int is_marked(Marker *m, Obj *object){
+    VM *vm = m->vm;
+    if(m->minor && (object->flags & OBJ_FLAG_MATURE)) return 1;
+    if(vm->immix && !(object->flags & OBJ_FLAG_LARGE)) return immix_is_marked(object);
+    if(vm->shared && !(object->flags & OBJ_FLAG_LARGE)) return heap_is_marked(object);
+    return object->marked;
+}
+
+static void prefetch_object(VM *vm, Obj *object){
+    __builtin_prefetch(object, 1);
+    if(vm->shared && !(object->flags & OBJ_FLAG_LARGE)){
+        HeapPage *page = heap_page_of(object);
+        __builtin_prefetch(&page->mark[(object - page->slots) >> 6], 1);
+    }
+}
+
+// Weak refs and ephemerons are not traced while marking but remembered for
+// the weak phase
+static void note_weak(Marker *m, Obj *object){
+    if(object->type == OBJ_WEAK){
+        // Referent is not traced; cleared after marking if it died
+        object->as.weak.next = m->weaks;
+        m->weaks = object;
+    }
+    else if(object->type == OBJ_EPHEMERON){
+        // Value is traced only once the key turns out to be live
+        object->as.ephemeron.next = m->ephemerons;
+        m->ephemerons = object;
+    }
+}
+
+static void scan_object(Marker *m, Obj *object){
     switch(object->type){
         case OBJ_PAIR:
-            mark_value(object->as.pair.left);
-            mark_value(object->as.pair.right);
+            mark_value_field(m, &object->as.pair.left);
+            mark_value_field(m, &object->as.pair.right);
             break;
             
         case OBJ_FUNCTION:
@@ -85,37 +402,439 @@ static void mark_object(Obj *object){
             
         case OBJ_CLOSURE:
             // Mark the function
-            mark_object(object->as.closure.function);
+            mark_field(m, &object->as.closure.function);
             // Mark the environment
-            mark_object(object->as.closure.env);
+            mark_field(m, &object->as.closure.env);
+            break;
+
+        case OBJ_WEAK:
+        case OBJ_EPHEMERON:
+            note_weak(m, object);
+            break;
+
+        case OBJ_VECTOR:
+            for(int i = 0; i < object->as.vector.length; i++){
+                mark_value_field(m, &object->as.vector.items[i]);
+            }
+            break;
+
+        case OBJ_BYTES:
+            // Raw data, nothing to trace
+            break;
+
+        case OBJ_TABLE:
+            mark_field(m, &object->as.table.entries);
+            mark_field(m, &object->as.table.old);
+            break;
+
+        case OBJ_STRING:
+            // Characters only
+            break;
+    }
+}
+
+// Reference fields as pointer reversal sees them: pair halves, closure
+// function/env, vector items, table buckets. Weak fields are never traced.
+static int ref_count(Obj *obj){
+    switch(obj->type){
+        case OBJ_PAIR:
+        case OBJ_CLOSURE:
+        case OBJ_TABLE:
+            return 2;
+        case OBJ_VECTOR:
+            return obj->as.vector.length;
+        default:
+            return 0;
+    }
+}
+
+static Obj *ref_get(Obj *obj, int i){
+    Value *val;
+    switch(obj->type){
+        case OBJ_CLOSURE:
+            return i == 0 ? obj->as.closure.function : obj->as.closure.env;
+        case OBJ_TABLE:
+            return i == 0 ? obj->as.table.entries : obj->as.table.old;
+        case OBJ_PAIR:
+            val = i == 0 ? &obj->as.pair.left : &obj->as.pair.right;
+            break;
+        default:
+            val = &obj->as.vector.items[i];
+            break;
+    }
+    return val->type == VAL_OBJ ? val->as.obj : NULL;
+}
+
+// Only called on fields that hold an object, so Value tags stay VAL_OBJ
+static void ref_set(Obj *obj, int i, Obj *target){
+    switch(obj->type){
+        case OBJ_CLOSURE:
+            if(i == 0) obj->as.closure.function = target;
+            else obj->as.closure.env = target;
+            break;
+        case OBJ_TABLE:
+            if(i == 0) obj->as.table.entries = target;
+            else obj->as.table.old = target;
+            break;
+        case OBJ_PAIR:
+            if(i == 0) obj->as.pair.left.as.obj = target;
+            else obj->as.pair.right.as.obj = target;
+            break;
+        default:
+            obj->as.vector.items[i].as.obj = target;
             break;
     }
 }
 
+// While an object is on the reversal path, Obj.marked holds DSW_VISITING
+// plus the index of the field being followed
+#define DSW_VISITING 2
+
+// Deutsch-Schorr-Waite marking of everything reachable from root, in
+// constant space. Going down a field, the field is pointed back at the
+// parent; coming back up, it is restored and the next field is tried.
+static void dsw_mark(Marker *m, Obj *root){
+    if(!try_mark(m, root)) return;
+    note_weak(m, root);
+    m->dsw_marked++;
+    Obj *parent = NULL;
+    Obj *cur = root;
+    cur->marked = DSW_VISITING;
+    for(;;){
+        int i = cur->marked - DSW_VISITING;
+        if(i < ref_count(cur)){
+            Obj *child = ref_get(cur, i);
+            if(child && m->immix && !(child->flags & OBJ_FLAG_LARGE)){
+                Obj *moved = immix_visit(m->immix, child);
+                if(moved != child) ref_set(cur, i, moved);
+                child = moved;
+            }
+            if(child && try_mark(m, child)){
+                note_weak(m, child);
+                m->dsw_marked++;
+                ref_set(cur, i, parent);
+                parent = cur;
+                cur = child;
+                cur->marked = DSW_VISITING;
+            }
+            else cur->marked++;
+            continue;
+        }
+
+        // Done with cur: page and block objects keep their mark in a bitmap
+        int side_table = (m->vm->shared || m->vm->immix) && !(cur->flags & OBJ_FLAG_LARGE);
+        cur->marked = side_table ? 0 : 1;
+        if(!parent) break;
+        Obj *up = parent;
+        int j = up->marked - DSW_VISITING;
+        parent = ref_get(up, j);
+        ref_set(up, j, cur);
+        up->marked++;
+        cur = up;
+    }
+}
+
+static void mark_drain(Marker *m){
+    for(;;){
+        // Depth order: each object is copied right after the one scanned
+        // before it, and a pair's right field is pushed last, so popped first
+        if(m->slot_count > 0){
+            Obj *obj = visit_field(m, m->slots[--m->slot_count]);
+            if(try_mark(m, obj)) scan_object(m, obj);
+            continue;
+        }
+
+        // Top up the FIFO from the stack, prefetching each entry
+        while(m->fifo_count < m->depth && m->count > 0){
+            Obj *obj = m->stack[--m->count];
+            prefetch_object(m->vm, obj);
+            m->fifo[(m->fifo_head + m->fifo_count++) & (MARK_FIFO_SIZE - 1)] = obj;
+        }
+
+        Obj *obj;
+        if(m->fifo_count > 0){
+            obj = m->fifo[m->fifo_head];
+            m->fifo_head = (m->fifo_head + 1) & (MARK_FIFO_SIZE - 1);
+            m->fifo_count--;
+        }
+        else if(m->count > 0) obj = m->stack[--m->count];
+        else break;
+
+        if(try_mark(m, obj)) scan_object(m, obj);
+    }
+}
+
+// Weak phase, after the strong graph is marked. An ephemeron's value is
+// traced once its key is marked; that can mark further keys, so passes
+// repeat until none resolves. Then dead referents and keys are cleared.
+// Returns the number of weak refs and ephemerons cleared.
+static long process_weak(Marker *m){
+    int progress = 1;
+    while(progress){
+        progress = 0;
+        Obj **link = &m->ephemerons;
+        while(*link){
+            Obj *eph = *link;
+            // Keys reached by marking may have moved
+            if(eph->as.ephemeron.key) eph->as.ephemeron.key = immix_resolve(eph->as.ephemeron.key);
+            if(eph->as.ephemeron.key && is_marked(m, eph->as.ephemeron.key)){
+                *link = eph->as.ephemeron.next;
+                mark_value_field(m, &eph->as.ephemeron.value);
+                progress = 1;
+            }
+            else link = &eph->as.ephemeron.next;
+        }
+        // New ephemerons found here are prepended and seen by the next pass
+        if(progress) mark_drain(m);
+    }
+
+    long cleared = 0;
+    for(Obj *eph = m->ephemerons; eph; eph = eph->as.ephemeron.next){
+        if(eph->as.ephemeron.key) cleared++;
+        eph->as.ephemeron.key = NULL;
+        eph->as.ephemeron.value = make_int_value(0);
+    }
+    for(Obj *weak = m->weaks; weak; weak = weak->as.weak.next){
+        Obj *referent = weak->as.weak.referent;
+        if(!referent) continue;
+        referent = immix_resolve(referent);
+        weak->as.weak.referent = referent;
+        if(!is_marked(m, referent)){
+            weak->as.weak.referent = NULL;
+            cleared++;
+        }
+    }
+    return cleared;
+}
+
+// Moves vm's registered objects that marking did not reach to its
+// finalization queue and pushes them, resurrecting what they reference
+static void queue_finalizers(Marker *m, VM *vm){
+    FinalizerList *registered = &vm->finalizers;
+    int first = vm->finalize_queue.count;
+    int i = 0;
+    while(i < registered->count){
+        registered->entries[i].obj = immix_resolve(registered->entries[i].obj);
+        FinalizerEntry entry = registered->entries[i];
+        if(is_marked(m, entry.obj)){
+            i++;
+            continue;
+        }
+        registered->entries[i] = registered->entries[--registered->count];
+        if(finalizer_list_add(&vm->finalize_queue, entry) != 0){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        vm->gc_stats.finalizers_queued++;
+    }
+    // Pushed once the queue has stopped growing, since fields may be pushed
+    // by address
+    for(int j = first; j < vm->finalize_queue.count; j++){
+        mark_field(m, &vm->finalize_queue.entries[j].obj);
+    }
+    int depth = vm_pending_finalizers(vm);
+    if(depth > vm->gc_stats.finalize_queue_max) vm->gc_stats.finalize_queue_max = depth;
+}
+
+// Everything between the strong mark and the sweep: weak processing, then
+// resurrection of dead finalizable objects. Weak refs to those objects are
+// already cleared; weak refs first reached through them are processed in a
+// second round. Returns the number of weak entries cleared.
+static long finish_marking(Marker *m, VM **vms, int count){
+    long cleared = process_weak(m);
+    m->weaks = NULL;
+    m->ephemerons = NULL;
+    for(int i = 0; i < count; i++){
+        queue_finalizers(m, vms[i]);
+    }
+    mark_drain(m);
+    return cleared + process_weak(m);
+}
+
+// Hash-consed pairs (cons.h) and interned strings (intern.h) are held
+// weakly: survivors at their current address
+static Obj *interned_survivor(Obj *object, void *arg){
+    Marker *m = (Marker*)arg;
+    object = immix_resolve(object);
+    return is_marked(m, object) ? object : NULL;
+}
+
+static void mark_heap(VM *vm, int minor){
+    Marker m;
+    marker_init(&m, vm);
+    m.minor = minor;
+    push_roots(&m, vm);
+    if(minor){
+        // Mature objects written with young pointers are roots as well
+        for(int i = 0; i < vm->remembered_count; i++){
+            scan_object(&m, vm->remembered[i]);
+        }
+    }
+    mark_drain(&m);
+    vm->gc_stats.weak_cleared += finish_marking(&m, &vm, 1);
+    if(vm->conses) cons_table_prune(vm->conses, interned_survivor, &m);
+    if(vm->strings) string_table_prune(vm->strings, interned_survivor, &m);
+    vm->gc_stats.dsw_marked += m.dsw_marked;
+    free(m.stack);
+    free(m.slots);
+}
+
+void mark_roots(VM *vm){
+    mark_heap(vm, 0);
+}
+
+// Page sweeps are pure bitmap work, so the census of every VM that keeps
+// one walks the objects before them
+static void census_shared(Obj *object, void *arg){
+    SharedHeap *heap = (SharedHeap*)arg;
+    int survived = (object->flags & OBJ_FLAG_LARGE) ? object->marked != 0 : heap_is_marked(object);
+    for(int i = 0; i < heap->mutator_count; i++){
+        Census *census = heap->mutators[i]->census;
+        if(census) census_record(census, object, survived);
+    }
+}
+
+// Stop-the-world collection of a shared heap. Every VM is marked before the
+// pages are swept, since objects allocated by one VM may be reachable only
+// through another VM's roots. Marks go to the page bitmaps, so the sweep
+// never touches the objects themselves.
+void gc_shared(SharedHeap *heap, VM *collector){
+    clock_t start = clock();
+    heap_retire_tlabs(heap);
+    long before = heap_count_allocated(heap);
+    if (collector->trace) {
+        trace_event(collector->trace, "gc", TRACE_BEGIN, before);
+        trace_event(collector->trace, "mark", TRACE_BEGIN, before);
+    }
+
+    Marker m;
+    marker_init(&m, collector);
+    for(int i = 0; i < heap->mutator_count; i++){
+        push_roots(&m, heap->mutators[i]);
+    }
+    mark_drain(&m);
+    heap->gc_stats.weak_cleared += finish_marking(&m, heap->mutators, heap->mutator_count);
+    for(int i = 0; i < heap->mutator_count; i++){
+        ConsTable *conses = heap->mutators[i]->conses;
+        if(conses) cons_table_prune(conses, interned_survivor, &m);
+        StringTable *strings = heap->mutators[i]->strings;
+        if(strings) string_table_prune(strings, interned_survivor, &m);
+    }
+    heap->gc_stats.dsw_marked += m.dsw_marked;
+    free(m.stack);
+    free(m.slots);
+    if (collector->trace) {
+        trace_event(collector->trace, "mark", TRACE_END, before);
+        trace_event(collector->trace, "sweep", TRACE_BEGIN, before);
+    }
+
+    int census = 0;
+    for(int i = 0; i < heap->mutator_count; i++){
+        if(heap->mutators[i]->census){
+            census_begin(heap->mutators[i]->census);
+            census = 1;
+        }
+    }
+    if(census) heap_for_each(heap, census_shared, heap);
+    heap->live = heap_sweep_pages(heap) + heap_sweep_large(heap);
+    long collected = before - heap->live;
+
+    if (collector->trace) {
+        trace_event(collector->trace, "sweep", TRACE_END, collected);
+        trace_event(collector->trace, "gc", TRACE_END, collected);
+        trace_event(collector->trace, "heap", TRACE_COUNTER, heap->live);
+    }
+    double gc_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    record_pause(&heap->gc_stats, gc_time, collected);
+    if (heap->live > heap->gc_stats.max_heap_size) {
+        heap->gc_stats.max_heap_size = heap->live;
+    }
+}
+
+// Immix has no per-object sweep: the census walks the blocks instead
+static void census_immix(Obj *object, void *arg){
+    census_record((Census*)arg, object, immix_is_marked(object));
+}
+
 static void sweep(VM *vm){
-    Obj **object = &vm->heap_head;
+    if(vm->census) census_begin(vm->census);
+    if(vm->immix){
+        if(vm->census) immix_for_each(vm->immix, census_immix, vm->census);
+        // No per-object sweep: the line marks decide the free space
+        vm->heap_size -= (int)(vm->immix->objects - vm->immix->marked);
+        immix_sweep(vm->immix);
+    }
+    if(generational(vm)){
+        // Remembered objects may be freed below; none is needed afterwards.
+        // The mature space goes first, before the survivors join it unmarked.
+        clear_remembered(vm);
+        int freed = sweep_list(vm, &vm->mature_head, vm->census) +
+                    sweep_list(vm, &vm->large_head, vm->census);
+        vm->mature_size -= freed;
+        vm->heap_size -= freed + sweep_young(vm, vm->census);
+        return;
+    }
+    vm->heap_size -= sweep_list(vm, &vm->heap_head, vm->census);
+    vm->heap_size -= sweep_list(vm, &vm->large_head, vm->census);
+}
+
+// Nursery sweep: frees the dead young objects and promotes the survivors to
+// the mature space. Returns the number of objects freed.
+static int sweep_young(VM *vm, Census *census){
+    int freed = 0;
+    Obj *object = vm->heap_head;
+    while(object){
+        Obj *next = object->next;
+        if(next) __builtin_prefetch(next, 1);
+        int survived = object->marked != 0;
+        if(census) census_record(census, object, survived);
+        if(vm->pretenure) pretenure_record(vm->pretenure, object->site, survived);
+        if(!survived){
+            free_object(vm, object);
+            freed++;
+        }
+        else{
+            object->marked = 0;
+            object->flags |= OBJ_FLAG_MATURE;
+            object->next = vm->mature_head;
+            vm->mature_head = object;
+            vm->mature_size++;
+            vm->gc_stats.objects_promoted++;
+        }
+        object = next;
+    }
+    vm->heap_head = NULL;
+    vm->young_size = 0;
+    return freed;
+}
+
+// Frees the unmarked objects of one list and clears the survivors' marks.
+// Returns the number of objects freed.
+static int sweep_list(VM *vm, Obj **object, Census *census){
+    int freed = 0;
     while(*object){
+        // Fetch the next header while this one is being examined
+        if((*object)->next) __builtin_prefetch((*object)->next, 1);
+        if(census) census_record(census, *object, (*object)->marked);
         if((*object)->marked==0){
             Obj *garbage = *object;
             *object = garbage->next;
-            free(garbage);
-<<<<<<< HEAD
-=======
-            vm->heap_size--;
->>>>>>> dev_rishabh
+            free_object(vm, garbage);
+            freed++;
         }
         else{
             (*object)->marked = 0;
             object = &(*object)->next;
         }
     }
-<<<<<<< HEAD
-}
-=======
+    return freed;
 }
 
 // Performance reporting function
 void print_gc_stats(VM *vm) {
+    // A shared heap keeps the collection statistics for all its VMs
+    GCStats *stats = vm->shared ? &vm->shared->gc_stats : &vm->gc_stats;
+    long alive = vm->shared ? heap_count_allocated(vm->shared) : vm->heap_size;
     printf("\n");
     printf("╔════════════════════════════════════════════════════════════╗\n");
     printf("║           Garbage Collection Performance Report           ║\n");
@@ -124,32 +843,90 @@ void print_gc_stats(VM *vm) {
     
     printf("Memory Statistics:\n");
     printf("  Total objects allocated:    %ld\n", vm->gc_stats.total_objects_allocated);
-    printf("  Total objects freed:        %ld\n", vm->gc_stats.total_objects_freed);
-    printf("  Objects still alive:        %d\n", vm->heap_size);
-    printf("  Peak heap size:             %d objects\n", vm->gc_stats.max_heap_size);
+    printf("  Total objects freed:        %ld\n", stats->total_objects_freed);
+    printf("  Objects still alive:        %ld\n", alive);
+    printf("  Peak heap size:             %d objects\n", stats->max_heap_size);
     printf("  Memory per object:          %zu bytes\n", sizeof(Obj));
     printf("  Peak memory usage:          ~%zu bytes\n", 
-           vm->gc_stats.max_heap_size * sizeof(Obj));
+           stats->max_heap_size * sizeof(Obj));
+    if (vm->shared) {
+        long committed, resident;
+        heap_memory_usage(vm->shared, &committed, &resident);
+        printf("  Committed heap bytes:       %ld (%d pages, %d returned)\n", committed,
+               vm->shared->page_count, vm->shared->released_pages);
+        printf("  Resident heap bytes:        %ld\n", resident);
+    } else if (vm->immix) {
+        printf("  Committed heap bytes:       %ld (%d Immix blocks) + %ld large\n",
+               immix_committed_bytes(vm->immix), vm->immix->block_count, vm->heap_bytes);
+        printf("  Resident heap bytes:        n/a (Immix heap)\n");
+    } else {
+        printf("  Committed heap bytes:       %ld (malloc)\n", vm->heap_bytes);
+        printf("  Resident heap bytes:        n/a (malloc heap)\n");
+    }
     printf("\n");
     
     printf("Garbage Collection Statistics:\n");
-    printf("  Total GC invocations:       %ld\n", vm->gc_stats.total_gc_calls);
-    printf("  Total GC time:              %.6f seconds\n", vm->gc_stats.total_gc_time);
+    printf("  Total GC invocations:       %ld\n", stats->total_gc_calls);
+    printf("  Total GC time:              %.6f seconds\n", stats->total_gc_time);
     
-    if (vm->gc_stats.total_gc_calls > 0) {
-        double avg_pause = vm->gc_stats.total_gc_time / vm->gc_stats.total_gc_calls;
+    if (stats->total_gc_calls > 0) {
+        double avg_pause = stats->total_gc_time / stats->total_gc_calls;
         printf("  Average GC pause:           %.6f seconds\n", avg_pause);
-        printf("  Min GC pause:               %.6f seconds\n", vm->gc_stats.min_gc_pause);
-        printf("  Max GC pause:               %.6f seconds\n", vm->gc_stats.max_gc_pause);
+        printf("  Min GC pause:               %.6f seconds\n", stats->min_gc_pause);
+        printf("  Max GC pause:               %.6f seconds\n", stats->max_gc_pause);
         
-        double avg_collected = (double)vm->gc_stats.total_objects_freed / vm->gc_stats.total_gc_calls;
+        double avg_collected = (double)stats->total_objects_freed / stats->total_gc_calls;
         printf("  Average objects/collection: %.1f\n", avg_collected);
     }
+    if (stats->dsw_marked > 0) {
+        printf("  Marked by pointer reversal: %ld objects\n", stats->dsw_marked);
+    }
+    if (!vm->shared && vm->immix && vm->immix->candidates_total > 0) {
+        printf("  Blocks picked to evacuate:  %ld\n", vm->immix->candidates_total);
+        printf("  Objects evacuated:          %ld (%ld bytes)\n", vm->immix->evacuated_total,
+               vm->immix->evacuated_bytes);
+    }
+    if (vm->gc_stats.minor_gcs > 0) {
+        printf("  Minor collections:          %ld (remembered set max %d)\n",
+               vm->gc_stats.minor_gcs, vm->gc_stats.remembered_max);
+        printf("  Objects promoted:           %ld\n", vm->gc_stats.objects_promoted);
+    }
+    if (vm->gc_stats.objects_pretenured > 0) {
+        printf("  Objects pretenured:         %ld\n", vm->gc_stats.objects_pretenured);
+    }
+    if (vm->region.allocated > 0) {
+        printf("  Region objects:             %ld in %ld regions (peak %ld bytes)\n",
+               vm->region.allocated, vm->region.regions, vm->region.peak_bytes);
+        printf("  Promoted out of regions:    %ld\n", vm->region.promoted);
+    }
+    if (vm->conses && vm->conses->lookups > 0) {
+        printf("  CONS_SHARED hits:           %ld of %ld (%.1f%%)\n", vm->conses->hits,
+               vm->conses->lookups, 100.0 * vm->conses->hits / vm->conses->lookups);
+        printf("  Hash-consed pairs:          %zu live, %ld pruned\n",
+               vm->conses->count, vm->conses->pruned);
+    }
+    if (vm->strings && vm->strings->lookups > 0) {
+        printf("  Interned strings:           %zu live, %ld pruned, %ld of %ld lookups hit\n",
+               vm->strings->count, vm->strings->pruned, vm->strings->hits, vm->strings->lookups);
+    }
+    if (stats->weak_cleared > 0) {
+        printf("  Weak refs cleared:          %ld\n", stats->weak_cleared);
+    }
+    if (vm->gc_stats.finalizers_queued > 0) {
+        printf("  Finalizers queued / run:    %ld / %ld\n", vm->gc_stats.finalizers_queued,
+               vm->gc_stats.finalizers_run);
+        printf("  Finalization queue max:     %d\n", vm->gc_stats.finalize_queue_max);
+        printf("  Finalizer time (no pause):  %.6f seconds\n", vm->gc_stats.total_finalize_time);
+    }
+    if (stats->emergency_gcs > 0 || stats->failed_allocations > 0) {
+        printf("  Emergency GCs (heap limit): %ld\n", stats->emergency_gcs);
+        printf("  Failed allocations:         %ld\n", stats->failed_allocations);
+    }
     printf("\n");
     
     printf("Collection Efficiency:\n");
     if (vm->gc_stats.total_objects_allocated > 0) {
-        double collection_rate = (double)vm->gc_stats.total_objects_freed / 
+        double collection_rate = (double)stats->total_objects_freed / 
                                  vm->gc_stats.total_objects_allocated * 100.0;
         printf("  Collection rate:            %.1f%%\n", collection_rate);
         printf("  Survival rate:              %.1f%%\n", 100.0 - collection_rate);
@@ -159,12 +936,12 @@ void print_gc_stats(VM *vm) {
     printf("Performance Impact:\n");
     printf("  Total instructions:         %ld\n", vm->instruction_count);
     if (vm->instruction_count > 0) {
-        double gc_overhead = (vm->gc_stats.total_gc_time / 
-                             (vm->gc_stats.total_gc_time + 0.0001)) * 100.0;
+        double gc_overhead = (stats->total_gc_time / 
+                             (stats->total_gc_time + 0.0001)) * 100.0;
         printf("  GC overhead:                %.2f%% of execution time\n", gc_overhead);
         
-        if (vm->gc_stats.total_gc_calls > 0) {
-            double instrs_per_gc = (double)vm->instruction_count / vm->gc_stats.total_gc_calls;
+        if (stats->total_gc_calls > 0) {
+            double instrs_per_gc = (double)vm->instruction_count / stats->total_gc_calls;
             printf("  Instructions per GC:        %.0f\n", instrs_per_gc);
         }
     }
@@ -172,4 +949,3 @@ void print_gc_stats(VM *vm) {
     printf("\n");
     printf("╚════════════════════════════════════════════════════════════╝\n");
 }
->>>>>>> dev_rishabh
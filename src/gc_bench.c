@@ -0,0 +1,602 @@
+/* GC benchmark suite: seeded, parameterized workloads driven through the
+ * public allocation API, with warmup/repeat loops and CSV/JSON output.
+ *
+ *   ./gc_bench                          all workloads, table output
+ *   ./gc_bench --workload trees --repeat 10 --format csv --output trees.csv
+ *   ./gc_bench --seed 7 --scale 4 --format json
+ *
+ * Every workload keeps its live data reachable from the VM stack/memory and
+ * only collects at gc_collect_if_needed() points, exactly like vm_run. */
+
+#include "vm.h"
+#include "object.h"
+#include "value.h"
+#include "heap.h"
+#include "immix.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_RUNS 64
+
+typedef struct {
+    unsigned long long state;
+} Rng;
+
+typedef struct {
+    int scale;            // Multiplies every workload size
+    double cycle_ratio;   // Random graph: fraction of back edges
+    int cache_capacity;   // LRU: entries kept (<= MEM_SIZE)
+} BenchParams;
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*run)(VM *vm, const BenchParams *p, Rng *rng);
+} Workload;
+
+typedef struct {
+    const char *name;
+    void (*configure)(VM *vm);
+} GcVariant;
+
+typedef struct {
+    double seconds;
+    long allocated;
+    long gc_calls;
+    double gc_seconds;
+    double max_pause;
+    int peak_heap;
+} RunResult;
+
+/* ---------------------------------------------------------------- helpers */
+
+static unsigned long long rng_next(Rng *rng){
+    // xorshift64*
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 2685821657736338717ULL;
+}
+
+static int rng_below(Rng *rng, int n){
+    return (int)(rng_next(rng) % (unsigned long long)n);
+}
+
+static double rng_unit(Rng *rng){
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_seconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* -------------------------------------------------------------- workloads */
+
+// Leaves a complete tree of the given depth on top of the stack
+static void build_tree(VM *vm, int depth){
+    if(depth <= 0){
+        push(&vm->stack, make_obj_value(new_pair(vm, make_int_value(0), make_int_value(0))));
+        gc_collect_if_needed(vm);
+        return;
+    }
+    build_tree(vm, depth - 1);
+    build_tree(vm, depth - 1);
+    Value right = pop(&vm->stack);
+    Value left = pop(&vm->stack);
+    push(&vm->stack, make_obj_value(new_pair(vm, left, right)));
+    gc_collect_if_needed(vm);
+}
+
+// GCBench: a long-lived tree plus many short-lived trees of growing depth
+static void run_binary_trees(VM *vm, const BenchParams *p, Rng *rng){
+    (void)rng;
+    int max_depth = 12;
+    for(int s = p->scale; s > 1; s /= 2) max_depth++;
+
+    build_tree(vm, max_depth);                   // long-lived, stays on the stack
+    for(int depth = 4; depth <= max_depth; depth += 2){
+        int iterations = 1 << (max_depth - depth + 2);
+        for(int i = 0; i < iterations; i++){
+            build_tree(vm, depth);
+            pop(&vm->stack);
+        }
+    }
+    pop(&vm->stack);
+}
+
+// One long list kept alive while every node also produces a garbage pair
+static void run_linked_list(VM *vm, const BenchParams *p, Rng *rng){
+    int length = 100000 * p->scale;
+    push(&vm->stack, make_int_value(0));
+    for(int i = 0; i < length; i++){
+        Value head = pop(&vm->stack);
+        push(&vm->stack, make_obj_value(new_pair(vm, make_int_value(i), head)));
+        new_pair(vm, make_int_value(rng_below(rng, 1000)), make_int_value(i));
+        gc_collect_if_needed(vm);
+    }
+    pop(&vm->stack);
+}
+
+// Random graphs: a spine keeps every node reachable, each node gets one
+// random edge; cycle_ratio of those point forward, closing cycles
+static void run_random_graph(VM *vm, const BenchParams *p, Rng *rng){
+    int nodes = 20000 * p->scale;
+    int rounds = 5;
+    Obj **index = (Obj**)malloc(sizeof(Obj*) * nodes);
+    if(!index) return;
+
+    for(int r = 0; r < rounds; r++){
+        // No collection happens while index[] holds raw pointers
+        Value spine = make_int_value(0);
+        for(int i = 0; i < nodes; i++){
+            Value edge = i ? make_obj_value(index[rng_below(rng, i)]) : make_int_value(0);
+            index[i] = new_pair(vm, spine, edge);
+            spine = make_obj_value(index[i]);
+        }
+        for(int i = 0; i < nodes - 1; i++){
+            if(rng_unit(rng) < p->cycle_ratio){
+                int target = i + 1 + rng_below(rng, nodes - i - 1);
+                index[i]->as.pair.right = make_obj_value(index[target]);
+            }
+        }
+        push(&vm->stack, spine);
+        for(int i = 0; i < nodes; i++){
+            new_pair(vm, make_int_value(i), make_int_value(r));   // churn
+            gc_collect_if_needed(vm);
+        }
+        pop(&vm->stack);
+    }
+    free(index);
+}
+
+// Chains of closures, each capturing an environment that holds the previous one
+static void run_closure_chain(VM *vm, const BenchParams *p, Rng *rng){
+    (void)rng;
+    int length = 2000;
+    int chains = 50 * p->scale;
+    vm->memory[0] = make_obj_value(new_function(vm, 0, 1));
+    vm->valid[0] = 1;
+
+    for(int c = 0; c < chains; c++){
+        push(&vm->stack, make_int_value(0));
+        for(int i = 0; i < length; i++){
+            // No collection between the two allocations, so env needs no root
+            Obj *env = new_pair(vm, make_int_value(i), peek(&vm->stack));
+            Obj *closure = new_closure(vm, vm->memory[0].as.obj, env);
+            pop(&vm->stack);
+            push(&vm->stack, make_obj_value(closure));
+            gc_collect_if_needed(vm);
+        }
+        pop(&vm->stack);
+    }
+    vm->valid[0] = 0;
+}
+
+// LRU cache in vm->memory: misses build a fresh 8-pair entry and evict the
+// least recently used one
+static void run_lru_churn(VM *vm, const BenchParams *p, Rng *rng){
+    int capacity = p->cache_capacity;
+    int keyspace = capacity * 4;
+    int operations = 50000 * p->scale;
+    int *keys = (int*)malloc(sizeof(int) * capacity);
+    long *last_use = (long*)calloc(capacity, sizeof(long));
+    if(!keys || !last_use){
+        free(keys);
+        free(last_use);
+        return;
+    }
+    for(int i = 0; i < capacity; i++) keys[i] = -1;
+
+    for(long op = 1; op <= operations; op++){
+        int key = rng_below(rng, keyspace);
+        int slot = -1, victim = 0;
+        for(int i = 0; i < capacity; i++){
+            if(keys[i] == key){
+                slot = i;
+                break;
+            }
+            if(last_use[i] < last_use[victim]) victim = i;
+        }
+        if(slot < 0){
+            slot = victim;
+            Value entry = make_int_value(key);
+            for(int k = 0; k < 8; k++){
+                entry = make_obj_value(new_pair(vm, make_int_value(k), entry));
+            }
+            vm->memory[slot] = entry;
+            vm->valid[slot] = 1;
+            keys[slot] = key;
+            gc_collect_if_needed(vm);
+        }
+        last_use[slot] = op;
+    }
+    for(int i = 0; i < capacity; i++) vm->valid[i] = 0;
+    free(keys);
+    free(last_use);
+}
+
+static const Workload workloads[] = {
+    {"trees",   "GCBench binary trees",              run_binary_trees},
+    {"list",    "long linked list + churn",          run_linked_list},
+    {"graph",   "random graph with cycles",          run_random_graph},
+    {"closure", "closure/environment chains",        run_closure_chain},
+    {"lru",     "LRU cache churn",                   run_lru_churn},
+    {NULL, NULL, NULL}
+};
+
+/* ----------------------------------------------------------- GC variants */
+
+static void configure_marksweep(VM *vm){
+    (void)vm;
+}
+
+// Baseline for the marking prefetch queue: scan straight off the mark stack
+static void configure_marksweep_noprefetch(VM *vm){
+    vm->mark_prefetch = 0;
+}
+
+// Constant-space marking: a one-entry mark stack, so nearly every object
+// is marked by pointer reversal
+static void configure_marksweep_dsw(VM *vm){
+    vm->mark_stack_budget = 1;
+}
+
+// Private mark-region heap: bump allocation into free lines, with
+// fragmented blocks evacuated while marking
+static void configure_immix(VM *vm){
+    vm->immix = immix_create();
+    if(!vm->immix){
+        printf("Out of memory\n");
+        exit(1);
+    }
+}
+
+// Evacuation in depth-first order, a pair's right field first
+static void configure_immix_depth(VM *vm){
+    configure_immix(vm);
+    vm->copy_order = COPY_ORDER_DEPTH;
+}
+
+// Nursery plus mature space, minor collections between major ones
+static void configure_generational(VM *vm){
+    vm->generational = 1;
+}
+
+// Shared paged heap with one mutator; marks and sweeps through page bitmaps
+static void configure_paged_with(VM *vm, const BitmapKernels *kernels){
+    SharedHeap *heap = heap_create();
+    if(!heap || !kernels || heap_attach(heap, vm) != 0){
+        printf("Paged heap unavailable (kernels not supported on this CPU?)\n");
+        exit(1);
+    }
+    heap->kernels = kernels;
+}
+
+static void configure_paged(VM *vm){
+    configure_paged_with(vm, bitmap_kernels_best());
+}
+
+// Chunks advised for transparent huge pages (fewer TLB misses while marking)
+static void configure_paged_huge(VM *vm){
+    configure_paged_with(vm, bitmap_kernels_best());
+    vm->shared->huge_pages = 1;
+}
+
+static void configure_paged_scalar(VM *vm){
+    configure_paged_with(vm, bitmap_kernels_named("scalar"));
+}
+
+static void configure_paged_sse2(VM *vm){
+    configure_paged_with(vm, bitmap_kernels_named("sse2"));
+}
+
+static void configure_paged_avx2(VM *vm){
+    configure_paged_with(vm, bitmap_kernels_named("avx2"));
+}
+
+static const GcVariant variants[] = {
+    {"marksweep", configure_marksweep},
+    {"marksweep-noprefetch", configure_marksweep_noprefetch},
+    {"marksweep-dsw", configure_marksweep_dsw},
+    {"immix", configure_immix},
+    {"immix-depth", configure_immix_depth},
+    {"generational", configure_generational},
+    {"paged", configure_paged},
+    {"paged-huge", configure_paged_huge},
+    {"paged-scalar", configure_paged_scalar},
+    {"paged-sse2", configure_paged_sse2},
+    {"paged-avx2", configure_paged_avx2},
+    {NULL, NULL}
+};
+
+/* --------------------------------------------------------- bitmap kernels */
+
+// Times the page-bitmap kernels alone, scalar against SIMD, on synthetic
+// bitmaps for `objects` slots: 90% of slots allocated, half of those marked
+static void run_bitmap_bench(FILE *out, long objects, int repeat, Rng *rng){
+    long pages = (objects + HEAP_PAGE_OBJECTS - 1) / HEAP_PAGE_OBJECTS;
+    size_t words = (size_t)pages * HEAP_PAGE_WORDS;
+    uint64_t *alloc_src = (uint64_t*)calloc(words, sizeof(uint64_t));
+    uint64_t *mark_src = (uint64_t*)calloc(words, sizeof(uint64_t));
+    uint64_t *alloc = (uint64_t*)malloc(words * sizeof(uint64_t));
+    uint64_t *mark = (uint64_t*)malloc(words * sizeof(uint64_t));
+    if(!alloc_src || !mark_src || !alloc || !mark){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < words * 64; i++){
+        if(rng_unit(rng) < 0.9){
+            alloc_src[i >> 6] |= 1ULL << (i & 63);
+            if(rng_unit(rng) < 0.5) mark_src[i >> 6] |= 1ULL << (i & 63);
+        }
+    }
+
+    fprintf(out, "%ld objects in %ld pages, best of %d\n", pages * HEAP_PAGE_OBJECTS, pages, repeat);
+    fprintf(out, "%-8s %10s %10s %12s %10s\n", "kernels", "sweep ms", "count ms", "find_run ms", "live");
+    const char *names[] = {"scalar", "sse2", "avx2"};
+    for(int k = 0; k < 3; k++){
+        const BitmapKernels *kernels = bitmap_kernels_named(names[k]);
+        if(!kernels){
+            fprintf(out, "%-8s (not supported on this CPU)\n", names[k]);
+            continue;
+        }
+        double sweep_best = 1e9, count_best = 1e9, run_best = 1e9;
+        long live = 0;
+        for(int r = 0; r < repeat; r++){
+            memcpy(alloc, alloc_src, words * sizeof(uint64_t));
+            memcpy(mark, mark_src, words * sizeof(uint64_t));
+
+            double start = now_seconds();
+            live = 0;
+            for(size_t w = 0; w < words; w += HEAP_PAGE_WORDS){
+                live += kernels->sweep(alloc + w, mark + w, HEAP_PAGE_WORDS);
+            }
+            double t = now_seconds() - start;
+            if(t < sweep_best) sweep_best = t;
+
+            start = now_seconds();
+            long counted = 0;
+            for(size_t w = 0; w < words; w += HEAP_PAGE_WORDS){
+                counted += kernels->count(alloc + w, HEAP_PAGE_WORDS);
+            }
+            t = now_seconds() - start;
+            if(t < count_best) count_best = t;
+            if(counted != live) fprintf(out, "%s: count mismatch\n", names[k]);
+
+            // Enumerate every free run, as TLAB refills do
+            start = now_seconds();
+            for(size_t w = 0; w < words; w += HEAP_PAGE_WORDS){
+                int from = 0, first, length;
+                while((length = kernels->find_run(alloc + w, HEAP_PAGE_WORDS, from, &first)) > 0){
+                    from = first + length;
+                }
+            }
+            t = now_seconds() - start;
+            if(t < run_best) run_best = t;
+        }
+        fprintf(out, "%-8s %10.3f %10.3f %12.3f %10ld\n", names[k], sweep_best * 1e3,
+                count_best * 1e3, run_best * 1e3, live);
+    }
+    free(alloc_src);
+    free(mark_src);
+    free(alloc);
+    free(mark);
+}
+
+/* ----------------------------------------------------------------- driver */
+
+static RunResult run_once(const Workload *w, const GcVariant *variant,
+                          const BenchParams *p, unsigned long long seed){
+    RunResult result;
+    VM *vm = vm_new(NULL);
+    if(!vm){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    variant->configure(vm);
+    Rng rng = {seed ? seed : 1};
+
+    double start = now_seconds();
+    w->run(vm, p, &rng);
+    result.seconds = now_seconds() - start;
+
+    // Collections of a shared heap are accounted on the heap, not the VM
+    SharedHeap *heap = vm->shared;
+    GCStats *stats = heap ? &heap->gc_stats : &vm->gc_stats;
+    result.allocated = vm->gc_stats.total_objects_allocated;
+    result.gc_calls = stats->total_gc_calls;
+    result.gc_seconds = stats->total_gc_time;
+    result.max_pause = stats->max_gc_pause;
+    result.peak_heap = stats->max_heap_size;
+
+    vm_free(vm);
+    heap_destroy(heap);
+    return result;
+}
+
+static int by_seconds(const void *a, const void *b){
+    double x = ((const RunResult*)a)->seconds, y = ((const RunResult*)b)->seconds;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    const char *variant;
+    const char *workload;
+    int runs;
+    double median, min, max, stddev;
+    double throughput;      // Allocations per second at the median
+    long allocated;
+    long gc_calls;
+    double gc_seconds;      // Median-run GC time
+    double max_pause;       // Worst pause over all runs
+    int peak_heap;
+} Summary;
+
+static Summary summarize(const char *variant, const Workload *w, RunResult *runs, int n){
+    Summary s;
+    qsort(runs, n, sizeof(RunResult), by_seconds);
+    RunResult *mid = &runs[n / 2];
+    double mean = 0.0, var = 0.0;
+    for(int i = 0; i < n; i++) mean += runs[i].seconds;
+    mean /= n;
+    for(int i = 0; i < n; i++) var += (runs[i].seconds - mean) * (runs[i].seconds - mean);
+
+    s.variant = variant;
+    s.workload = w->name;
+    s.runs = n;
+    s.median = n % 2 ? mid->seconds : (runs[n / 2 - 1].seconds + mid->seconds) / 2;
+    s.min = runs[0].seconds;
+    s.max = runs[n - 1].seconds;
+    s.stddev = n > 1 ? sqrt(var / (n - 1)) : 0.0;
+    s.allocated = mid->allocated;
+    s.throughput = s.median > 0 ? mid->allocated / s.median : 0.0;
+    s.gc_calls = mid->gc_calls;
+    s.gc_seconds = mid->gc_seconds;
+    s.max_pause = 0.0;
+    s.peak_heap = mid->peak_heap;
+    for(int i = 0; i < n; i++){
+        if(runs[i].max_pause > s.max_pause) s.max_pause = runs[i].max_pause;
+    }
+    return s;
+}
+
+static void print_header(FILE *out, const char *format){
+    if(strcmp(format, "csv") == 0){
+        fprintf(out, "variant,workload,runs,median_s,min_s,max_s,stddev_s,"
+                     "allocations,allocs_per_s,gc_calls,gc_s,max_pause_s,peak_heap\n");
+    }
+    else if(strcmp(format, "json") == 0){
+        fprintf(out, "[\n");
+    }
+    else{
+        fprintf(out, "%-20s %-8s %10s %10s %10s %12s %8s %10s %10s\n",
+                "variant", "workload", "median ms", "min ms", "max ms",
+                "Mallocs/s", "GCs", "GC ms", "max pause");
+    }
+}
+
+static void print_summary(FILE *out, const char *format, const Summary *s, int first){
+    if(strcmp(format, "csv") == 0){
+        fprintf(out, "%s,%s,%d,%.6f,%.6f,%.6f,%.6f,%ld,%.0f,%ld,%.6f,%.6f,%d\n",
+                s->variant, s->workload, s->runs, s->median, s->min, s->max, s->stddev,
+                s->allocated, s->throughput, s->gc_calls, s->gc_seconds, s->max_pause,
+                s->peak_heap);
+    }
+    else if(strcmp(format, "json") == 0){
+        fprintf(out, "%s  {\"variant\":\"%s\",\"workload\":\"%s\",\"runs\":%d,"
+                     "\"median_s\":%.6f,\"min_s\":%.6f,\"max_s\":%.6f,\"stddev_s\":%.6f,"
+                     "\"allocations\":%ld,\"allocs_per_s\":%.0f,\"gc_calls\":%ld,"
+                     "\"gc_s\":%.6f,\"max_pause_s\":%.6f,\"peak_heap\":%d}",
+                first ? "" : ",\n", s->variant, s->workload, s->runs, s->median, s->min,
+                s->max, s->stddev, s->allocated, s->throughput, s->gc_calls, s->gc_seconds,
+                s->max_pause, s->peak_heap);
+    }
+    else{
+        fprintf(out, "%-20s %-8s %10.2f %10.2f %10.2f %12.2f %8ld %10.2f %10.3f\n",
+                s->variant, s->workload, s->median * 1e3, s->min * 1e3, s->max * 1e3,
+                s->throughput / 1e6, s->gc_calls, s->gc_seconds * 1e3, s->max_pause * 1e3);
+    }
+}
+
+static void usage(const char *prog){
+    printf("Usage: %s [options]\n", prog);
+    printf("  --workload NAME   run one workload (default: all)\n");
+    printf("  --gc NAME         GC variant (default: all)\n");
+    printf("  --warmup N        untimed runs before measuring (default 1)\n");
+    printf("  --repeat N        measured runs, median reported (default 5)\n");
+    printf("  --seed N          PRNG seed (default 42)\n");
+    printf("  --scale N         size multiplier (default 1)\n");
+    printf("  --cycles F        random graph back-edge ratio (default 0.3)\n");
+    printf("  --format F        table, csv or json (default table)\n");
+    printf("  --output FILE     write results to FILE instead of stdout\n");
+    printf("  --bitmap-bench N  time the page-bitmap kernels on N objects, then exit\n");
+    printf("Workloads:\n");
+    for(int i = 0; workloads[i].name; i++){
+        printf("  %-10s %s\n", workloads[i].name, workloads[i].description);
+    }
+    printf("Variants:");
+    for(int i = 0; variants[i].name; i++) printf(" %s", variants[i].name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]){
+    BenchParams params = {1, 0.3, 256};
+    const char *only_workload = NULL, *only_variant = NULL;
+    const char *format = "table", *output = NULL;
+    int warmup = 1, repeat = 5;
+    long bitmap_objects = 0;
+    unsigned long long seed = 42;
+
+    for(int i = 1; i < argc; i++){
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if(strcmp(arg, "--help") == 0){
+            usage(argv[0]);
+            return 0;
+        }
+        if(!val){
+            usage(argv[0]);
+            return 1;
+        }
+        if(strcmp(arg, "--workload") == 0) only_workload = val;
+        else if(strcmp(arg, "--gc") == 0) only_variant = val;
+        else if(strcmp(arg, "--warmup") == 0) warmup = atoi(val);
+        else if(strcmp(arg, "--repeat") == 0) repeat = atoi(val);
+        else if(strcmp(arg, "--seed") == 0) seed = strtoull(val, NULL, 10);
+        else if(strcmp(arg, "--scale") == 0) params.scale = atoi(val);
+        else if(strcmp(arg, "--cycles") == 0) params.cycle_ratio = atof(val);
+        else if(strcmp(arg, "--format") == 0) format = val;
+        else if(strcmp(arg, "--output") == 0) output = val;
+        else if(strcmp(arg, "--bitmap-bench") == 0) bitmap_objects = atol(val);
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if(repeat < 1) repeat = 1;
+    if(repeat > MAX_RUNS) repeat = MAX_RUNS;
+    if(params.scale < 1) params.scale = 1;
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if(!out){
+        perror("failed to open output file");
+        return 1;
+    }
+
+    if(bitmap_objects > 0){
+        Rng rng = {seed ? seed : 1};
+        run_bitmap_bench(out, bitmap_objects, repeat, &rng);
+        if(output) fclose(out);
+        return 0;
+    }
+
+    print_header(out, format);
+    int first = 1;
+    RunResult runs[MAX_RUNS];
+    for(int v = 0; variants[v].name; v++){
+        if(only_variant && strcmp(only_variant, variants[v].name) != 0) continue;
+        for(int w = 0; workloads[w].name; w++){
+            if(only_workload && strcmp(only_workload, workloads[w].name) != 0) continue;
+            for(int i = 0; i < warmup; i++){
+                run_once(&workloads[w], &variants[v], &params, seed);
+            }
+            // Same seed every run: the repeats measure noise, not input variance
+            for(int i = 0; i < repeat; i++){
+                runs[i] = run_once(&workloads[w], &variants[v], &params, seed);
+            }
+            Summary s = summarize(variants[v].name, &workloads[w], runs, repeat);
+            print_summary(out, format, &s, first);
+            first = 0;
+            fflush(out);
+        }
+    }
+    if(strcmp(format, "json") == 0) fprintf(out, "\n]\n");
+    if(output) fclose(out);
+    return 0;
+}
@@ -0,0 +1,499 @@
+/* Offline GC policy simulator for allocation traces recorded by the VM
+ * (vm --record, see recorder.h).
+ *
+ *   gcsim run.gctrace                          default policy table
+ *   gcsim run.gctrace --policy marksweep:1.5 --policy generational:1024
+ *
+ * The trace is replayed once per policy: allocations, pointer stores and
+ * root changes rebuild the object graph, and the policy decides when to
+ * collect. A collection marks from the roots like the VM would, so the
+ * live sets are exact; pause times come from a linear cost model
+ * (--mark-ns per object traced, --sweep-ns per object swept, --free-ns per
+ * object handed back to malloc, --block-ns per Immix block). The defaults
+ * were fitted to the VM's measured pauses on benchmark/persistent_tree.
+ *
+ * Policies:
+ *   marksweep:G        collect at live * G + 100 objects (the VM uses 2)
+ *   marksweep:+N       collect at live + N objects
+ *   generational:N     minor collection every N young objects, major once
+ *                      the mature space doubles (as vm --generational)
+ *   markregion:G       threshold like marksweep:G, but the sweep only
+ *                      visits 32KB blocks (as vm --immix, no fragmentation)
+ *
+ * Weak references hold nothing; ephemeron values are treated as strong and
+ * finalizers are not replayed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "recorder.h"
+
+#define MEMORY_SLOTS 1024           /* MEM_SIZE in vm.h */
+#define REGION_BLOCK_BYTES 32768    /* IMMIX_BLOCK_BYTES in immix.h */
+#define MAX_POLICIES 16
+
+typedef struct {
+    uint8_t tag;
+    uint32_t a, b, c;       /* See load_trace */
+} Event;
+
+typedef struct {
+    Event *events;
+    size_t count;
+    uint32_t objects;       /* Ids 1..objects */
+    uint8_t *type;
+    uint32_t *size;
+    uint32_t *field_start;  /* Field slots of each object, CSR over ids */
+    long recorded_gcs;
+    long file_bytes;
+} Trace;
+
+enum { ENGINE_MARKSWEEP, ENGINE_GENERATIONAL, ENGINE_MARKREGION };
+
+typedef struct {
+    char label[32];
+    int engine;
+    double growth;          /* marksweep/markregion: threshold = live * growth + 100 */
+    long headroom;          /* ... or live + headroom when growth is 0 */
+    long nursery;           /* generational */
+} Policy;
+
+typedef struct {
+    double mark_ns;
+    double sweep_ns;
+    double free_ns;
+    double block_ns;
+} CostModel;
+
+typedef struct {
+    long gcs;
+    long minor_gcs;
+    double total_ns;
+    double max_ns;
+    long peak_objects;
+    long peak_bytes;
+    long marked;            /* Objects traced, all collections */
+} Result;
+
+/* Replay state */
+typedef struct {
+    const Trace *t;
+    uint32_t *fields;
+    uint8_t *mature;        /* Generational: promoted */
+    uint8_t *remembered;
+    uint32_t *mark_epoch;
+    uint32_t epoch;
+    uint32_t *young;        /* Resident ids; the only list unless generational */
+    size_t young_count;
+    uint32_t *old;
+    size_t old_count;
+    uint32_t *remembered_ids;
+    size_t remembered_count;
+    uint32_t *work;
+    uint32_t memory[MEMORY_SLOTS];
+    uint32_t stack[STACK_SIZE];
+    int depth;
+    long bytes;             /* Resident bytes */
+} Heap;
+
+static void die(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n ? n : 1, size);
+    if (!p) die("Out of memory");
+    return p;
+}
+
+static uint32_t read_varint(const unsigned char **p, const unsigned char *end) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*p >= end) die("Truncated trace");
+        unsigned char byte = *(*p)++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    die("Corrupt trace (varint too long)");
+    return 0;
+}
+
+/* Reference to id, relative to the next id (see recorder.h) */
+static uint32_t read_ref(const unsigned char **p, const unsigned char *end, uint32_t next_id) {
+    uint32_t ref = read_varint(p, end);
+    if (ref == 0) return 0;
+    if (ref >= next_id) die("Corrupt trace (reference before the first object)");
+    return next_id - ref;
+}
+
+/* Events keep absolute ids: ALLOC a=type b=size c=id, FIELD a=obj b=field
+   c=target, MEMORY/STACK a=slot c=target, DEPTH a=depth */
+static void load_trace(const char *path, Trace *t) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (length < (long)sizeof(RecorderHeader)) die("Not an allocation trace (too short)");
+    unsigned char *data = xcalloc((size_t)length, 1);
+    if (fread(data, (size_t)length, 1, fp) != 1) die("Truncated trace");
+    fclose(fp);
+
+    RecorderHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, RECORDER_MAGIC, sizeof(h.magic)) != 0 || h.version != RECORDER_VERSION)
+        die("Not an allocation trace (bad magic or version)");
+
+    memset(t, 0, sizeof(*t));
+    t->file_bytes = length;
+    const unsigned char *p = data + sizeof(h), *end = data + length;
+    size_t cap = 1024, type_cap = 1024;
+    t->events = xcalloc(cap, sizeof(Event));
+    t->type = xcalloc(type_cap, sizeof(uint8_t));
+    t->size = xcalloc(type_cap, sizeof(uint32_t));
+    uint32_t *field_count = xcalloc(type_cap, sizeof(uint32_t));
+    uint32_t next_id = 1;
+    int done = 0;
+
+    while (!done) {
+        if (p >= end) die("Truncated trace (no end marker)");
+        Event e = {*p++, 0, 0, 0};
+        switch (e.tag) {
+            case REC_END:
+                done = 1;
+                continue;
+            case REC_ALLOC:
+                if (p >= end) die("Truncated trace");
+                e.a = *p++;
+                e.b = read_varint(&p, end);
+                e.c = next_id++;
+                if (e.c >= type_cap) {
+                    type_cap *= 2;
+                    t->type = realloc(t->type, type_cap * sizeof(uint8_t));
+                    t->size = realloc(t->size, type_cap * sizeof(uint32_t));
+                    field_count = realloc(field_count, type_cap * sizeof(uint32_t));
+                    if (!t->type || !t->size || !field_count) die("Out of memory");
+                }
+                t->type[e.c] = (uint8_t)e.a;
+                t->size[e.c] = e.b;
+                field_count[e.c] = 0;
+                break;
+            case REC_FIELD:
+                e.a = read_ref(&p, end, next_id);
+                e.b = read_varint(&p, end);
+                e.c = read_ref(&p, end, next_id);
+                if (!e.a) die("Corrupt trace (store into no object)");
+                if (e.b + 1 > field_count[e.a]) field_count[e.a] = e.b + 1;
+                break;
+            case REC_MEMORY:
+            case REC_STACK:
+                e.a = read_varint(&p, end);
+                e.c = read_ref(&p, end, next_id);
+                if (e.a >= (e.tag == REC_MEMORY ? MEMORY_SLOTS : STACK_SIZE)) die("Corrupt trace (bad root slot)");
+                break;
+            case REC_DEPTH:
+                e.a = read_varint(&p, end);
+                if (e.a > STACK_SIZE) die("Corrupt trace (bad stack depth)");
+                break;
+            case REC_GC:
+                t->recorded_gcs++;
+                break;
+            default:
+                die("Corrupt trace (unknown event)");
+        }
+        if (t->count == cap) {
+            cap *= 2;
+            t->events = realloc(t->events, cap * sizeof(Event));
+            if (!t->events) die("Out of memory");
+        }
+        t->events[t->count++] = e;
+    }
+    free(data);
+
+    t->objects = next_id - 1;
+    t->field_start = xcalloc((size_t)next_id + 1, sizeof(uint32_t));
+    for (uint32_t id = 1; id < next_id; id++) {
+        t->field_start[id + 1] = t->field_start[id] + field_count[id];
+    }
+    free(field_count);
+}
+
+static void free_trace(Trace *t) {
+    free(t->events);
+    free(t->type);
+    free(t->size);
+    free(t->field_start);
+}
+
+/* ---- Replay ---------------------------------------------------------- */
+
+static void heap_init(Heap *h, const Trace *t) {
+    memset(h, 0, sizeof(*h));
+    size_t n = (size_t)t->objects + 1;
+    h->t = t;
+    h->fields = xcalloc(t->field_start[n], sizeof(uint32_t));
+    h->mature = xcalloc(n, 1);
+    h->remembered = xcalloc(n, 1);
+    h->mark_epoch = xcalloc(n, sizeof(uint32_t));
+    h->young = xcalloc(n, sizeof(uint32_t));
+    h->old = xcalloc(n, sizeof(uint32_t));
+    h->remembered_ids = xcalloc(n, sizeof(uint32_t));
+    h->work = xcalloc(n, sizeof(uint32_t));
+}
+
+static void heap_free(Heap *h) {
+    free(h->fields);
+    free(h->mature);
+    free(h->remembered);
+    free(h->mark_epoch);
+    free(h->young);
+    free(h->old);
+    free(h->remembered_ids);
+    free(h->work);
+}
+
+static size_t push_root(Heap *h, size_t sp, uint32_t id, int minor) {
+    if (!id || h->mark_epoch[id] == h->epoch) return sp;
+    if (minor && h->mature[id]) return sp;
+    h->mark_epoch[id] = h->epoch;
+    h->work[sp++] = id;
+    return sp;
+}
+
+/* Marks everything reachable from the roots (minor: young objects only,
+   with the remembered set as extra roots); returns objects traced */
+static long mark(Heap *h, int minor) {
+    const Trace *t = h->t;
+    long marked = 0;
+    size_t sp = 0;
+    h->epoch++;
+    for (int i = 0; i < MEMORY_SLOTS; i++) sp = push_root(h, sp, h->memory[i], minor);
+    for (int i = 0; i < h->depth; i++) sp = push_root(h, sp, h->stack[i], minor);
+    if (minor) {
+        for (size_t i = 0; i < h->remembered_count; i++) {
+            uint32_t id = h->remembered_ids[i];
+            for (uint32_t f = t->field_start[id]; f < t->field_start[id + 1]; f++) {
+                sp = push_root(h, sp, h->fields[f], minor);
+            }
+        }
+        marked += (long)h->remembered_count;
+    }
+    while (sp) {
+        uint32_t id = h->work[--sp];
+        marked++;
+        for (uint32_t f = t->field_start[id]; f < t->field_start[id + 1]; f++) {
+            sp = push_root(h, sp, h->fields[f], minor);
+        }
+    }
+    return marked;
+}
+
+/* Keeps the marked ids of list; promote moves them to the mature list */
+static size_t sweep(Heap *h, uint32_t *list, size_t count, int promote) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t id = list[i];
+        if (h->mark_epoch[id] == h->epoch) {
+            if (promote) {
+                h->mature[id] = 1;
+                h->old[h->old_count++] = id;
+            }
+            else list[kept++] = id;
+        }
+        else h->bytes -= h->t->size[id];
+    }
+    return kept;
+}
+
+static void clear_remembered(Heap *h) {
+    for (size_t i = 0; i < h->remembered_count; i++) h->remembered[h->remembered_ids[i]] = 0;
+    h->remembered_count = 0;
+}
+
+static void record_pause(Result *r, double ns, long marked) {
+    r->gcs++;
+    r->total_ns += ns;
+    if (ns > r->max_ns) r->max_ns = ns;
+    r->marked += marked;
+}
+
+static void note_peak(Result *r, Heap *h) {
+    long objects = (long)(h->young_count + h->old_count);
+    if (objects > r->peak_objects) r->peak_objects = objects;
+    if (h->bytes > r->peak_bytes) r->peak_bytes = h->bytes;
+}
+
+static long next_threshold(const Policy *p, long live) {
+    if (p->growth > 0) return (long)(live * p->growth) + 100;
+    return live + p->headroom;
+}
+
+static void full_collection(Heap *h, const Policy *p, const CostModel *cost, Result *r) {
+    long resident = (long)(h->young_count + h->old_count);
+    long blocks = (h->bytes + REGION_BLOCK_BYTES - 1) / REGION_BLOCK_BYTES;
+    long marked = mark(h, 0);
+    h->old_count = sweep(h, h->old, h->old_count, 0);
+    h->young_count = sweep(h, h->young, h->young_count, p->engine == ENGINE_GENERATIONAL);
+    clear_remembered(h);
+    long freed = resident - (long)(h->young_count + h->old_count);
+    double ns = cost->mark_ns * marked;
+    /* Mark-region reclaims whole lines: no per-object sweep or free */
+    if (p->engine == ENGINE_MARKREGION) ns += cost->block_ns * blocks;
+    else ns += cost->sweep_ns * resident + cost->free_ns * freed;
+    record_pause(r, ns, marked);
+}
+
+static void minor_collection(Heap *h, const CostModel *cost, Result *r) {
+    long young = (long)h->young_count;
+    long old = (long)h->old_count;
+    long marked = mark(h, 1);
+    h->young_count = sweep(h, h->young, h->young_count, 1);
+    clear_remembered(h);
+    long freed = young - ((long)h->old_count - old);
+    record_pause(r, cost->mark_ns * marked + cost->sweep_ns * young + cost->free_ns * freed, marked);
+    r->minor_gcs++;
+}
+
+static void simulate(const Trace *t, const Policy *p, const CostModel *cost, Result *r) {
+    Heap h;
+    heap_init(&h, t);
+    memset(r, 0, sizeof(*r));
+    long threshold = p->growth > 0 ? 100 : p->headroom;
+    long major_threshold = p->nursery * 4;
+
+    for (size_t i = 0; i < t->count; i++) {
+        const Event *e = &t->events[i];
+        switch (e->tag) {
+            case REC_ALLOC:
+                /* Collect before the object exists: it is not rooted yet */
+                note_peak(r, &h);
+                if (p->engine == ENGINE_GENERATIONAL) {
+                    if ((long)h.young_count >= p->nursery) minor_collection(&h, cost, r);
+                    if ((long)h.old_count >= major_threshold) {
+                        full_collection(&h, p, cost, r);
+                        major_threshold = (long)h.old_count * 2 + p->nursery;
+                    }
+                }
+                else if ((long)h.young_count >= threshold) {
+                    full_collection(&h, p, cost, r);
+                    threshold = next_threshold(p, (long)h.young_count);
+                }
+                h.young[h.young_count++] = e->c;
+                h.bytes += e->b;
+                break;
+            case REC_FIELD:
+                h.fields[t->field_start[e->a] + e->b] = e->c;
+                /* Write barrier */
+                if (h.mature[e->a] && e->c && !h.mature[e->c] && !h.remembered[e->a]) {
+                    h.remembered[e->a] = 1;
+                    h.remembered_ids[h.remembered_count++] = e->a;
+                }
+                break;
+            case REC_MEMORY:
+                h.memory[e->a] = e->c;
+                break;
+            case REC_STACK:
+                h.stack[e->a] = e->c;
+                break;
+            case REC_DEPTH:
+                h.depth = (int)e->a;
+                break;
+        }
+    }
+    note_peak(r, &h);
+    heap_free(&h);
+}
+
+/* ---- Command line ---------------------------------------------------- */
+
+static int parse_policy(const char *spec, Policy *p) {
+    memset(p, 0, sizeof(*p));
+    snprintf(p->label, sizeof(p->label), "%s", spec);
+    const char *colon = strchr(spec, ':');
+    size_t name_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    const char *arg = colon ? colon + 1 : NULL;
+    char *end;
+
+    if (name_len == 9 && strncmp(spec, "marksweep", 9) == 0) p->engine = ENGINE_MARKSWEEP;
+    else if (name_len == 10 && strncmp(spec, "markregion", 10) == 0) p->engine = ENGINE_MARKREGION;
+    else if (name_len == 12 && strncmp(spec, "generational", 12) == 0) {
+        p->engine = ENGINE_GENERATIONAL;
+        p->nursery = arg ? strtol(arg, &end, 10) : 4096;
+        return arg && (*end || p->nursery < 1) ? -1 : 0;
+    }
+    else return -1;
+
+    if (!arg) p->growth = 2.0;
+    else if (*arg == '+') {
+        p->headroom = strtol(arg + 1, &end, 10);
+        if (*end || p->headroom < 1) return -1;
+    }
+    else {
+        p->growth = strtod(arg, &end);
+        if (*end || p->growth < 1.0) return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <file.gctrace> [--policy SPEC]... [--mark-ns N] [--sweep-ns N] [--free-ns N] [--block-ns N]\n", prog);
+    fprintf(stderr, "  SPEC: marksweep[:G|:+N]  generational[:N]  markregion[:G|:+N]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *defaults[] = {
+        "marksweep:2", "marksweep:1.5", "marksweep:4", "marksweep:+4096",
+        "generational:1024", "generational:4096", "generational:16384", "markregion:2", NULL
+    };
+    Policy policies[MAX_POLICIES];
+    int policy_count = 0;
+    CostModel cost = {60.0, 8.0, 25.0, 1000.0};
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            if (policy_count == MAX_POLICIES) die("Too many policies");
+            if (parse_policy(argv[++i], &policies[policy_count++]) != 0) {
+                fprintf(stderr, "Invalid policy: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--mark-ns") == 0 && i + 1 < argc) cost.mark_ns = atof(argv[++i]);
+        else if (strcmp(argv[i], "--sweep-ns") == 0 && i + 1 < argc) cost.sweep_ns = atof(argv[++i]);
+        else if (strcmp(argv[i], "--free-ns") == 0 && i + 1 < argc) cost.free_ns = atof(argv[++i]);
+        else if (strcmp(argv[i], "--block-ns") == 0 && i + 1 < argc) cost.block_ns = atof(argv[++i]);
+        else if (!path && argv[i][0] != '-') path = argv[i];
+        else usage(argv[0]);
+    }
+    if (!path) usage(argv[0]);
+    if (policy_count == 0) {
+        for (int i = 0; defaults[i]; i++) parse_policy(defaults[i], &policies[policy_count++]);
+    }
+
+    Trace t;
+    load_trace(path, &t);
+    long allocated_bytes = 0;
+    for (uint32_t id = 1; id <= t.objects; id++) allocated_bytes += t.size[id];
+    printf("Trace: %zu events, %u objects (%ld KB), %ld bytes on disk, %ld collections recorded\n",
+           t.count, t.objects, allocated_bytes / 1024, t.file_bytes, t.recorded_gcs);
+    printf("Cost model: %.1f ns/object marked, %.1f ns/object swept, %.1f ns/object freed, %.1f ns/block\n\n",
+           cost.mark_ns, cost.sweep_ns, cost.free_ns, cost.block_ns);
+
+    printf("%-20s %7s %7s %12s %12s %12s %12s %10s %10s\n", "policy", "GCs", "minor",
+           "marked", "total ms", "avg ms", "max ms", "peak objs", "peak KB");
+    for (int i = 0; i < policy_count; i++) {
+        Result r;
+        simulate(&t, &policies[i], &cost, &r);
+        printf("%-20s %7ld %7ld %12ld %12.3f %12.4f %12.4f %10ld %10ld\n", policies[i].label, r.gcs,
+               r.minor_gcs, r.marked, r.total_ns / 1e6, r.gcs ? r.total_ns / 1e6 / r.gcs : 0.0,
+               r.max_ns / 1e6, r.peak_objects, r.peak_bytes / 1024);
+    }
+    free_trace(&t);
+    return 0;
+}
@@ -0,0 +1,419 @@
+#include "heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define HEAP_CHUNK_BYTES ((size_t)HEAP_CHUNK_PAGES * HEAP_PAGE_BYTES)
+
+#define HEAP_MIN_THRESHOLD (TLAB_OBJECTS * 8)
+
+_Static_assert(sizeof(HeapPage) <= HEAP_PAGE_BYTES, "HeapPage must fit its alignment");
+
+SharedHeap *heap_create(void){
+    SharedHeap *heap = (SharedHeap*)calloc(1, sizeof(SharedHeap));
+    if(!heap) return NULL;
+    pthread_mutex_init(&heap->lock, NULL);
+    pthread_cond_init(&heap->parked_cond, NULL);
+    pthread_cond_init(&heap->resume_cond, NULL);
+    heap->kernels = bitmap_kernels_best();
+    heap->decay = HEAP_DEFAULT_DECAY;
+    heap->gc_threshold = HEAP_MIN_THRESHOLD;
+    return heap;
+}
+
+void heap_destroy(SharedHeap *heap){
+    if(!heap) return;
+    Obj *obj = heap->large;
+    while(obj){
+        Obj *next = obj->next;
+        free_object(NULL, obj);
+        obj = next;
+    }
+    HeapChunk *chunk = heap->chunks;
+    while(chunk){
+        HeapChunk *next = chunk->next;
+        munmap(chunk->base, HEAP_CHUNK_BYTES);
+        free(chunk);
+        chunk = next;
+    }
+    free(heap->mutators);
+    pthread_mutex_destroy(&heap->lock);
+    pthread_cond_destroy(&heap->parked_cond);
+    pthread_cond_destroy(&heap->resume_cond);
+    free(heap);
+}
+
+int heap_attach(SharedHeap *heap, VM *vm){
+    pthread_mutex_lock(&heap->lock);
+    if(heap->mutator_count == heap->mutator_capacity){
+        int capacity = heap->mutator_capacity ? heap->mutator_capacity * 2 : 8;
+        VM **grown = (VM**)realloc(heap->mutators, capacity * sizeof(VM*));
+        if(!grown){
+            pthread_mutex_unlock(&heap->lock);
+            return -1;
+        }
+        heap->mutators = grown;
+        heap->mutator_capacity = capacity;
+    }
+    heap->mutators[heap->mutator_count++] = vm;
+    vm->shared = heap;
+    vm->tlab_cursor = NULL;
+    vm->tlab_limit = NULL;
+    pthread_mutex_unlock(&heap->lock);
+    return 0;
+}
+
+static void set_bits(uint64_t *bits, int from, int count, int value){
+    for(int i = from; i < from + count; i++){
+        if(value) bits[i >> 6] |= 1ULL << (i & 63);
+        else bits[i >> 6] &= ~(1ULL << (i & 63));
+    }
+}
+
+// Unused TLAB slots are still flagged as allocated; clear them
+static void retire_tlab(VM *vm){
+    if(vm->tlab_cursor < vm->tlab_limit){
+        HeapPage *page = heap_page_of(vm->tlab_cursor);
+        int from = (int)(vm->tlab_cursor - page->slots);
+        set_bits(page->alloc, from, (int)(vm->tlab_limit - vm->tlab_cursor), 0);
+    }
+    vm->tlab_cursor = NULL;
+    vm->tlab_limit = NULL;
+}
+
+void heap_detach(VM *vm){
+    SharedHeap *heap = vm->shared;
+    if(!heap) return;
+    pthread_mutex_lock(&heap->lock);
+    for(int i = 0; i < heap->mutator_count; i++){
+        if(heap->mutators[i] == vm){
+            heap->mutators[i] = heap->mutators[--heap->mutator_count];
+            break;
+        }
+    }
+    retire_tlab(vm);
+    vm->shared = NULL;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// Reserve HEAP_CHUNK_BYTES of address space, aligned to the page size (or
+// to the huge page size), by over-mapping and trimming both ends
+static HeapChunk *reserve_chunk(SharedHeap *heap){
+    size_t align = heap->huge_pages ? HEAP_HUGE_PAGE_BYTES : HEAP_PAGE_BYTES;
+    size_t span = HEAP_CHUNK_BYTES + align;
+    char *raw = (char*)mmap(NULL, span, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(raw == MAP_FAILED) return NULL;
+    char *base = (char*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if(base > raw) munmap(raw, base - raw);
+    size_t tail = (raw + span) - (base + HEAP_CHUNK_BYTES);
+    if(tail) munmap(base + HEAP_CHUNK_BYTES, tail);
+
+#ifdef MADV_HUGEPAGE
+    if(heap->huge_pages) madvise(base, HEAP_CHUNK_BYTES, MADV_HUGEPAGE);
+#endif
+
+    HeapChunk *chunk = (HeapChunk*)malloc(sizeof(HeapChunk));
+    if(!chunk){
+        munmap(base, HEAP_CHUNK_BYTES);
+        return NULL;
+    }
+    chunk->base = base;
+    chunk->used = 0;
+    chunk->next = heap->chunks;
+    heap->chunks = chunk;
+    return chunk;
+}
+
+// Fresh mappings are zero-filled, so the bitmaps start out clear
+static int heap_fits(SharedHeap *heap, size_t bytes){
+    return heap->max_bytes <= 0 ||
+           (long)heap->page_count * HEAP_PAGE_BYTES + heap->large_bytes + (long)bytes <= heap->max_bytes;
+}
+
+static HeapPage *add_page(SharedHeap *heap){
+    if(!heap_fits(heap, HEAP_PAGE_BYTES)) return NULL;
+    HeapChunk *chunk = heap->chunks;
+    if(!chunk || chunk->used == HEAP_CHUNK_PAGES){
+        chunk = reserve_chunk(heap);
+        if(!chunk) return NULL;
+    }
+    HeapPage *page = (HeapPage*)(chunk->base + (size_t)chunk->used++ * HEAP_PAGE_BYTES);
+    page->next = heap->pages;
+    heap->pages = page;
+    heap->page_count++;
+    return page;
+}
+
+static void release_page(SharedHeap *heap, HeapPage *page){
+    int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if(heap->use_madv_free) advice = MADV_FREE;
+#endif
+    madvise((char*)page + HEAP_RELEASE_OFFSET, HEAP_PAGE_BYTES - HEAP_RELEASE_OFFSET, advice);
+    page->released = 1;
+    heap->released_pages++;
+    heap->pages_returned++;
+}
+
+void heap_memory_usage(SharedHeap *heap, long *committed, long *resident){
+    *committed = (long)(heap->page_count - heap->released_pages) * HEAP_PAGE_BYTES + heap->large_bytes;
+    *resident = heap->large_bytes;      // Large objects are assumed touched
+
+    long os_page = sysconf(_SC_PAGESIZE);
+    for(HeapChunk *chunk = heap->chunks; chunk; chunk = chunk->next){
+        size_t bytes = (size_t)chunk->used * HEAP_PAGE_BYTES;
+        size_t count = (bytes + os_page - 1) / os_page;
+#ifdef __APPLE__
+        char *vec = (char*)malloc(count);
+#else
+        unsigned char *vec = (unsigned char*)malloc(count);
+#endif
+        if(!vec) continue;
+        if(mincore(chunk->base, bytes, vec) == 0){
+            for(size_t i = 0; i < count; i++){
+                if(vec[i] & 1) *resident += os_page;
+            }
+        }
+        free(vec);
+    }
+}
+
+static void safepoint_locked(VM *vm);
+
+Obj *heap_refill_tlab(VM *vm){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+
+    // Next-fit over the pages' allocation bitmaps; grow when all are full
+    HeapPage *page = heap->alloc_page;
+    int start = 0, length = 0;
+    int emergency = 0;
+    while(!length){
+        if(!page){
+            page = add_page(heap);
+            if(!page && !emergency){
+                // Limit (or mmap) refused a page: collect once, then rescan.
+                // Safe mid-instruction because allocating opcodes keep their
+                // operands on the stack.
+                emergency = 1;
+                heap->gc_stats.emergency_gcs++;
+                __atomic_store_n(&heap->safepoint_requested, 1, __ATOMIC_RELEASE);
+                safepoint_locked(vm);
+                page = heap->alloc_page;
+                heap->alloc_bit = 0;
+                continue;
+            }
+            if(!page){
+                heap->gc_stats.failed_allocations++;
+                pthread_mutex_unlock(&heap->lock);
+                return NULL;
+            }
+            heap->alloc_bit = 0;
+        }
+        length = heap->kernels->find_run(page->alloc, HEAP_PAGE_WORDS, heap->alloc_bit, &start);
+        if(!length){
+            page = page->next;
+            heap->alloc_bit = 0;
+        }
+    }
+    if(length > TLAB_OBJECTS) length = TLAB_OBJECTS;
+    set_bits(page->alloc, start, length, 1);
+    if(page->released){
+        page->released = 0;          // Faults back in on first touch
+        heap->released_pages--;
+    }
+    heap->alloc_page = page;
+    heap->alloc_bit = start + length;
+
+    // The collection itself waits for the next safepoint: the allocating
+    // instruction may hold unrooted operands in C locals
+    heap->handed_out += length;
+    if(heap->live + heap->handed_out >= heap->gc_threshold){
+        __atomic_store_n(&heap->safepoint_requested, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&heap->lock);
+
+    vm->tlab_cursor = &page->slots[start + 1];
+    vm->tlab_limit = &page->slots[start + length];
+    return &page->slots[start];
+}
+
+Obj *heap_alloc_large(VM *vm, size_t size){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+    Obj *obj = heap_fits(heap, size) ? alloc_object_memory(size) : NULL;
+    if(!obj){
+        heap->gc_stats.emergency_gcs++;
+        __atomic_store_n(&heap->safepoint_requested, 1, __ATOMIC_RELEASE);
+        safepoint_locked(vm);
+        obj = heap_fits(heap, size) ? alloc_object_memory(size) : NULL;
+    }
+    if(!obj){
+        heap->gc_stats.failed_allocations++;
+        pthread_mutex_unlock(&heap->lock);
+        return NULL;
+    }
+    obj->next = heap->large;
+    heap->large = obj;
+    heap->large_count++;
+    heap->large_bytes += size;
+
+    // Counted in slot-sized units against the same collection threshold
+    heap->handed_out += (long)(size / sizeof(Obj));
+    if(heap->live + heap->handed_out >= heap->gc_threshold){
+        __atomic_store_n(&heap->safepoint_requested, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return obj;
+}
+
+long heap_sweep_large(SharedHeap *heap){
+    long live = 0;
+    Obj **link = &heap->large;
+    while(*link){
+        Obj *obj = *link;
+        if(obj->marked){
+            obj->marked = 0;
+            live++;
+            link = &obj->next;
+        }
+        else{
+            *link = obj->next;
+            heap->large_count--;
+            heap->large_bytes -= object_size(obj);
+            free_object(NULL, obj);
+        }
+    }
+    return live;
+}
+
+void heap_retire_tlabs(SharedHeap *heap){
+    for(int i = 0; i < heap->mutator_count; i++){
+        retire_tlab(heap->mutators[i]);
+    }
+}
+
+long heap_count_allocated(SharedHeap *heap){
+    long count = 0;
+    for(HeapPage *page = heap->pages; page; page = page->next){
+        count += heap->kernels->count(page->alloc, HEAP_PAGE_WORDS);
+    }
+    // Unused TLAB slots are flagged but hold no object
+    for(int i = 0; i < heap->mutator_count; i++){
+        count -= heap->mutators[i]->tlab_limit - heap->mutators[i]->tlab_cursor;
+    }
+    return count + heap->large_count;
+}
+
+// Unused TLAB slots are flagged but hold no object
+static int in_tlab(SharedHeap *heap, Obj *slot){
+    for(int i = 0; i < heap->mutator_count; i++){
+        VM *vm = heap->mutators[i];
+        if(slot >= vm->tlab_cursor && slot < vm->tlab_limit) return 1;
+    }
+    return 0;
+}
+
+void heap_for_each(SharedHeap *heap, void (*visit)(Obj *obj, void *arg), void *arg){
+    for(HeapPage *page = heap->pages; page; page = page->next){
+        for(int w = 0; w < HEAP_PAGE_WORDS; w++){
+            uint64_t bits = page->alloc[w];
+            while(bits){
+                Obj *obj = &page->slots[w * 64 + __builtin_ctzll(bits)];
+                bits &= bits - 1;
+                if(!in_tlab(heap, obj)) visit(obj, arg);
+            }
+        }
+    }
+    for(Obj *obj = heap->large; obj; obj = obj->next) visit(obj, arg);
+}
+
+long heap_sweep_pages(SharedHeap *heap){
+    long live = 0;
+    for(HeapPage *page = heap->pages; page; page = page->next){
+        if(page->next) __builtin_prefetch(page->next, 1);
+        page->live = heap->kernels->sweep(page->alloc, page->mark, HEAP_PAGE_WORDS);
+        live += page->live;
+
+        // Decay: hand a page back once it has stayed empty long enough
+        if(page->live > 0) page->empty_sweeps = 0;
+        else if(!page->released && heap->decay > 0 && ++page->empty_sweeps >= heap->decay){
+            release_page(heap, page);
+        }
+    }
+    heap->alloc_page = heap->pages;
+    heap->alloc_bit = 0;
+    return live;
+}
+
+void heap_enter(VM *vm){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+    heap->running++;
+    vm->mutator_running = 1;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+void heap_leave(VM *vm){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+    heap->running--;
+    vm->mutator_running = 0;
+    pthread_cond_signal(&heap->parked_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// Caller holds the lock. The first VM to arrive collects once every other
+// running VM has parked; the rest sleep until the epoch changes.
+static void safepoint_locked(VM *vm){
+    SharedHeap *heap = vm->shared;
+    if(!heap->safepoint_requested) return;
+
+    if(!heap->collecting){
+        heap->collecting = 1;
+        int self = vm->mutator_running ? 1 : 0;
+        while(heap->parked < heap->running - self){
+            pthread_cond_wait(&heap->parked_cond, &heap->lock);
+        }
+        gc_shared(heap, vm);
+        heap->gc_threshold = heap->live * 2 + HEAP_MIN_THRESHOLD;
+        heap->handed_out = 0;
+        heap->collecting = 0;
+        heap->epoch++;
+        __atomic_store_n(&heap->safepoint_requested, 0, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&heap->resume_cond);
+    }
+    else{
+        // Only VMs inside vm_run count towards the collector's quorum
+        long epoch = heap->epoch;
+        int self = vm->mutator_running ? 1 : 0;
+        heap->parked += self;
+        pthread_cond_signal(&heap->parked_cond);
+        while(heap->epoch == epoch){
+            pthread_cond_wait(&heap->resume_cond, &heap->lock);
+        }
+        heap->parked -= self;
+    }
+}
+
+void heap_safepoint(VM *vm){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+    safepoint_locked(vm);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+void heap_collect(VM *vm){
+    SharedHeap *heap = vm->shared;
+    pthread_mutex_lock(&heap->lock);
+    __atomic_store_n(&heap->safepoint_requested, 1, __ATOMIC_RELEASE);
+    safepoint_locked(vm);
+    pthread_mutex_unlock(&heap->lock);
+}
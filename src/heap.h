@@ -0,0 +1,165 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "vm.h"
+#include "bitmap.h"
+
+// Shared heap for several mutator threads, each running its own VM (own
+// stack, memory and bytecode) against one object graph.
+//
+// Objects live in 64KB-aligned pages that carry an allocation bitmap and a
+// mark bitmap. Each attached VM bump-allocates from a thread-local
+// allocation buffer (TLAB): a run of free slots found in the allocation
+// bitmap, so new_pair() only takes the heap lock when the run is used up.
+// Collection is stop-the-world: a refill that crosses the threshold raises a
+// safepoint request, every running VM parks at its next instruction
+// boundary, and the first VM to arrive marks the roots of all attached VMs
+// into the mark bitmaps. Sweeping is then pure bitmap work per page.
+//
+// Pages are carved from chunks of address space reserved with mmap,
+// optionally backed by transparent huge pages. A page found empty by
+// `decay` consecutive sweeps is returned to the OS with madvise; its
+// address stays reserved and faults back in when a TLAB reuses it.
+//
+// Objects too big for a slot (vectors, byte arrays) go to a large-object
+// space instead: each has its own malloc block or mapping, is linked into
+// heap->large and is marked through Obj.marked (OBJ_FLAG_LARGE).
+//
+// With max_bytes set, a refill that would need a page past the limit first
+// runs an emergency collection; if that frees nothing usable the refill
+// fails and the allocating VM raises VM_ERROR_OUT_OF_MEMORY.
+
+#define HEAP_PAGE_BYTES 65536
+#define HEAP_PAGE_WORDS 18                          // Bitmap words per page
+#define HEAP_PAGE_OBJECTS (HEAP_PAGE_WORDS * 64)    // 1152 Obj slots per page
+#define TLAB_OBJECTS 128                            // Longest run handed out per refill
+#define HEAP_CHUNK_PAGES 512                        // Pages per mmap reservation (32MB)
+#define HEAP_HUGE_PAGE_BYTES (2 * 1024 * 1024)      // Chunk alignment with huge pages
+#define HEAP_RELEASE_OFFSET 4096                    // Page headers stay resident
+#define HEAP_DEFAULT_DECAY 2
+
+typedef struct HeapPage {
+    uint64_t alloc[HEAP_PAGE_WORDS];    // Slot holds an object or belongs to a TLAB
+    uint64_t mark[HEAP_PAGE_WORDS];     // Set by marking, folded into alloc by the sweep
+    struct HeapPage *next;
+    int live;                           // Objects alive after the last sweep
+    int empty_sweeps;                   // Consecutive sweeps that found it empty
+    int released;                       // Slots handed back with madvise
+    Obj slots[HEAP_PAGE_OBJECTS];
+} HeapPage;
+
+typedef struct HeapChunk {
+    struct HeapChunk *next;
+    char *base;                         // Aligned start of the reservation
+    int used;                           // Pages carved so far
+} HeapChunk;
+
+typedef struct SharedHeap {
+    pthread_mutex_t lock;
+    pthread_cond_t parked_cond;     // A mutator parked or left vm_run
+    pthread_cond_t resume_cond;     // A collection finished
+
+    HeapPage *pages;
+    int page_count;
+    long max_bytes;                 // Ceiling on pages plus large objects, 0 = unlimited
+    HeapChunk *chunks;
+    Obj *large;                     // Large-object space, linked through Obj.next
+    long large_count;
+    long large_bytes;
+    int huge_pages;                 // madvise(MADV_HUGEPAGE) new chunks
+    int decay;                      // Empty sweeps before a page is returned; 0 = never
+    int use_madv_free;              // MADV_FREE (lazy) instead of MADV_DONTNEED
+    int released_pages;             // Pages currently returned to the OS
+    long pages_returned;            // Total page releases
+    HeapPage *alloc_page;           // Next-fit cursor for TLAB refills
+    int alloc_bit;
+    const BitmapKernels *kernels;   // Chosen by cpuid at creation
+
+    VM **mutators;                  // Attached VMs; all of them are roots
+    int mutator_count;
+    int mutator_capacity;
+
+    int running;                    // Attached VMs currently inside vm_run
+    int parked;                     // Running VMs waiting at a safepoint
+    int collecting;                 // A collector has been elected
+    long epoch;                     // Bumped after every collection
+    int safepoint_requested;        // Polled by every VM once per instruction
+
+    long live;                      // Objects alive after the last collection
+    long handed_out;                // TLAB slots handed out since then
+    long gc_threshold;
+    GCStats gc_stats;
+} SharedHeap;
+
+SharedHeap *heap_create(void);
+void heap_destroy(SharedHeap *heap);    // All VMs must be detached first
+
+// A VM allocates from the shared heap between attach and detach. Detaching
+// keeps its objects (other VMs may reference them) until a sweep finds them dead.
+int heap_attach(SharedHeap *heap, VM *vm);
+void heap_detach(VM *vm);
+
+// Slow path of allocation: find a new TLAB for vm and return its first slot,
+// or NULL once the heap limit is reached even after an emergency collection
+Obj *heap_refill_tlab(VM *vm);
+
+// Allocation of an object bigger than a slot, linked into the large-object
+// space; NULL under the same conditions as heap_refill_tlab
+Obj *heap_alloc_large(VM *vm, size_t size);
+
+// Safepoint protocol, driven by vm_run
+void heap_enter(VM *vm);
+void heap_leave(VM *vm);
+void heap_safepoint(VM *vm);
+void heap_collect(VM *vm);              // Request and run a collection now
+
+// Bytes in pages not returned to the OS, and bytes actually resident
+// (mincore over every chunk)
+void heap_memory_usage(SharedHeap *heap, long *committed, long *resident);
+
+// Objects currently allocated (set allocation bits minus unused TLAB slots)
+long heap_count_allocated(SharedHeap *heap);
+
+// Calls visit on every allocated object: the page slots, then the
+// large-object space. No other VM may allocate meanwhile (world stopped,
+// or a single mutator).
+void heap_for_each(SharedHeap *heap, void (*visit)(Obj *obj, void *arg), void *arg);
+
+// Collector side, world stopped: give back the unused part of every TLAB
+// and sweep every page's bitmaps
+void heap_retire_tlabs(SharedHeap *heap);
+long heap_sweep_pages(SharedHeap *heap);
+long heap_sweep_large(SharedHeap *heap);
+
+// Marks the roots of every attached VM, then sweeps the pages (gc.c).
+// Runs on the collector with the world stopped.
+void gc_shared(SharedHeap *heap, VM *collector);
+
+static inline int heap_safepoint_pending(SharedHeap *heap){
+    return __atomic_load_n(&heap->safepoint_requested, __ATOMIC_ACQUIRE);
+}
+
+static inline HeapPage *heap_page_of(Obj *obj){
+    return (HeapPage*)((uintptr_t)obj & ~(uintptr_t)(HEAP_PAGE_BYTES - 1));
+}
+
+// Sets obj's mark bit (page objects only); returns 0 if it was already set
+static inline int heap_mark(Obj *obj){
+    HeapPage *page = heap_page_of(obj);
+    int index = (int)(obj - page->slots);
+    uint64_t bit = 1ULL << (index & 63);
+    uint64_t *word = &page->mark[index >> 6];
+    if(*word & bit) return 0;
+    *word |= bit;
+    return 1;
+}
+
+static inline int heap_is_marked(Obj *obj){
+    HeapPage *page = heap_page_of(obj);
+    int index = (int)(obj - page->slots);
+    return (page->mark[index >> 6] >> (index & 63)) & 1;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "immix.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t align_size(size_t size){
+    return (size + IMMIX_GRANULE - 1) & ~(size_t)(IMMIX_GRANULE - 1);
+}
+
+ImmixSpace *immix_create(void){
+    return (ImmixSpace*)calloc(1, sizeof(ImmixSpace));
+}
+
+void immix_destroy(ImmixSpace *space){
+    if(!space) return;
+    ImmixBlock *block = space->blocks;
+    while(block){
+        ImmixBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(space->recyclable);
+    free(space->free_blocks);
+    free(space);
+}
+
+long immix_committed_bytes(ImmixSpace *space){
+    return (long)space->block_count * IMMIX_BLOCK_BYTES;
+}
+
+static ImmixBlock *new_block(ImmixSpace *space){
+    ImmixBlock *block = (ImmixBlock*)aligned_alloc(IMMIX_BLOCK_BYTES, IMMIX_BLOCK_BYTES);
+    if(!block) return NULL;
+    memset(block, 0, sizeof(ImmixBlock));
+    block->free_lines = IMMIX_USABLE_LINES;
+    block->holes = 1;
+    block->next = space->blocks;
+    space->blocks = block;
+    space->block_count++;
+    return block;
+}
+
+static ImmixBlock *take_free_block(ImmixSpace *space, int may_grow){
+    if(space->free_count > 0) return space->free_blocks[--space->free_count];
+    return may_grow ? new_block(space) : NULL;
+}
+
+static void note_start(Obj *obj){
+    ImmixBlock *block = immix_block_of(obj);
+    size_t granule = (size_t)((char*)obj - (char*)block) / IMMIX_GRANULE;
+    block->object_starts[granule >> 6] |= 1ULL << (granule & 63);
+}
+
+static char *block_start(ImmixBlock *block){
+    return (char*)block + IMMIX_FIRST_LINE * IMMIX_LINE_BYTES;
+}
+
+// Moves the cursor to the next run of unmarked lines in the current block
+static int next_hole(ImmixSpace *space){
+    ImmixBlock *block = space->current;
+    if(!block) return 0;
+    int line = space->next_line;
+    while(line < IMMIX_LINES && block->line_marks[line]) line++;
+    if(line >= IMMIX_LINES) return 0;
+    int end = line;
+    while(end < IMMIX_LINES && !block->line_marks[end]) end++;
+    space->cursor = (char*)block + line * IMMIX_LINE_BYTES;
+    space->limit = (char*)block + end * IMMIX_LINE_BYTES;
+    space->next_line = end;
+    return 1;
+}
+
+// Medium objects that do not fit the current hole get a block of their own
+// rather than making the allocator skip the hole
+static Obj *overflow_alloc(ImmixSpace *space, size_t size, int may_grow){
+    if(!space->overflow_cursor || (size_t)(space->overflow_limit - space->overflow_cursor) < size){
+        ImmixBlock *block = take_free_block(space, may_grow);
+        if(!block) return NULL;
+        space->overflow_cursor = block_start(block);
+        space->overflow_limit = (char*)block + IMMIX_BLOCK_BYTES;
+    }
+    Obj *obj = (Obj*)space->overflow_cursor;
+    space->overflow_cursor += size;
+    space->objects++;
+    note_start(obj);
+    return obj;
+}
+
+Obj *immix_alloc(ImmixSpace *space, size_t size, int may_grow){
+    size = align_size(size);
+    for(;;){
+        if(space->cursor && (size_t)(space->limit - space->cursor) >= size){
+            Obj *obj = (Obj*)space->cursor;
+            space->cursor += size;
+            space->objects++;
+            note_start(obj);
+            return obj;
+        }
+        if(size > IMMIX_LINE_BYTES) return overflow_alloc(space, size, may_grow);
+        if(next_hole(space)) continue;
+
+        // Current block used up: recyclable blocks first, then free ones
+        ImmixBlock *block;
+        if(space->recyclable_next < space->recyclable_count){
+            block = space->recyclable[space->recyclable_next++];
+        }
+        else block = take_free_block(space, may_grow);
+        if(!block) return NULL;
+        space->current = block;
+        space->next_line = IMMIX_FIRST_LINE;
+        space->cursor = NULL;
+        space->limit = NULL;
+    }
+}
+
+void immix_prepare(ImmixSpace *space){
+    space->marked = 0;
+    space->evac_cursor = NULL;
+    space->evac_limit = NULL;
+    space->evac_exhausted = 0;
+
+    // Candidates: fragmented blocks, as long as the free blocks can take
+    // their live lines
+    long room = (long)space->free_count * IMMIX_USABLE_LINES;
+    for(ImmixBlock *block = space->blocks; block; block = block->next){
+        int live = IMMIX_USABLE_LINES - block->free_lines;
+        block->candidate = live > 0 && live <= room &&
+                           block->free_lines * 100 >= IMMIX_USABLE_LINES * IMMIX_DEFRAG_PERCENT;
+        if(block->candidate){
+            room -= live;
+            space->candidates_total++;
+        }
+        memset(block->object_marks, 0, sizeof(block->object_marks));
+        memset(block->line_marks, 0, sizeof(block->line_marks));
+    }
+}
+
+int immix_mark(ImmixSpace *space, Obj *obj){
+    ImmixBlock *block = immix_block_of(obj);
+    size_t offset = (size_t)((char*)obj - (char*)block);
+    size_t granule = offset / IMMIX_GRANULE;
+    uint64_t bit = 1ULL << (granule & 63);
+    if(block->object_marks[granule >> 6] & bit) return 0;
+    block->object_marks[granule >> 6] |= bit;
+
+    size_t last = (offset + object_size(obj) - 1) / IMMIX_LINE_BYTES;
+    for(size_t line = offset / IMMIX_LINE_BYTES; line <= last; line++){
+        block->line_marks[line] = 1;
+    }
+    space->marked++;
+    return 1;
+}
+
+int immix_is_marked(Obj *obj){
+    ImmixBlock *block = immix_block_of(obj);
+    size_t granule = (size_t)((char*)obj - (char*)block) / IMMIX_GRANULE;
+    return (block->object_marks[granule >> 6] >> (granule & 63)) & 1;
+}
+
+Obj *immix_visit(ImmixSpace *space, Obj *obj){
+    if(!immix_block_of(obj)->candidate) return obj;
+    if(obj->flags & OBJ_FLAG_FORWARDED) return obj->next;
+    // Already marked in place (e.g. by pointer reversal): it stays
+    if(space->evac_exhausted || immix_is_marked(obj)) return obj;
+
+    size_t bytes = object_size(obj);
+    size_t size = align_size(bytes);
+    if(!space->evac_cursor || (size_t)(space->evac_limit - space->evac_cursor) < size){
+        ImmixBlock *block = take_free_block(space, 0);
+        if(!block){
+            space->evac_exhausted = 1;
+            return obj;
+        }
+        space->evac_cursor = block_start(block);
+        space->evac_limit = (char*)block + IMMIX_BLOCK_BYTES;
+    }
+    Obj *copy = (Obj*)space->evac_cursor;
+    space->evac_cursor += size;
+    memcpy(copy, obj, bytes);
+    note_start(copy);
+    obj->flags |= OBJ_FLAG_FORWARDED;
+    obj->next = copy;
+    space->evacuated_total++;
+    space->evacuated_bytes += size;
+    return copy;
+}
+
+void immix_for_each(ImmixSpace *space, void (*visit)(Obj *obj, void *arg), void *arg){
+    for(ImmixBlock *block = space->blocks; block; block = block->next){
+        for(int w = 0; w < IMMIX_GRANULES / 64; w++){
+            uint64_t bits = block->object_starts[w];
+            while(bits){
+                Obj *obj = (Obj*)((char*)block + (w * 64 + __builtin_ctzll(bits)) * IMMIX_GRANULE);
+                bits &= bits - 1;
+                if(!(obj->flags & OBJ_FLAG_FORWARDED)) visit(obj, arg);
+            }
+        }
+    }
+}
+
+void immix_sweep(ImmixSpace *space){
+    if(space->list_capacity < space->block_count){
+        int capacity = space->block_count * 2;
+        ImmixBlock **recyclable = (ImmixBlock**)realloc(space->recyclable, capacity * sizeof(ImmixBlock*));
+        if(recyclable) space->recyclable = recyclable;
+        ImmixBlock **free_blocks = (ImmixBlock**)realloc(space->free_blocks, capacity * sizeof(ImmixBlock*));
+        if(free_blocks) space->free_blocks = free_blocks;
+        if(!recyclable || !free_blocks){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        space->list_capacity = capacity;
+    }
+
+    space->recyclable_count = 0;
+    space->recyclable_next = 0;
+    space->free_count = 0;
+    for(ImmixBlock *block = space->blocks; block; block = block->next){
+        int free_lines = 0, holes = 0;
+        for(int line = IMMIX_FIRST_LINE; line < IMMIX_LINES; line++){
+            if(block->line_marks[line]) continue;
+            free_lines++;
+            if(line == IMMIX_FIRST_LINE || block->line_marks[line - 1]) holes++;
+        }
+        block->free_lines = free_lines;
+        block->holes = holes;
+        // The dead objects' headers are left for the allocator to overwrite
+        memcpy(block->object_starts, block->object_marks, sizeof(block->object_starts));
+        block->candidate = 0;
+        if(free_lines == IMMIX_USABLE_LINES) space->free_blocks[space->free_count++] = block;
+        else if(free_lines > 0) space->recyclable[space->recyclable_count++] = block;
+    }
+
+    // Allocation restarts from the new holes
+    space->current = NULL;
+    space->cursor = NULL;
+    space->limit = NULL;
+    space->overflow_cursor = NULL;
+    space->overflow_limit = NULL;
+    space->evac_cursor = NULL;
+    space->evac_limit = NULL;
+    space->objects = space->marked;
+}
@@ -0,0 +1,127 @@
+#ifndef IMMIX_H
+#define IMMIX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "object.h"
+
+// Mark-region heap in the style of Immix, as an alternative to the
+// malloc-per-object private heap (vm->immix).
+//
+// Memory comes in 32KB blocks of 128-byte lines. Allocation bumps a cursor
+// through a hole (a run of lines that held no live object at the last
+// collection), moving to the next hole, then to a recyclable or free
+// block. Objects bigger than a line that do not fit the current hole go to
+// a separate overflow block instead of skipping it.
+//
+// Marking sets an object bit and the bits of every line the object covers
+// in the block header; there is no per-object sweep. The sweep counts the
+// free lines of each block, which decides the holes for the next cycle.
+// A second bitmap records where every object allocated since then starts,
+// so snapshots and the census can still walk the objects.
+//
+// Defragmentation is opportunistic: at the start of a collection, sparse
+// blocks (see IMMIX_DEFRAG_PERCENT) become candidates, as far as the free
+// blocks can take their live data. Marking copies an object out of a candidate the first
+// time it reaches it through a field, leaves a forwarding address in the
+// old copy and updates the field. Once the free blocks are used up it marks
+// in place instead. Objects of LARGE_OBJECT_BYTES and up stay in the
+// large-object space (vm->large_head).
+//
+// Because objects move, C code must not keep Obj pointers across a
+// collection; reload them from the stack or memory.
+
+#define IMMIX_BLOCK_BYTES 32768
+#define IMMIX_LINE_BYTES 128
+#define IMMIX_LINES (IMMIX_BLOCK_BYTES / IMMIX_LINE_BYTES)      // 256
+#define IMMIX_GRANULE 8                                         // Object alignment
+#define IMMIX_GRANULES (IMMIX_BLOCK_BYTES / IMMIX_GRANULE)      // 4096
+
+typedef struct ImmixBlock {
+    uint64_t object_marks[IMMIX_GRANULES / 64];  // Bit per granule a marked object starts at
+    uint64_t object_starts[IMMIX_GRANULES / 64]; // Same, for every object not yet swept away
+    uint8_t line_marks[IMMIX_LINES];             // Line holds part of a live object
+    struct ImmixBlock *next;                     // Every block of the space
+    int free_lines;                              // Unmarked usable lines after the last sweep
+    int holes;                                   // Runs of free lines after the last sweep
+    int candidate;                               // Being evacuated by this collection
+} ImmixBlock;
+
+// Lines holding the block header are never allocated
+#define IMMIX_FIRST_LINE ((int)((sizeof(ImmixBlock) + IMMIX_LINE_BYTES - 1) / IMMIX_LINE_BYTES))
+#define IMMIX_USABLE_LINES (IMMIX_LINES - IMMIX_FIRST_LINE)
+
+// Blocks whose free lines are at least this share of the usable lines, and
+// which still hold live data, are evacuation candidates
+#define IMMIX_DEFRAG_PERCENT 50
+
+typedef struct ImmixSpace {
+    ImmixBlock *blocks;
+    int block_count;
+
+    // Blocks sorted by the last sweep, used as allocation targets
+    ImmixBlock **recyclable;        // Some free lines
+    int recyclable_count;
+    int recyclable_next;
+    ImmixBlock **free_blocks;       // No live data at all
+    int free_count;
+    int list_capacity;
+
+    // Bump allocation into the current hole
+    char *cursor;
+    char *limit;
+    ImmixBlock *current;
+    int next_line;                  // Where the search for the next hole resumes
+
+    char *overflow_cursor;          // Medium objects that did not fit the hole
+    char *overflow_limit;
+
+    char *evac_cursor;              // Evacuation target during a collection
+    char *evac_limit;
+    int evac_exhausted;             // No free block left: mark in place from now on
+
+    long objects;                   // Objects in the blocks (live + not yet collected)
+    long marked;                    // Objects marked by the current collection
+
+    // Statistics
+    long candidates_total;
+    long evacuated_total;
+    long evacuated_bytes;
+} ImmixSpace;
+
+ImmixSpace *immix_create(void);
+void immix_destroy(ImmixSpace *space);
+
+// Object of size bytes (8-byte aligned internally), or NULL. A new block is
+// only taken from the system when may_grow is set.
+Obj *immix_alloc(ImmixSpace *space, size_t size, int may_grow);
+
+// Collection protocol (gc.c): prepare before marking, sweep after
+void immix_prepare(ImmixSpace *space);
+void immix_sweep(ImmixSpace *space);
+
+// Sets the object's mark and line marks; returns 0 if it was already marked
+int immix_mark(ImmixSpace *space, Obj *obj);
+int immix_is_marked(Obj *obj);
+
+// Calls visit on every object allocated or surviving since the last sweep,
+// except the old copies of evacuated objects
+void immix_for_each(ImmixSpace *space, void (*visit)(Obj *obj, void *arg), void *arg);
+
+// Called for every object reached through a field while marking. Returns
+// the address the field should hold: the forwarded copy if the object has
+// moved (or moves now, out of a candidate block), otherwise obj.
+Obj *immix_visit(ImmixSpace *space, Obj *obj);
+
+// Forwarding address of a moved object, else obj
+static inline Obj *immix_resolve(Obj *obj){
+    return (obj->flags & OBJ_FLAG_FORWARDED) ? obj->next : obj;
+}
+
+static inline ImmixBlock *immix_block_of(Obj *obj){
+    return (ImmixBlock*)((uintptr_t)obj & ~(uintptr_t)(IMMIX_BLOCK_BYTES - 1));
+}
+
+long immix_committed_bytes(ImmixSpace *space);
+
+#endif
@@ -0,0 +1,116 @@
+#include "intern.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a
+unsigned int string_hash(const char *chars, int length){
+    unsigned int h = 2166136261u;
+    for(int i = 0; i < length; i++){
+        h ^= (unsigned char)chars[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void put(Obj **slots, size_t capacity, Obj *string){
+    size_t i = string->as.string.hash & (capacity - 1);
+    while(slots[i]) i = (i + 1) & (capacity - 1);
+    slots[i] = string;
+}
+
+// Rehashes the table's strings into capacity slots; the hashes are cached,
+// so no string is read
+static void rehash(StringTable *table, size_t capacity){
+    Obj **slots = (Obj**)calloc(capacity, sizeof(Obj*));
+    if(!slots){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < table->capacity; i++){
+        if(table->slots[i]) put(slots, capacity, table->slots[i]);
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+static StringTable *string_table_create(void){
+    StringTable *table = (StringTable*)calloc(1, sizeof(StringTable));
+    if(!table) return NULL;
+    table->slots = (Obj**)calloc(STRING_TABLE_MIN_CAPACITY, sizeof(Obj*));
+    if(!table->slots){
+        free(table);
+        return NULL;
+    }
+    table->capacity = STRING_TABLE_MIN_CAPACITY;
+    return table;
+}
+
+void string_table_destroy(StringTable *table){
+    if(!table) return;
+    free(table->slots);
+    free(table);
+}
+
+Obj *string_intern(VM *vm, const char *chars, int length){
+    if(!vm->strings && !(vm->strings = string_table_create())) return NULL;
+    StringTable *table = vm->strings;
+    table->lookups++;
+    unsigned int hash = string_hash(chars, length);
+    size_t i = hash & (table->capacity - 1);
+    for(Obj *string; (string = table->slots[i]); i = (i + 1) & (table->capacity - 1)){
+        if(string->as.string.hash == hash && string->as.string.length == length &&
+           memcmp(string->as.string.chars, chars, length) == 0){
+            table->hits++;
+            return string;
+        }
+    }
+
+    // The table only holds heap objects: a region would free the string
+    vm->region.bypass++;
+    Obj *string = new_string(vm, chars, length, hash);
+    vm->region.bypass--;
+    if(!string) return NULL;
+    // An emergency GC in new_string may have rehashed the table
+    if((table->count + 1) * 2 > table->capacity) rehash(table, table->capacity * 2);
+    put(table->slots, table->capacity, string);
+    table->count++;
+    return string;
+}
+
+void string_table_prune(StringTable *table, Obj *(*survivor)(Obj *obj, void *arg), void *arg){
+    size_t live = 0;
+    for(size_t i = 0; i < table->capacity; i++){
+        if(!table->slots[i]) continue;
+        table->slots[i] = survivor(table->slots[i], arg);
+        if(table->slots[i]) live++;
+        else table->pruned++;
+    }
+    table->count = live;
+    // Close the gaps left by dead strings, shrinking to fit
+    size_t capacity = STRING_TABLE_MIN_CAPACITY;
+    while(capacity < live * 4) capacity *= 2;
+    rehash(table, capacity);
+}
+
+int vm_attach_constants(VM *vm, const ConstantPool *pool){
+    Obj **constants = NULL;
+    if(pool && pool->count > 0){
+        constants = (Obj**)calloc(pool->count, sizeof(Obj*));
+        if(!constants) return -1;
+    }
+    free(vm->constants);
+    vm->constants = constants;
+    vm->constant_pool = pool;
+    return 0;
+}
+
+void constant_pool_destroy(ConstantPool *pool){
+    if(!pool) return;
+    for(int i = 0; i < pool->count; i++) free(pool->chars[i]);
+    free(pool->chars);
+    free(pool->lengths);
+    free(pool);
+}
@@ -0,0 +1,63 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include "object.h"
+
+// Interned strings (OBJ_STRING) and the constant pool behind CONST.
+//
+// Every string is interned: string_intern() returns the one string object
+// with the given bytes, allocating it only when there is none yet. Equal
+// strings are therefore the same object; comparing them (SAME, table keys)
+// is a pointer compare, and their hash is computed once, when interned.
+// Strings are immutable and, like hash-consed pairs, always live on the
+// heap, even inside a region.
+//
+// The intern table (vm->strings) is weak, like the CONS_SHARED table
+// (cons.h): every collection calls string_table_prune() between marking
+// and sweeping, so the strings that only the table reaches are swept.
+//
+// String literals in assembly (STRING "text") are collected by the
+// assembler into a constant pool written next to the bytecode
+// (prog.bc.str, loaded by load_constants()). CONST k pushes constant k,
+// interned the first time it runs and cached in vm->constants after that.
+
+#define STRING_TABLE_MIN_CAPACITY 64
+
+typedef struct StringTable {
+    Obj **slots;            // Open addressing on the cached hash; NULL = empty
+    size_t capacity;        // Power of two, at most half full
+    size_t count;
+    long lookups;
+    long hits;
+    long pruned;            // Dead strings dropped by collections
+} StringTable;
+
+// Read-only, so several VMs may share one
+typedef struct ConstantPool {
+    int count;
+    char **chars;
+    int *lengths;
+} ConstantPool;
+
+struct VM;
+
+unsigned int string_hash(const char *chars, int length);
+
+// The interned string with these bytes: found, or allocated and entered.
+// NULL when the heap is out of memory.
+Obj *string_intern(struct VM *vm, const char *chars, int length);
+
+void string_table_destroy(StringTable *table);
+
+// Keeps the strings for which survivor() returns an object, under that
+// (possibly moved) address, and drops the others
+void string_table_prune(StringTable *table, Obj *(*survivor)(Obj *obj, void *arg), void *arg);
+
+// Gives the VM a constant pool for CONST (NULL: none). Returns -1 when
+// out of memory.
+int vm_attach_constants(struct VM *vm, const ConstantPool *pool);
+
+void constant_pool_destroy(ConstantPool *pool);
+
+#endif
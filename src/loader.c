@@ -31,4 +31,39 @@ int* load_bytecode(const char *filename, int *out_size){
     fclose(fp);
     *out_size = count;
     return bytecode;
-}
\ No newline at end of file
+}
+
+ConstantPool *load_constants(const char *filename){
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.str", filename);
+    FILE *fp = fopen(path, "r");
+    if(!fp) return NULL;
+
+    ConstantPool *pool = calloc(1, sizeof(ConstantPool));
+    int capacity = 0;
+    int length;
+    while(pool && fscanf(fp, "%d", &length) == 1 && length >= 0 && fgetc(fp) == ' '){
+        if(pool->count == capacity){
+            capacity = capacity ? capacity * 2 : 16;
+            char **chars = realloc(pool->chars, capacity * sizeof(char*));
+            int *lengths = realloc(pool->lengths, capacity * sizeof(int));
+            if(chars) pool->chars = chars;
+            if(lengths) pool->lengths = lengths;
+            if(!chars || !lengths) break;
+        }
+        char *bytes = malloc(length + 1);
+        if(!bytes) break;
+        if(fread(bytes, 1, length, fp) != (size_t)length || fgetc(fp) != '\n'){
+            printf("Malformed constant pool %s\n", path);
+            free(bytes);
+            break;
+        }
+        bytes[length] = '\0';
+        pool->chars[pool->count] = bytes;
+        pool->lengths[pool->count] = length;
+        pool->count++;
+    }
+    fclose(fp);
+    if(!pool) perror("Memory Allocation Failed");
+    return pool;
+}
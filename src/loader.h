@@ -1,6 +1,12 @@
 #ifndef LOADER_H
 #define LOADER_H
 
+#include "intern.h"
+
 int* load_bytecode(const char *filename, int *out_size);
 
+// The constant pool the assembler wrote next to the bytecode
+// (filename.str). NULL when the program has none.
+ConstantPool *load_constants(const char *filename);
+
 #endif
\ No newline at end of file
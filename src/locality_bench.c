@@ -0,0 +1,199 @@
+/* Traversal locality benchmark: how fast long-lived lists and trees can be
+ * walked after a collection, depending on where the collector left them.
+ *
+ *   ./locality_bench                      list of 2^18 cells, tree of depth 17
+ *   ./locality_bench --size 100000 --depth 15 --passes 50 --seed 7
+ *
+ * Cells are allocated in shuffled order with garbage in between, so the
+ * links jump around the heap, as after a long run of mixed allocation. A
+ * burst of pure garbage then leaves empty blocks for evacuation, and two
+ * collections run: the first finds the sparse blocks, the second moves
+ * their live objects. Each variant then walks the list (right fields) and
+ * the tree (preorder, left first) several times. Cache misses come from
+ * perf_event where available. */
+
+#include "vm.h"
+#include "object.h"
+#include "value.h"
+#include "immix.h"
+#include "perf_counters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GARBAGE_PER_CELL 7      // Leaves each block mostly free after the first GC
+#define FILLER_PER_CELL 6       // Empty blocks the second GC can evacuate into
+
+typedef struct {
+    const char *name;
+    int immix;
+    CopyOrder order;
+} Variant;
+
+static const Variant variants[] = {
+    {"marksweep", 0, COPY_ORDER_BREADTH},
+    {"immix-breadth", 1, COPY_ORDER_BREADTH},
+    {"immix-depth", 1, COPY_ORDER_DEPTH},
+    {NULL, 0, COPY_ORDER_BREADTH}
+};
+
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void){
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static double now_seconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// count pairs in memory[slot] (a vector), interleaved with garbage and
+// shuffled, so their order in the vector says nothing about their addresses
+static Obj *scattered_cells(VM *vm, int slot, int count){
+    Obj *cells = new_vector(vm, count);
+    if(!cells){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    vm->memory[slot] = make_obj_value(cells);
+    vm->valid[slot] = 1;
+    for(int i = 0; i < count; i++){
+        cells->as.vector.items[i] = make_obj_value(new_pair(vm, make_int_value(i), make_int_value(0)));
+        for(int g = 0; g < GARBAGE_PER_CELL; g++){
+            new_pair(vm, make_int_value(g), make_int_value(i));
+        }
+    }
+    for(int i = count - 1; i > 0; i--){
+        int j = (int)(rng_next() % (unsigned long long)(i + 1));
+        Value tmp = cells->as.vector.items[i];
+        cells->as.vector.items[i] = cells->as.vector.items[j];
+        cells->as.vector.items[j] = tmp;
+    }
+    return cells;
+}
+
+// List: memory[1], cells linked through their right fields
+static void build_list(VM *vm, int length){
+    Obj *cells = scattered_cells(vm, 0, length);
+    for(int i = 0; i < length; i++){
+        Obj *cell = cells->as.vector.items[i].as.obj;
+        cell->as.pair.left = make_int_value(i);
+        if(i + 1 < length) cell->as.pair.right = cells->as.vector.items[i + 1];
+    }
+    vm->memory[1] = cells->as.vector.items[0];
+    vm->valid[1] = 1;
+    vm->valid[0] = 0;
+}
+
+// Complete tree: memory[3]; node k has children 2k+1 and 2k+2
+static void build_tree(VM *vm, int nodes){
+    Obj *cells = scattered_cells(vm, 2, nodes);
+    for(int k = 0; k < nodes; k++){
+        Obj *node = cells->as.vector.items[k].as.obj;
+        if(2 * k + 2 < nodes){
+            node->as.pair.left = cells->as.vector.items[2 * k + 1];
+            node->as.pair.right = cells->as.vector.items[2 * k + 2];
+        }
+    }
+    vm->memory[3] = cells->as.vector.items[0];
+    vm->valid[3] = 1;
+    vm->valid[2] = 0;
+}
+
+static long walk_list(Value v){
+    long sum = 0;
+    while(v.type == VAL_OBJ){
+        sum += v.as.obj->as.pair.left.as.i;
+        v = v.as.obj->as.pair.right;
+    }
+    return sum;
+}
+
+static long walk_tree(Obj *node){
+    if(node->as.pair.left.type != VAL_OBJ) return node->as.pair.left.as.i;
+    return 1 + walk_tree(node->as.pair.left.as.obj) + walk_tree(node->as.pair.right.as.obj);
+}
+
+static void report(const char *variant, const char *shape, long nodes, int passes,
+                   double seconds, PerfSample *perf, long evacuated, long check){
+    char misses[32];
+    if(perf->cache_misses < 0) snprintf(misses, sizeof(misses), "n/a");
+    else snprintf(misses, sizeof(misses), "%.3f", (double)perf->cache_misses / ((double)nodes * passes));
+    printf("%-16s %-6s %10.2f %14s %12ld %14ld\n", variant, shape,
+           seconds * 1e9 / ((double)nodes * passes), misses, evacuated, check);
+}
+
+int main(int argc, char *argv[]){
+    int length = 1 << 18;
+    int depth = 17;
+    int passes = 20;
+    unsigned long long seed = 42;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--size") == 0 && i + 1 < argc) length = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--passes") == 0 && i + 1 < argc) passes = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else{
+            printf("Usage: %s [--size N] [--depth N] [--passes N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(length < 1) length = 1;
+    if(depth < 1) depth = 1;
+    if(depth > 24) depth = 24;
+    if(passes < 1) passes = 1;
+    int nodes = (1 << depth) - 1;
+
+    PerfCounters counters;
+    perf_counters_open(&counters);
+    printf("%-16s %-6s %10s %14s %12s %14s\n", "variant", "shape", "ns/node", "misses/node",
+           "evacuated", "checksum");
+
+    for(int v = 0; variants[v].name; v++){
+        VM *vm = vm_new(NULL);
+        if(!vm || (variants[v].immix && !(vm->immix = immix_create()))){
+            printf("Out of memory\n");
+            return 1;
+        }
+        vm->copy_order = variants[v].order;
+        rng_state = seed ? seed : 1;
+
+        build_list(vm, length);
+        build_tree(vm, nodes);
+        for(long i = 0; i < (long)(length + nodes) * FILLER_PER_CELL; i++){
+            new_pair(vm, make_int_value(0), make_int_value(0));
+        }
+        gc(vm);
+        gc(vm);
+        long evacuated = vm->immix ? vm->immix->evacuated_total : 0;
+
+        PerfSample perf;
+        long check = 0;
+        perf_counters_start(&counters);
+        double start = now_seconds();
+        for(int p = 0; p < passes; p++) check += walk_list(vm->memory[1]);
+        double seconds = now_seconds() - start;
+        perf_counters_stop(&counters, &perf);
+        report(variants[v].name, "list", length, passes, seconds, &perf, evacuated, check);
+
+        check = 0;
+        perf_counters_start(&counters);
+        start = now_seconds();
+        for(int p = 0; p < passes; p++) check += walk_tree(vm->memory[3].as.obj);
+        seconds = now_seconds() - start;
+        perf_counters_stop(&counters, &perf);
+        report(variants[v].name, "tree", nodes, passes, seconds, &perf, evacuated, check);
+
+        vm_free(vm);
+    }
+    perf_counters_close(&counters);
+    return 0;
+}
@@ -2,35 +2,304 @@
 #include<stdio.h>
 #include "loader.h"
 #include<stdlib.h>
+#include<string.h>
 #include<time.h>
 #include "value.h"
+#include "trace.h"
+#include "profile.h"
+#include "census.h"
+#include "snapshot.h"
+#include "heap.h"
+#include "immix.h"
+#include<signal.h>
+
+// Trace state lives here so the atexit hook can still flush it when the
+// VM bails out through exit() (stack overflow, out of memory, ...)
+static Trace *active_trace = NULL;
+static const char *trace_path = NULL;
+
+// SIGUSR1 asks the running VM for a heap snapshot at the next instruction
+static VM *signal_vm = NULL;
+
+static void on_sigusr1(int sig){
+    (void)sig;
+    if(signal_vm) signal_vm->snapshot_requested = 1;
+}
+
+static void flush_trace(void){
+    if(!active_trace) return;
+    if(trace_write_json(active_trace, trace_path) == 0){
+        printf("Trace written to %s\n", trace_path);
+    }
+    trace_destroy(active_trace);
+    active_trace = NULL;
+}
+
+// "64m", "512k", "1g" or plain bytes; 0 on a malformed size
+static long parse_size(const char *text){
+    char *end;
+    long size = strtol(text, &end, 10);
+    switch(*end){
+        case 'k': case 'K': size *= 1024L; end++; break;
+        case 'm': case 'M': size *= 1024L * 1024; end++; break;
+        case 'g': case 'G': size *= 1024L * 1024 * 1024; end++; break;
+    }
+    return (*end || size < 0) ? 0 : size;
+}
 
 int main(int argc, char *argv[]){
     if(argc<2){
-        printf("Usage: %s <bytecode_file>\n", argv[0]);
+        printf("Usage: %s <bytecode_file> [--trace out.json] [--profile prefix] [--profile-hz N] [--census N] [--snapshot prefix] [--paged-heap] [--huge-pages] [--decay N] [--max-heap BYTES] [--mark-budget N] [--immix] [--copy-order breadth|depth] [--generational] [--pretenure] [--record out.gctrace] [--no-escape] [--gc-stats]\n", argv[0]);
         return 1;
     }
 
+    const char *profile_prefix = NULL;
+    int profile_hz = 0;
+    int census_rate = 0;
+    const char *snapshot_prefix = NULL;
+    int paged_heap = 0;
+    int huge_pages = 0;
+    int decay = HEAP_DEFAULT_DECAY;
+    int gc_stats = 0;
+    long max_heap = 0;
+    int mark_budget = 0;
+    int immix = 0;
+    CopyOrder copy_order = COPY_ORDER_BREADTH;
+    int generational = 0;
+    int pretenure = 0;
+    const char *record_path = NULL;
+    int escape = 1;
+
+    for(int i=2;i<argc;i++){
+        if(strcmp(argv[i],"--trace")==0 && i+1<argc){
+            trace_path = argv[++i];
+        }
+        else if(strcmp(argv[i],"--profile")==0 && i+1<argc){
+            profile_prefix = argv[++i];
+        }
+        else if(strcmp(argv[i],"--profile-hz")==0 && i+1<argc){
+            profile_hz = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--census")==0 && i+1<argc){
+            census_rate = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--snapshot")==0 && i+1<argc){
+            snapshot_prefix = argv[++i];
+        }
+        else if(strcmp(argv[i],"--paged-heap")==0){
+            paged_heap = 1;
+        }
+        else if(strcmp(argv[i],"--huge-pages")==0){
+            paged_heap = 1;
+            huge_pages = 1;
+        }
+        else if(strcmp(argv[i],"--decay")==0 && i+1<argc){
+            paged_heap = 1;
+            decay = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--max-heap")==0 && i+1<argc){
+            max_heap = parse_size(argv[++i]);
+            if(max_heap <= 0){
+                printf("Invalid heap size: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i],"--mark-budget")==0 && i+1<argc){
+            mark_budget = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--immix")==0){
+            immix = 1;
+        }
+        else if(strcmp(argv[i],"--copy-order")==0 && i+1<argc){
+            i++;
+            if(strcmp(argv[i],"breadth")==0) copy_order = COPY_ORDER_BREADTH;
+            else if(strcmp(argv[i],"depth")==0) copy_order = COPY_ORDER_DEPTH;
+            else{
+                printf("Invalid copy order: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i],"--generational")==0){
+            generational = 1;
+        }
+        else if(strcmp(argv[i],"--pretenure")==0){
+            generational = 1;
+            pretenure = 1;
+        }
+        else if(strcmp(argv[i],"--record")==0 && i+1<argc){
+            record_path = argv[++i];
+        }
+        else if(strcmp(argv[i],"--no-escape")==0){
+            escape = 0;
+        }
+        else if(strcmp(argv[i],"--gc-stats")==0){
+            gc_stats = 1;
+        }
+        else{
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
     int code_size;
     int *bytecode = load_bytecode(argv[1],&code_size);
     if(!bytecode) return 1;
 
-    VM vm;
-    vm_init(&vm,bytecode);
+    // Pairs that never leave their basic block go to scratch slots. Not
+    // when recording: the trace only sees heap objects.
+    LocalPairs *local_pairs = escape && !record_path ? escape_analyze(bytecode, code_size) : NULL;
+
+    // STRING literals (prog.bc.str)
+    ConstantPool *constants = load_constants(argv[1]);
+
+    VM *vm = vm_new(bytecode);
+    if(!vm || vm_attach_local_pairs(vm, local_pairs) != 0 || vm_attach_constants(vm, constants) != 0){
+        printf("Out of memory\n");
+        return 1;
+    }
+    // mmap-backed pages instead of one malloc per object
+    SharedHeap *heap = NULL;
+    if(paged_heap){
+        heap = heap_create();
+        if(!heap || heap_attach(heap, vm) != 0){
+            printf("Failed to create paged heap\n");
+            return 1;
+        }
+        heap->huge_pages = huge_pages;
+        heap->decay = decay;
+        heap->max_bytes = max_heap;
+    }
+    else{
+        vm->max_heap_bytes = max_heap;
+        // Mark-region blocks instead of one malloc per object
+        if(immix && !(vm->immix = immix_create())){
+            printf("Out of memory\n");
+            return 1;
+        }
+    }
+    vm->mark_stack_budget = mark_budget;
+    vm->copy_order = copy_order;
+    // Nursery plus mature space; only the private malloc heap supports it
+    if(generational && (paged_heap || immix)){
+        printf("--generational needs the default private heap\n");
+        return 1;
+    }
+    vm->generational = generational;
+    if(pretenure && !(vm->pretenure = pretenure_create(code_size))){
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    // Allocation/mutation trace for gcsim; objects are known by address
+    if(record_path && immix){
+        printf("--record needs a heap that does not move objects (no --immix)\n");
+        return 1;
+    }
+    if(record_path && !(vm->recorder = recorder_open(record_path))){
+        printf("Cannot create %s\n", record_path);
+        return 1;
+    }
+    // Region objects would be missing from the trace too; keep them on the heap
+    if(record_path) vm->region.bypass = 1;
+
+    if(trace_path){
+        active_trace = trace_create(TRACE_DEFAULT_CAPACITY, TRACE_DEFAULT_ALLOC_SAMPLE);
+        if(!active_trace){
+            printf("Failed to allocate trace buffer\n");
+            return 1;
+        }
+        vm->trace = active_trace;
+        atexit(flush_trace);
+    }
+
+    Profiler *profiler = NULL;
+    if(profile_prefix){
+        profiler = profiler_create(code_size, PROFILE_DEFAULT_PERIOD);
+        if(!profiler){
+            printf("Failed to allocate profiler\n");
+            return 1;
+        }
+        char path[1024];
+        snprintf(path, sizeof(path), "%s.sym", argv[1]);
+        profiler_load_symbols(profiler, path);
+        if(profile_hz > 0 && profiler_start_timer(profiler, profile_hz) != 0){
+            printf("Timer sampling unavailable, using instruction sampling\n");
+        }
+        vm->profiler = profiler;
+    }
+
+    if(census_rate > 0){
+        vm->census = census_create(code_size, census_rate);
+        if(!vm->census){
+            printf("Failed to allocate census\n");
+            return 1;
+        }
+    }
+
+    vm->snapshot_prefix = snapshot_prefix;
+    signal_vm = vm;
+    signal(SIGUSR1, on_sigusr1);
+
     clock_t start = clock();
-    vm_run(&vm);
+    vm_run(vm);
     clock_t end = clock();
     double exec_time = (double)(end - start) / CLOCKS_PER_SEC;
     printf("Execution time: %.6f seconds\n", exec_time);
-    printf("Instructions executed: %ld\n", vm.instruction_count);
-    if(vm.stack.sp>=0){
-        Value result = pop(&vm.stack);
-        printf("Result: %d\n",result.as.i);
+    printf("Instructions executed: %ld\n", vm->instruction_count);
+    if(vm->stack.sp>=0){
+        Value result = pop(&vm->stack);
+        if(result.type == VAL_OBJ && result.as.obj->type == OBJ_STRING){
+            printf("Result: \"%s\"\n", result.as.obj->as.string.chars);
+        }
+        else printf("Result: %d\n",result.as.i);
     }
     else{
         printf("Stack empty at the execution\n");
     }
 
+    if(vm->recorder){
+        long events = vm->recorder->events + 1;
+        if(recorder_close(vm->recorder) == 0){
+            printf("Recorded %ld events to %s\n", events, record_path);
+        }
+        else printf("Failed to write %s\n", record_path);
+        vm->recorder = NULL;
+    }
+
+    if(profiler){
+        char path[1024];
+        profiler_stop_timer(profiler);
+        snprintf(path, sizeof(path), "%s.txt", profile_prefix);
+        FILE *flat = fopen(path, "w");
+        if(flat){
+            profiler_write_flat(profiler, flat);
+            fclose(flat);
+        }
+        snprintf(path, sizeof(path), "%s.folded", profile_prefix);
+        profiler_write_collapsed(profiler, path);
+        printf("Profile written to %s.txt and %s.folded\n", profile_prefix, profile_prefix);
+        profiler_destroy(profiler);
+    }
+
+    if(vm->census){
+        census_print(vm->census, stdout);
+        census_destroy(vm->census);
+    }
+
+    if(gc_stats) print_gc_stats(vm);
+    if(gc_stats && local_pairs){
+        printf("Escape analysis: %d of %d NEW_PAIR sites use scratch pairs\n",
+               local_pairs->sites, local_pairs->candidates);
+    }
+    if(gc_stats && vm->pretenure) pretenure_print(vm->pretenure, stdout);
+
+    // An uncaught VM error (e.g. out of memory) is a failed run
+    int status = vm->error != VM_OK ? 1 : 0;
+    signal_vm = NULL;
+    vm_free(vm);
+    heap_destroy(heap);
+    local_pairs_destroy(local_pairs);
+    constant_pool_destroy(constants);
     free(bytecode);
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
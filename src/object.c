@@ -1,88 +1,266 @@
 #include "vm.h"
 #include "object.h"
+#include "heap.h"
+#include "immix.h"
 #include<stdio.h>
 #include<stdlib.h>
+#include<stddef.h>
+#include<string.h>
+#include<sys/mman.h>
 
-Obj *new_pair(VM *vm, Value left, Value right){
-    Obj *obj = (Obj*)malloc(sizeof(Obj));
-    if(!obj){
-        printf("Out of memory\n");
-        exit(1);
-    }
+static size_t vector_size(int length){
+    return offsetof(Obj, as.vector.items) + (size_t)length * sizeof(Value);
+}
 
-    obj->type = OBJ_PAIR;
-    obj->marked = 0;
-    obj->as.pair.left = left;
-    obj->as.pair.right = right;
+static size_t bytes_size(int length){
+    return offsetof(Obj, as.bytes.data) + (size_t)length;
+}
 
-    obj->next = vm->heap_head;
-    vm->heap_head = obj;
-    vm->heap_size++;
-    
-    // Track allocation statistics
-    vm->gc_stats.total_objects_allocated++;
-    vm->gc_stats.bytes_allocated += sizeof(Obj);
-    
-    // Update peak heap size
-    if (vm->heap_size > vm->gc_stats.max_heap_size) {
-        vm->gc_stats.max_heap_size = vm->heap_size;
+static size_t string_size(int length){
+    return offsetof(Obj, as.string.chars) + (size_t)length + 1;
+}
+
+size_t object_size(Obj *obj){
+    switch(obj->type){
+        case OBJ_VECTOR: return vector_size(obj->as.vector.length);
+        case OBJ_BYTES: return bytes_size(obj->as.bytes.length);
+        case OBJ_STRING: return string_size(obj->as.string.length);
+        default: return sizeof(Obj);
     }
-    
+}
+
+Obj *alloc_object_memory(size_t size){
+    if(size < LARGE_OBJECT_BYTES) return (Obj*)malloc(size);
+    // Large-object space: a mapping of its own, handed back whole on free
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : (Obj*)mem;
+}
+
+static Obj *reserve_private(VM *vm, size_t size){
+    if(vm->max_heap_bytes > 0 && vm->heap_bytes + (long)size > vm->max_heap_bytes) return NULL;
+    return alloc_object_memory(size);
+}
+
+// Private heap: malloc (or a mapping) within max_heap_bytes. When the limit
+// is hit or memory runs out, run one emergency collection and retry.
+static Obj *allocate_private(VM *vm, size_t size){
+    Obj *obj = reserve_private(vm, size);
+    if(obj) return obj;
+
+    vm->gc_stats.emergency_gcs++;
+    if(vm->trace) trace_event(vm->trace, "emergency-gc", TRACE_INSTANT, vm->heap_size);
+    gc(vm);
+    obj = reserve_private(vm, size);
+    if(!obj) vm->gc_stats.failed_allocations++;
     return obj;
 }
 
-Obj *new_function(VM *vm, int address, int arity){
-    Obj *obj = (Obj*)malloc(sizeof(Obj));
-    if(!obj){
-        printf("Out of memory\n");
-        exit(1);
+// Immix blocks count against max_heap_bytes as a whole, next to the
+// large objects in heap_bytes
+static int immix_may_grow(VM *vm){
+    return vm->max_heap_bytes <= 0 ||
+           vm->heap_bytes + immix_committed_bytes(vm->immix) + IMMIX_BLOCK_BYTES <= vm->max_heap_bytes;
+}
+
+static Obj *allocate_immix(VM *vm, size_t size){
+    Obj *obj = immix_alloc(vm->immix, size, immix_may_grow(vm));
+    if(obj) return obj;
+
+    vm->gc_stats.emergency_gcs++;
+    if(vm->trace) trace_event(vm->trace, "emergency-gc", TRACE_INSTANT, vm->heap_size);
+    gc(vm);
+    obj = immix_alloc(vm->immix, size, immix_may_grow(vm));
+    if(!obj) vm->gc_stats.failed_allocations++;
+    return obj;
+}
+
+// Common allocation path: links the object into the heap and updates stats.
+// Returns NULL when the heap is out of memory; nothing is printed, the
+// caller decides whether that is a VM error.
+static Obj *allocate_object(VM *vm, ObjType type, size_t size){
+    Obj *obj;
+    int large;
+    // Inside a region (region.h) objects never reach the collector
+    if(vm->region.depth > 0 && !vm->region.bypass && type != OBJ_WEAK && type != OBJ_EPHEMERON){
+        return region_alloc(&vm->region, type, size);
+    }
+    if(vm->shared){
+        // Anything bigger than a page slot lives in the large-object space
+        large = size > sizeof(Obj);
+        // TLAB fast path: bump allocation, no lock until the run is used up
+        if(large) obj = heap_alloc_large(vm, size);
+        else if(vm->tlab_cursor < vm->tlab_limit) obj = vm->tlab_cursor++;
+        else obj = heap_refill_tlab(vm);
+    }
+    else{
+        large = size >= LARGE_OBJECT_BYTES;
+        obj = vm->immix && !large ? allocate_immix(vm, size) : allocate_private(vm, size);
     }
+    if(!obj) return NULL;
 
-    obj->type = OBJ_FUNCTION;
+    obj->type = type;
     obj->marked = 0;
-    obj->as.function.address = address;
-    obj->as.function.arity = arity;
+    obj->flags = large ? OBJ_FLAG_LARGE : 0;
+    obj->site = SITE_NONE;
+    // vm->pc already points past the allocating opcode
+    int site = vm->bytecode ? vm->pc - 1 : SITE_NATIVE;
+    if (vm->census) {
+        obj->site = census_sample(vm->census, site);
+        if (obj->site != SITE_NONE) obj->flags |= OBJ_FLAG_SAMPLED;
+    }
+    if (vm->pretenure) obj->site = site;
+
+    // Shared-heap objects are found through the page bitmaps, or the heap's
+    // large-object list (linked by heap_alloc_large); Immix objects through
+    // the block marks
+    if(vm->immix && !large){
+        obj->next = NULL;
+        vm->heap_size++;
+    }
+    else if(!vm->shared){
+        Obj **list = large ? &vm->large_head : &vm->heap_head;
+        if(vm->generational && !vm->immix){
+            // Weak refs and ephemerons always start young: minor
+            // collections only process the ones they reach
+            if(!large && vm->pretenure && type != OBJ_WEAK && type != OBJ_EPHEMERON &&
+               pretenure_allocate_mature(vm->pretenure, site)){
+                list = &vm->mature_head;
+                vm->gc_stats.objects_pretenured++;
+            }
+            if(list == &vm->heap_head) vm->young_size++;
+            else{
+                obj->flags |= OBJ_FLAG_MATURE;
+                vm->mature_size++;
+            }
+        }
+        obj->next = *list;
+        *list = obj;
+        vm->heap_size++;
+        vm->heap_bytes += size;
+    }
+    else if(!large) obj->next = NULL;
 
-    obj->next = vm->heap_head;
-    vm->heap_head = obj;
-    vm->heap_size++;
-    
     // Track allocation statistics
     vm->gc_stats.total_objects_allocated++;
-    vm->gc_stats.bytes_allocated += sizeof(Obj);
-    
+    vm->gc_stats.bytes_allocated += size;
+
     // Update peak heap size
     if (vm->heap_size > vm->gc_stats.max_heap_size) {
         vm->gc_stats.max_heap_size = vm->heap_size;
     }
-    
+
+    if (vm->profiler) profile_alloc(vm->profiler, vm);
+    if (vm->recorder) recorder_alloc(vm->recorder, obj, size);
+
+    // Sample the heap size every N allocations to show allocation bursts
+    if (vm->trace && --vm->trace->alloc_countdown <= 0) {
+        vm->trace->alloc_countdown = vm->trace->alloc_sample;
+        trace_event(vm->trace, "heap", TRACE_COUNTER, vm->heap_size);
+    }
+
     return obj;
 }
 
-Obj *new_closure(VM *vm, Obj *function, Obj *env){
-    Obj *obj = (Obj*)malloc(sizeof(Obj));
-    if(!obj){
-        printf("Out of memory\n");
-        exit(1);
-    }
+// Release an object's memory; the caller has already unlinked it. vm is
+// NULL for the shared heap's large objects, which the heap accounts for.
+void free_object(VM *vm, Obj *obj){
+    size_t size = object_size(obj);
+    if(vm && !vm->shared) vm->heap_bytes -= size;
+    if(size >= LARGE_OBJECT_BYTES) munmap(obj, size);
+    else free(obj);
+}
 
-    obj->type = OBJ_CLOSURE;
-    obj->marked = 0;
+// Links a new object starts with, for the recorder (fields start empty)
+static void record_field(VM *vm, Obj *obj, int field, Value value){
+    if(vm->recorder && value.type == VAL_OBJ) recorder_field(vm->recorder, obj, field, value);
+}
+
+Obj *new_pair(VM *vm, Value left, Value right){
+    Obj *obj = allocate_object(vm, OBJ_PAIR, sizeof(Obj));
+    if(!obj) return NULL;
+    obj->as.pair.left = left;
+    obj->as.pair.right = right;
+    // A pretenured pair may start out pointing at young objects
+    gc_write_barrier(vm, obj, left);
+    gc_write_barrier(vm, obj, right);
+    record_field(vm, obj, 0, left);
+    record_field(vm, obj, 1, right);
+    return obj;
+}
+
+Obj *new_function(VM *vm, int address, int arity){
+    Obj *obj = allocate_object(vm, OBJ_FUNCTION, sizeof(Obj));
+    if(!obj) return NULL;
+    obj->as.function.address = address;
+    obj->as.function.arity = arity;
+    return obj;
+}
+
+Obj *new_closure(VM *vm, Obj *function, Obj *env){
+    Obj *obj = allocate_object(vm, OBJ_CLOSURE, sizeof(Obj));
+    if(!obj) return NULL;
     obj->as.closure.function = function;
     obj->as.closure.env = env;
+    if(function) gc_write_barrier(vm, obj, make_obj_value(function));
+    if(env) gc_write_barrier(vm, obj, make_obj_value(env));
+    if(function) record_field(vm, obj, 0, make_obj_value(function));
+    if(env) record_field(vm, obj, 1, make_obj_value(env));
+    return obj;
+}
 
-    obj->next = vm->heap_head;
-    vm->heap_head = obj;
-    vm->heap_size++;
-    
-    // Track allocation statistics
-    vm->gc_stats.total_objects_allocated++;
-    vm->gc_stats.bytes_allocated += sizeof(Obj);
-    
-    // Update peak heap size
-    if (vm->heap_size > vm->gc_stats.max_heap_size) {
-        vm->gc_stats.max_heap_size = vm->heap_size;
-    }
-    
+Obj *new_weak(VM *vm, Obj *referent){
+    Obj *obj = allocate_object(vm, OBJ_WEAK, sizeof(Obj));
+    if(!obj) return NULL;
+    obj->as.weak.referent = referent;
+    obj->as.weak.next = NULL;
+    return obj;
+}
+
+Obj *new_ephemeron(VM *vm, Obj *key, Value value){
+    Obj *obj = allocate_object(vm, OBJ_EPHEMERON, sizeof(Obj));
+    if(!obj) return NULL;
+    obj->as.ephemeron.key = key;
+    obj->as.ephemeron.value = value;
+    obj->as.ephemeron.next = NULL;
+    // The key is weak; gcsim treats the value as an ordinary field
+    record_field(vm, obj, 0, value);
+    return obj;
+}
+
+Obj *new_vector(VM *vm, int length){
+    Obj *obj = allocate_object(vm, OBJ_VECTOR, vector_size(length));
+    if(!obj) return NULL;
+    obj->as.vector.length = length;
+    for(int i = 0; i < length; i++) obj->as.vector.items[i] = make_int_value(0);
+    return obj;
+}
+
+Obj *new_bytes(VM *vm, int length){
+    Obj *obj = allocate_object(vm, OBJ_BYTES, bytes_size(length));
+    if(!obj) return NULL;
+    obj->as.bytes.length = length;
+    memset(obj->as.bytes.data, 0, length);
+    return obj;
+}
+
+Obj *new_table(VM *vm){
+    Obj *obj = allocate_object(vm, OBJ_TABLE, sizeof(Obj));
+    if(!obj) return NULL;
+    obj->as.table.entries = NULL;
+    obj->as.table.old = NULL;
+    obj->as.table.count = 0;
+    obj->as.table.start = 0;
+    obj->as.table.migrated = 0;
+    return obj;
+}
+
+Obj *new_string(VM *vm, const char *chars, int length, unsigned int hash){
+    Obj *obj = allocate_object(vm, OBJ_STRING, string_size(length));
+    if(!obj) return NULL;
+    obj->flags |= OBJ_FLAG_INTERNED;
+    obj->as.string.length = length;
+    obj->as.string.hash = hash;
+    memcpy(obj->as.string.chars, chars, length);
+    obj->as.string.chars[length] = '\0';
     return obj;
 }
@@ -6,12 +6,40 @@
 typedef enum{
     OBJ_PAIR,
     OBJ_FUNCTION,
-    OBJ_CLOSURE
+    OBJ_CLOSURE,
+    OBJ_WEAK,
+    OBJ_EPHEMERON,
+    OBJ_VECTOR,
+    OBJ_BYTES,
+    OBJ_TABLE,
+    OBJ_STRING
 }ObjType;
 
+#define OBJ_TYPE_COUNT 9
+
+// Obj.flags
+#define OBJ_FLAG_LARGE 1        // In the large-object space; marked through Obj.marked
+#define OBJ_FLAG_FORWARDED 2    // Moved by the collector; Obj.next is the new copy
+#define OBJ_FLAG_MATURE 4       // Generational heap: promoted, pretenured or large
+#define OBJ_FLAG_REMEMBERED 8   // Mature object in the remembered set
+#define OBJ_FLAG_SAMPLED 16     // Counted by the heap census
+#define OBJ_FLAG_LOCAL 32       // Scratch pair of a NEW_LOCAL_PAIR, not on the heap
+#define OBJ_FLAG_REGION 64      // In an allocation region (region.h), not on the heap
+#define OBJ_FLAG_INTERNED 128   // Hash-consed pair (cons.h) or string (intern.h); never mutated
+
+// Objects of at least this many bytes get their own mapping in the
+// large-object space instead of coming from malloc or a heap page
+#define LARGE_OBJECT_BYTES 16384
+
+// Values of Obj.site besides a bytecode pc
+#define SITE_NONE   (-1)   // Allocation site not recorded
+#define SITE_NATIVE (-2)   // Allocated from C (no bytecode)
+
 typedef struct Obj{
     ObjType type;
     int marked;
+    int site;           // Allocating pc, when sampled by the census or pretenuring is on
+    int flags;          // OBJ_FLAG_*
     struct Obj *next;
     union{
         struct{
@@ -28,6 +56,49 @@ typedef struct Obj{
             struct Obj *function;  // The function object
             struct Obj *env;       // Captured environment
         }closure;
+
+        // Weak references do not keep their target alive; the collector
+        // clears the field once nothing else reaches it
+        struct{
+            struct Obj *referent;  // NULL once collected
+            struct Obj *next;      // Found-during-marking list (gc.c)
+        }weak;
+
+        // Key is weak; value is kept alive only while the key is
+        struct{
+            struct Obj *key;       // NULL once collected (value is cleared too)
+            struct Obj *next;      // Found-during-marking list (gc.c)
+            Value value;
+        }ephemeron;
+
+        // Variable-size objects: the elements follow inline, so the
+        // allocation is object_size() bytes rather than sizeof(Obj)
+        struct{
+            int length;
+            Value items[];         // Traced by the collector
+        }vector;
+
+        struct{
+            int length;
+            unsigned char data[];  // Raw bytes, never scanned
+        }bytes;
+
+        // Hash table (table.h): the buckets are vectors of key, value
+        // Values
+        struct{
+            struct Obj *entries;   // NULL until the first put
+            struct Obj *old;       // Buckets still migrating to entries
+            int count;
+            int start;             // Bucket of old where migration began
+            int migrated;          // Buckets of old moved so far
+        }table;
+
+        // Interned (intern.h), so never mutated
+        struct{
+            int length;
+            unsigned int hash;     // string_hash() of chars
+            char chars[];          // length bytes and a NUL
+        }string;
     }as;
 }Obj;
 
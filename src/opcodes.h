@@ -0,0 +1,53 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+// Bytecode instruction set, shared by the interpreter (vm.c) and the
+// load-time analyses (escape.c). asm.c keeps its own mnemonic table.
+
+#define OP_PUSH 0x01
+#define OP_POP 0x02
+#define OP_DUP 0x03
+#define OP_ADD 0x10
+#define OP_SUB 0x11
+#define OP_MUL 0x12
+#define OP_DIV 0x13
+#define OP_CMP 0x14
+#define OP_SAME 0x15        // 1 if both are the same int or the same object
+#define OP_HALT 0xff
+#define OP_JMP  0x20
+#define OP_JZ   0x21
+#define OP_JNZ  0x22
+#define OP_STORE 0x30
+#define OP_LOAD  0x31
+#define OP_CONST 0x32       // Push a constant pool string (intern.h)
+#define OP_CALL 0x40
+#define OP_RET 0x41
+#define OP_NEW_PAIR 0x50    // New: create a pair from top two stack values
+#define OP_PAIR_LEFT 0x51   // New: get left value from pair
+#define OP_PAIR_RIGHT 0x52  // New: get right value from pair
+#define OP_SET_LEFT 0x53    // New: set left value of pair
+#define OP_SET_RIGHT 0x54   // New: set right value of pair
+#define OP_NEW_WEAK 0x55        // Weak reference to the object on top
+#define OP_NEW_EPHEMERON 0x56   // Ephemeron from key and value
+#define OP_WEAK_GET 0x57        // Referent (or ephemeron key), 0 once cleared
+#define OP_EPHEMERON_VALUE 0x58 // Ephemeron value, 0 once cleared
+#define OP_NEW_LOCAL_PAIR 0x59  // NEW_PAIR rewritten by escape analysis (not in asm)
+#define OP_CONS_SHARED 0x5a     // Immutable pair, shared with every equal one
+#define OP_GC 0x60          // New: explicit GC trigger
+#define OP_SNAPSHOT 0x61    // Dump the object graph to a snapshot file
+#define OP_REGION_BEGIN 0x62    // Allocate in a region until the matching REGION_END
+#define OP_REGION_END 0x63      // Free the region; objects left on the stack move to the heap
+#define OP_TRY 0x70         // Install an error handler at the operand address
+#define OP_END_TRY 0x71     // Remove the innermost handler
+#define OP_NEW_VECTOR 0x80      // Vector of n elements, all 0
+#define OP_NEW_BYTES 0x81       // Byte array of n zero bytes
+#define OP_ARRAY_GET 0x82       // Element of a vector or byte array
+#define OP_ARRAY_SET 0x83       // Store an element; the array stays on the stack
+#define OP_ARRAY_LEN 0x84       // Element count of a vector or byte array
+#define OP_TABLE_NEW 0x90       // Empty hash table
+#define OP_TABLE_GET 0x91       // Value under a key, 0 if there is none
+#define OP_TABLE_PUT 0x92       // Store under a key; the table stays on the stack
+#define OP_TABLE_DELETE 0x93    // Remove a key; the table stays on the stack
+#define OP_TABLE_SIZE 0x94      // Number of keys
+
+#endif
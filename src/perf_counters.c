@@ -0,0 +1,78 @@
+#include "perf_counters.h"
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const unsigned long long events[3] = {
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+void perf_counters_open(PerfCounters *pc){
+    for(int i=0;i<3;i++){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = events[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        pc->fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+void perf_counters_close(PerfCounters *pc){
+    for(int i=0;i<3;i++){
+        if(pc->fds[i] >= 0) close(pc->fds[i]);
+        pc->fds[i] = -1;
+    }
+}
+
+void perf_counters_start(PerfCounters *pc){
+    for(int i=0;i<3;i++){
+        if(pc->fds[i] < 0) continue;
+        ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_counters_stop(PerfCounters *pc, PerfSample *out){
+    long long values[3];
+    for(int i=0;i<3;i++){
+        values[i] = -1;
+        if(pc->fds[i] < 0) continue;
+        ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        long long v;
+        if(read(pc->fds[i], &v, sizeof(v)) == (ssize_t)sizeof(v)) values[i] = v;
+    }
+    out->instructions = values[0];
+    out->cycles = values[1];
+    out->cache_misses = values[2];
+}
+
+#else
+
+void perf_counters_open(PerfCounters *pc){
+    for(int i=0;i<3;i++) pc->fds[i] = -1;
+}
+
+void perf_counters_close(PerfCounters *pc){
+    (void)pc;
+}
+
+void perf_counters_start(PerfCounters *pc){
+    (void)pc;
+}
+
+void perf_counters_stop(PerfCounters *pc, PerfSample *out){
+    (void)pc;
+    out->instructions = out->cycles = out->cache_misses = -1;
+}
+
+#endif
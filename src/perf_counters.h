@@ -0,0 +1,23 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// Hardware counters around a region of code, via perf_event_open(2) on
+// Linux. Elsewhere, or when the kernel refuses (perf_event_paranoid,
+// containers), every counter reads as -1 and callers print "n/a".
+
+typedef struct {
+    long long instructions;
+    long long cycles;
+    long long cache_misses;
+} PerfSample;
+
+typedef struct {
+    int fds[3];          // instructions, cycles, cache misses (-1 = closed)
+} PerfCounters;
+
+void perf_counters_open(PerfCounters *pc);
+void perf_counters_close(PerfCounters *pc);
+void perf_counters_start(PerfCounters *pc);
+void perf_counters_stop(PerfCounters *pc, PerfSample *out);
+
+#endif
@@ -7,30 +7,7 @@
 
 // Helper to initialize VM for testing
 void test_vm_init(VM *vm) {
-    init_stack(&vm->stack);
-    vm->bytecode = NULL;
-    vm->pc = 0;
-    vm->running = 1;
-    vm->rsp = -1;
-    vm->instruction_count = 0;
-    vm->heap_head = NULL;
-    vm->heap_size = 0;
-    vm->gc_threshold = 100;
-    
-    // Initialize performance statistics
-    vm->gc_stats.total_gc_calls = 0;
-    vm->gc_stats.total_objects_allocated = 0;
-    vm->gc_stats.total_objects_freed = 0;
-    vm->gc_stats.total_gc_time = 0.0;
-    vm->gc_stats.max_gc_pause = 0.0;
-    vm->gc_stats.min_gc_pause = 0.0;
-    vm->gc_stats.max_heap_size = 0;
-    vm->gc_stats.bytes_allocated = 0;
-    
-    for(int i = 0; i < 1024; i++){
-        vm->memory[i] = make_int_value(0);
-        vm->valid[i] = 0;
-    }
+    vm_init(vm, NULL);
 }
 
 // Benchmark 1: Memory Churn (High allocation/collection rate)
@@ -0,0 +1,68 @@
+#include "pretenure.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+Pretenure *pretenure_create(int code_size){
+    if(code_size < 0) code_size = 0;
+    Pretenure *pretenure = (Pretenure*)calloc(1, sizeof(Pretenure));
+    if(!pretenure) return NULL;
+    pretenure->sites = (PretenureSite*)calloc(code_size + 1, sizeof(PretenureSite));
+    if(!pretenure->sites){
+        free(pretenure);
+        return NULL;
+    }
+    pretenure->code_size = code_size;
+    for(int i = 0; i <= code_size; i++) pretenure->sites[i].window = PRETENURE_WINDOW;
+    return pretenure;
+}
+
+void pretenure_destroy(Pretenure *pretenure){
+    if(!pretenure) return;
+    free(pretenure->sites);
+    free(pretenure);
+}
+
+int pretenure_allocate_mature(Pretenure *pretenure, int site){
+    if(site < 0 || site >= pretenure->code_size) site = pretenure->code_size;
+    PretenureSite *s = &pretenure->sites[site];
+    if(!s->pretenured) return 0;
+    if(--s->countdown <= 0){
+        // Probe: this one is allocated young to keep measuring the site
+        s->countdown = PRETENURE_PROBE;
+        return 0;
+    }
+    s->mature_allocated++;
+    return 1;
+}
+
+void pretenure_decide(Pretenure *pretenure, PretenureSite *s){
+    int percent = s->survived * 100 / (s->survived + s->died);
+    if(!s->pretenured && percent >= PRETENURE_ENTER_PERCENT){
+        s->pretenured = 1;
+        s->countdown = PRETENURE_PROBE;
+        pretenure->decisions++;
+    }
+    else if(s->pretenured && percent < PRETENURE_EXIT_PERCENT){
+        s->pretenured = 0;
+        pretenure->reversals++;
+    }
+    // Pretenured sites only see their probes, so their window is shorter
+    s->window = s->pretenured ? PRETENURE_WINDOW / PRETENURE_PROBE : PRETENURE_WINDOW;
+    s->survived = 0;
+    s->died = 0;
+}
+
+void pretenure_print(Pretenure *pretenure, FILE *out){
+    fprintf(out, "Pretenuring: %ld site(s) switched to mature allocation, %ld switched back\n",
+            pretenure->decisions, pretenure->reversals);
+    fprintf(out, "  %-8s %12s %10s\n", "site", "pretenured", "state");
+    for(int i = 0; i <= pretenure->code_size; i++){
+        PretenureSite *s = &pretenure->sites[i];
+        if(s->mature_allocated == 0 && !s->pretenured) continue;
+        char site[16];
+        if(i == pretenure->code_size) snprintf(site, sizeof(site), "native");
+        else snprintf(site, sizeof(site), "pc %d", i);
+        fprintf(out, "  %-8s %12ld %10s\n", site, s->mature_allocated,
+                s->pretenured ? "mature" : "young");
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PRETENURE_H
+#define PRETENURE_H
+
+#include <stdio.h>
+
+// Dynamic pretenuring for the generational heap (vm->generational). Every
+// allocation site (bytecode pc, plus one slot for native code) counts how
+// many of its young objects survive their first collection. After
+// PRETENURE_WINDOW outcomes, a site whose survival reached
+// PRETENURE_ENTER_PERCENT allocates straight into the mature space, so
+// minor collections no longer trace and promote its objects one by one. A pretenured site still sends one allocation in
+// PRETENURE_PROBE to the nursery, which keeps its survival measured: once
+// that drops below PRETENURE_EXIT_PERCENT the site allocates young again.
+
+#define PRETENURE_WINDOW 256
+#define PRETENURE_ENTER_PERCENT 80
+#define PRETENURE_EXIT_PERCENT 50
+#define PRETENURE_PROBE 32
+
+typedef struct {
+    int survived;           // Young objects promoted, current window
+    int died;               // Young objects freed, current window
+    int pretenured;         // Allocating in the mature space
+    int countdown;          // Pretenured allocations until the next probe
+    int window;             // Outcomes per decision
+    long mature_allocated;  // Objects allocated pretenured
+} PretenureSite;
+
+typedef struct Pretenure {
+    int code_size;
+    PretenureSite *sites;   // code_size slots, then one for SITE_NATIVE
+    long decisions;         // Sites switched to pretenuring
+    long reversals;         // Sites switched back to young allocation
+} Pretenure;
+
+Pretenure *pretenure_create(int code_size);
+void pretenure_destroy(Pretenure *pretenure);
+
+// Whether the next object from site goes to the mature space
+int pretenure_allocate_mature(Pretenure *pretenure, int site);
+
+// Called when a site's window is full: switches it if its survival rate
+// crossed a threshold, then starts a new window
+void pretenure_decide(Pretenure *pretenure, PretenureSite *s);
+
+// Sweep hook for every young object, so kept inline
+static inline void pretenure_record(Pretenure *pretenure, int site, int survived){
+    if((unsigned)site >= (unsigned)pretenure->code_size) site = pretenure->code_size;
+    PretenureSite *s = &pretenure->sites[site];
+    if(survived) s->survived++;
+    else s->died++;
+    if(s->survived + s->died >= s->window) pretenure_decide(pretenure, s);
+}
+
+void pretenure_print(Pretenure *pretenure, FILE *out);
+
+#endif
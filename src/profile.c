@@ -0,0 +1,308 @@
+#include "profile.h"
+#include "vm.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAIN_FRAME (-1)
+
+// SIGPROF can only be delivered to one handler per process
+static Profiler *timer_profiler = NULL;
+
+static void on_sigprof(int sig){
+    (void)sig;
+    if(timer_profiler) timer_profiler->sample_pending = 1;
+}
+
+Profiler *profiler_create(int code_size, long sample_period){
+    Profiler *prof = (Profiler*)calloc(1, sizeof(Profiler));
+    if(!prof) return NULL;
+
+    prof->code_size = code_size;
+    prof->pc_counts = (long*)calloc(code_size, sizeof(long));
+    prof->pc_opcodes = (unsigned char*)calloc(code_size, 1);
+    prof->fn_instructions = (long*)calloc(code_size + 1, sizeof(long));
+    prof->fn_allocs = (long*)calloc(code_size + 1, sizeof(long));
+    prof->fn_gc_allocs = (long*)calloc(code_size + 1, sizeof(long));
+    prof->sample_capacity = 256;
+    prof->samples = (StackSample*)calloc(prof->sample_capacity, sizeof(StackSample));
+    if(!prof->pc_counts || !prof->pc_opcodes || !prof->fn_instructions || !prof->fn_allocs ||
+       !prof->fn_gc_allocs || !prof->samples){
+        profiler_destroy(prof);
+        return NULL;
+    }
+
+    prof->sample_period = sample_period > 0 ? sample_period : PROFILE_DEFAULT_PERIOD;
+    prof->countdown = prof->sample_period;
+    return prof;
+}
+
+void profiler_destroy(Profiler *prof){
+    if(!prof) return;
+    profiler_stop_timer(prof);
+    for(int i=0;i<prof->sample_capacity;i++){
+        free(prof->samples[i].frames);
+    }
+    free(prof->samples);
+    free(prof->pc_counts);
+    free(prof->pc_opcodes);
+    free(prof->fn_instructions);
+    free(prof->fn_allocs);
+    free(prof->fn_gc_allocs);
+    free(prof->symbols);
+    free(prof);
+}
+
+int profiler_start_timer(Profiler *prof, int hz){
+    if(hz <= 0 || timer_profiler) return -1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGPROF, &sa, NULL) != 0) return -1;
+
+    struct itimerval tv;
+    tv.it_interval.tv_sec = 0;
+    tv.it_interval.tv_usec = hz >= 1000000 ? 1 : 1000000 / hz;
+    tv.it_value = tv.it_interval;
+    timer_profiler = prof;
+    prof->timer_hz = hz;
+    if(setitimer(ITIMER_PROF, &tv, NULL) != 0){
+        timer_profiler = NULL;
+        prof->timer_hz = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void profiler_stop_timer(Profiler *prof){
+    if(timer_profiler != prof) return;
+    struct itimerval tv;
+    memset(&tv, 0, sizeof(tv));
+    setitimer(ITIMER_PROF, &tv, NULL);
+    signal(SIGPROF, SIG_DFL);
+    timer_profiler = NULL;
+    prof->timer_hz = 0;
+}
+
+int profiler_load_symbols(Profiler *prof, const char *path){
+    FILE *fp = fopen(path, "r");
+    if(!fp) return 0;
+
+    int capacity = 64;
+    ProfileSymbol *symbols = (ProfileSymbol*)malloc(sizeof(ProfileSymbol) * capacity);
+    int count = 0;
+    int addr;
+    char name[64];
+    while(symbols && fscanf(fp, "%d %63s", &addr, name) == 2){
+        if(count == capacity){
+            capacity *= 2;
+            ProfileSymbol *grown = (ProfileSymbol*)realloc(symbols, sizeof(ProfileSymbol) * capacity);
+            if(!grown) break;
+            symbols = grown;
+        }
+        symbols[count].addr = addr;
+        strcpy(symbols[count].name, name);
+        count++;
+    }
+    fclose(fp);
+
+    free(prof->symbols);
+    prof->symbols = symbols;
+    prof->symbol_count = symbols ? count : 0;
+    return prof->symbol_count;
+}
+
+static int current_function(struct VM *vm){
+    return vm->rsp >= 0 ? vm->call_targets[vm->rsp] : MAIN_FRAME;
+}
+
+static int fn_slot(Profiler *prof, int addr){
+    if(addr < 0 || addr >= prof->code_size) return prof->code_size;
+    return addr;
+}
+
+static StackSample *find_sample(Profiler *prof, const int *frames, int depth, unsigned int hash){
+    int mask = prof->sample_capacity - 1;
+    int i = (int)(hash & (unsigned int)mask);
+    while(prof->samples[i].frames){
+        StackSample *s = &prof->samples[i];
+        if(s->hash == hash && s->depth == depth &&
+           memcmp(s->frames, frames, sizeof(int) * depth) == 0){
+            return s;
+        }
+        i = (i + 1) & mask;
+    }
+    return &prof->samples[i];
+}
+
+static void grow_samples(Profiler *prof){
+    StackSample *old = prof->samples;
+    int old_capacity = prof->sample_capacity;
+    StackSample *grown = (StackSample*)calloc(old_capacity * 2, sizeof(StackSample));
+    if(!grown) return;
+
+    prof->samples = grown;
+    prof->sample_capacity = old_capacity * 2;
+    for(int i=0;i<old_capacity;i++){
+        if(!old[i].frames) continue;
+        *find_sample(prof, old[i].frames, old[i].depth, old[i].hash) = old[i];
+    }
+    free(old);
+}
+
+static void record_stack(Profiler *prof, struct VM *vm){
+    int frames[PROFILE_MAX_DEPTH];
+    int first = vm->rsp + 1 > PROFILE_MAX_DEPTH - 1 ? vm->rsp + 2 - PROFILE_MAX_DEPTH : 0;
+    int depth = 0;
+    frames[depth++] = MAIN_FRAME;
+    for(int i=first;i<=vm->rsp;i++){
+        frames[depth++] = vm->call_targets[i];
+    }
+
+    // FNV-1a over the frame addresses
+    unsigned int hash = 2166136261u;
+    for(int i=0;i<depth;i++){
+        hash = (hash ^ (unsigned int)frames[i]) * 16777619u;
+    }
+
+    if(prof->sample_count * 2 >= prof->sample_capacity) grow_samples(prof);
+    StackSample *s = find_sample(prof, frames, depth, hash);
+    if(!s->frames){
+        s->frames = (int*)malloc(sizeof(int) * depth);
+        if(!s->frames) return;
+        memcpy(s->frames, frames, sizeof(int) * depth);
+        s->hash = hash;
+        s->depth = depth;
+        s->count = 0;
+        prof->sample_count++;
+    }
+    s->count++;
+    prof->total_samples++;
+}
+
+void profile_instruction(Profiler *prof, struct VM *vm, int pc, int opcode){
+    prof->op_counts[opcode & 0xff]++;
+    if(pc >= 0 && pc < prof->code_size){
+        prof->pc_counts[pc]++;
+        prof->pc_opcodes[pc] = (unsigned char)opcode;
+    }
+    prof->fn_instructions[fn_slot(prof, current_function(vm))]++;
+
+    if(prof->timer_hz){
+        if(prof->sample_pending){
+            prof->sample_pending = 0;
+            record_stack(prof, vm);
+        }
+    }
+    else if(--prof->countdown <= 0){
+        prof->countdown = prof->sample_period;
+        record_stack(prof, vm);
+    }
+}
+
+void profile_alloc(Profiler *prof, struct VM *vm){
+    int slot = fn_slot(prof, current_function(vm));
+    prof->fn_allocs[slot]++;
+    // vm_run collects before the next instruction once this limit is reached
+    if(vm->heap_size >= vm->gc_threshold) prof->fn_gc_allocs[slot]++;
+}
+
+// Exact label for a function entry, or "<main>" / "fn@addr"
+static void function_name(Profiler *prof, int addr, char *out, size_t size){
+    if(addr == MAIN_FRAME){
+        snprintf(out, size, "<main>");
+        return;
+    }
+    for(int i=0;i<prof->symbol_count;i++){
+        if(prof->symbols[i].addr == addr){
+            snprintf(out, size, "%s", prof->symbols[i].name);
+            return;
+        }
+    }
+    snprintf(out, size, "fn@%d", addr);
+}
+
+// Nearest preceding label for an arbitrary pc, e.g. "loop+3"
+static void pc_name(Profiler *prof, int pc, char *out, size_t size){
+    int best = -1;
+    for(int i=0;i<prof->symbol_count;i++){
+        if(prof->symbols[i].addr <= pc &&
+           (best < 0 || prof->symbols[i].addr > prof->symbols[best].addr)){
+            best = i;
+        }
+    }
+    if(best < 0) snprintf(out, size, "%d", pc);
+    else if(prof->symbols[best].addr == pc) snprintf(out, size, "%s", prof->symbols[best].name);
+    else snprintf(out, size, "%s+%d", prof->symbols[best].name, pc - prof->symbols[best].addr);
+}
+
+void profiler_write_flat(Profiler *prof, FILE *out){
+    long total = 0;
+    for(int i=0;i<256;i++) total += prof->op_counts[i];
+    if(total == 0) total = 1;
+    char name[96];
+
+    fprintf(out, "Opcode profile:\n");
+    fprintf(out, "  %-12s %14s %8s\n", "opcode", "count", "share");
+    for(int i=0;i<256;i++){
+        if(!prof->op_counts[i]) continue;
+        fprintf(out, "  %-12s %14ld %7.2f%%\n", vm_opcode_name(i),
+                prof->op_counts[i], 100.0 * prof->op_counts[i] / total);
+    }
+
+    fprintf(out, "\nHottest instructions:\n");
+    fprintf(out, "  %-6s %-20s %-12s %14s\n", "pc", "location", "opcode", "count");
+    for(int shown=0;shown<20;shown++){
+        int best = -1;
+        for(int pc=0;pc<prof->code_size;pc++){
+            if(prof->pc_counts[pc] > 0 && (best < 0 || prof->pc_counts[pc] > prof->pc_counts[best])){
+                best = pc;
+            }
+        }
+        if(best < 0) break;
+        long count = prof->pc_counts[best];
+        pc_name(prof, best, name, sizeof(name));
+        fprintf(out, "  %-6d %-20s %-12s %14ld\n", best, name,
+                vm_opcode_name(prof->pc_opcodes[best]), count);
+        prof->pc_counts[best] = -count; // hide while selecting, restored below
+    }
+    for(int pc=0;pc<prof->code_size;pc++){
+        if(prof->pc_counts[pc] < 0) prof->pc_counts[pc] = -prof->pc_counts[pc];
+    }
+
+    fprintf(out, "\nFunctions (by CALL target):\n");
+    fprintf(out, "  %-20s %14s %10s %12s\n", "function", "instructions", "allocs", "gc-triggers");
+    for(int slot=prof->code_size;slot>=0;slot--){
+        if(!prof->fn_instructions[slot] && !prof->fn_allocs[slot]) continue;
+        function_name(prof, slot == prof->code_size ? MAIN_FRAME : slot, name, sizeof(name));
+        fprintf(out, "  %-20s %14ld %10ld %12ld\n", name, prof->fn_instructions[slot],
+                prof->fn_allocs[slot], prof->fn_gc_allocs[slot]);
+    }
+    fprintf(out, "\nStack samples: %ld (%d distinct stacks)\n",
+            prof->total_samples, prof->sample_count);
+}
+
+int profiler_write_collapsed(Profiler *prof, const char *path){
+    FILE *fp = fopen(path, "w");
+    if(!fp){
+        perror("failed to open profile output");
+        return -1;
+    }
+    char name[96];
+    for(int i=0;i<prof->sample_capacity;i++){
+        StackSample *s = &prof->samples[i];
+        if(!s->frames) continue;
+        for(int f=0;f<s->depth;f++){
+            function_name(prof, s->frames[f], name, sizeof(name));
+            fprintf(fp, "%s%s", f ? ";" : "", name);
+        }
+        fprintf(fp, " %ld\n", s->count);
+    }
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+// Bytecode profiler: exact per-opcode / per-pc execution counts, allocation
+// attribution to the active CALL target, and sampled call stacks written in
+// the collapsed ("folded") format used by flamegraph.pl and speedscope.
+
+#define PROFILE_DEFAULT_PERIOD 1000  // Instructions between stack samples
+#define PROFILE_MAX_DEPTH 64         // Innermost frames kept per sample
+
+struct VM;
+
+typedef struct {
+    char name[64];
+    int addr;
+} ProfileSymbol;
+
+typedef struct {
+    unsigned int hash;
+    int depth;
+    int *frames;         // Callee addresses, outermost first (-1 = <main>)
+    long count;
+} StackSample;
+
+typedef struct Profiler {
+    long op_counts[256];        // Executions per opcode
+    long *pc_counts;            // Executions per bytecode index
+    unsigned char *pc_opcodes;  // Opcode seen at each executed index
+    int code_size;
+
+    // Per-function cost, indexed by callee address; slot code_size is <main>
+    long *fn_instructions;
+    long *fn_allocs;
+    long *fn_gc_allocs;         // Allocations that pushed the heap past gc_threshold
+
+    // Stack sampling: every sample_period instructions, or on SIGPROF ticks
+    long sample_period;
+    long countdown;
+    int timer_hz;               // 0 = instruction-count sampling
+    volatile int sample_pending;
+    StackSample *samples;
+    int sample_capacity;
+    int sample_count;
+    long total_samples;
+
+    ProfileSymbol *symbols;     // Labels from the assembler's .sym file
+    int symbol_count;
+} Profiler;
+
+Profiler *profiler_create(int code_size, long sample_period);
+void profiler_destroy(Profiler *prof);
+
+// Switch to timer sampling (SIGPROF at hz samples per CPU second).
+// Only one profiler per process can use timer mode.
+int profiler_start_timer(Profiler *prof, int hz);
+void profiler_stop_timer(Profiler *prof);
+
+// Load "addr name" lines written by asm next to the bytecode. Returns the
+// number of symbols read (0 if the file does not exist).
+int profiler_load_symbols(Profiler *prof, const char *path);
+
+// Hooks called by the VM
+void profile_instruction(Profiler *prof, struct VM *vm, int pc, int opcode);
+void profile_alloc(Profiler *prof, struct VM *vm);
+
+void profiler_write_flat(Profiler *prof, FILE *out);
+int profiler_write_collapsed(Profiler *prof, const char *path);
+
+#endif
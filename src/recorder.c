@@ -0,0 +1,166 @@
+#include "recorder.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORDER_MIN_CAPACITY 1024
+
+static size_t slot_of(Recorder *rec, Obj *obj){
+    uintptr_t h = ((uintptr_t)obj >> 4) * 0x9E3779B97F4A7C15ULL;
+    size_t i = (size_t)(h >> 20) & (rec->capacity - 1);
+    while(rec->keys[i] && rec->keys[i] != obj) i = (i + 1) & (rec->capacity - 1);
+    return i;
+}
+
+static void grow_map(Recorder *rec){
+    Obj **old_keys = rec->keys;
+    uint32_t *old_ids = rec->ids;
+    size_t old_capacity = rec->capacity;
+    rec->capacity = old_capacity ? old_capacity * 2 : RECORDER_MIN_CAPACITY;
+    rec->keys = (Obj**)calloc(rec->capacity, sizeof(Obj*));
+    rec->ids = (uint32_t*)malloc(rec->capacity * sizeof(uint32_t));
+    if(!rec->keys || !rec->ids){
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < old_capacity; i++){
+        if(!old_keys[i]) continue;
+        size_t j = slot_of(rec, old_keys[i]);
+        rec->keys[j] = old_keys[i];
+        rec->ids[j] = old_ids[i];
+    }
+    free(old_keys);
+    free(old_ids);
+}
+
+// Scratch pairs and region objects are not on the heap, so never recorded
+static uint32_t id_of(Recorder *rec, Value value){
+    if(value.type != VAL_OBJ || !value.as.obj) return 0;
+    if(value.as.obj->flags & (OBJ_FLAG_LOCAL | OBJ_FLAG_REGION)) return 0;
+    size_t i = slot_of(rec, value.as.obj);
+    return rec->keys[i] ? rec->ids[i] : 0;
+}
+
+static void flush(Recorder *rec){
+    if(rec->used && fwrite(rec->buffer, rec->used, 1, rec->fp) != 1){
+        fclose(rec->fp);
+        rec->fp = NULL;
+    }
+    rec->bytes += rec->used;
+    rec->used = 0;
+}
+
+static void put_byte(Recorder *rec, unsigned char byte){
+    if(rec->used == RECORDER_BUFFER){
+        if(!rec->fp) rec->used = 0;     // Write error: drop, reported on close
+        else flush(rec);
+    }
+    rec->buffer[rec->used++] = byte;
+}
+
+static void put_varint(Recorder *rec, uint32_t value){
+    while(value >= 0x80){
+        put_byte(rec, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    put_byte(rec, (unsigned char)value);
+}
+
+// Reference to id: 0 = no object, else distance back from the next id
+static void put_ref(Recorder *rec, uint32_t id){
+    put_varint(rec, id ? rec->next_id - id : 0);
+}
+
+static void put_tag(Recorder *rec, int tag){
+    put_byte(rec, (unsigned char)tag);
+    rec->events++;
+}
+
+Recorder *recorder_open(const char *path){
+    Recorder *rec = (Recorder*)calloc(1, sizeof(Recorder));
+    if(!rec) return NULL;
+    rec->fp = fopen(path, "wb");
+    if(!rec->fp){
+        free(rec);
+        return NULL;
+    }
+    RecorderHeader header;
+    memcpy(header.magic, RECORDER_MAGIC, sizeof(header.magic));
+    header.version = RECORDER_VERSION;
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, rec->fp);
+    rec->bytes = sizeof(header);
+    rec->next_id = 1;
+    rec->sp = -1;
+    grow_map(rec);
+    return rec;
+}
+
+int recorder_close(Recorder *rec){
+    if(!rec) return 0;
+    put_tag(rec, REC_END);
+    int failed = !rec->fp;
+    if(rec->fp){
+        flush(rec);
+        failed = !rec->fp;
+    }
+    if(rec->fp && fclose(rec->fp) != 0) failed = 1;
+    free(rec->keys);
+    free(rec->ids);
+    free(rec);
+    return failed ? -1 : 0;
+}
+
+void recorder_alloc(Recorder *rec, Obj *obj, size_t size){
+    if((rec->count + 1) * 2 > rec->capacity) grow_map(rec);
+    size_t i = slot_of(rec, obj);
+    if(!rec->keys[i]){
+        rec->keys[i] = obj;
+        rec->count++;
+    }
+    rec->ids[i] = rec->next_id;
+    put_tag(rec, REC_ALLOC);
+    put_byte(rec, (unsigned char)obj->type);
+    put_varint(rec, (uint32_t)size);
+    rec->next_id++;
+}
+
+void recorder_field(Recorder *rec, Obj *obj, int field, Value value){
+    uint32_t id = id_of(rec, make_obj_value(obj));
+    if(!id) return;     // Allocated before recording started
+    put_tag(rec, REC_FIELD);
+    put_ref(rec, id);
+    put_varint(rec, (uint32_t)field);
+    put_ref(rec, id_of(rec, value));
+}
+
+void recorder_memory(Recorder *rec, int slot, Value value){
+    put_tag(rec, REC_MEMORY);
+    put_varint(rec, (uint32_t)slot);
+    put_ref(rec, id_of(rec, value));
+}
+
+void recorder_gc(Recorder *rec){
+    put_tag(rec, REC_GC);
+}
+
+// Instructions only rewrite the slots at or above the lower of the old and
+// new depth (a raise cuts the stack back, then pushes the error code).
+// Slots above the depth keep their last id, as they do in gcsim.
+void recorder_sync_stack(Recorder *rec, Stack *stack){
+    int sp = stack->sp;
+    int low = sp < rec->sp ? sp : rec->sp;
+    if(low < 0) low = 0;
+    for(int i = low; i <= sp; i++){
+        uint32_t id = id_of(rec, stack->data[i]);
+        if(rec->stack[i] == id) continue;
+        rec->stack[i] = id;
+        put_tag(rec, REC_STACK);
+        put_varint(rec, (uint32_t)i);
+        put_ref(rec, id);
+    }
+    if(sp != rec->sp){
+        put_tag(rec, REC_DEPTH);
+        put_varint(rec, (uint32_t)(sp + 1));
+        rec->sp = sp;
+    }
+}
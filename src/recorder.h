@@ -0,0 +1,83 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "object.h"
+#include "stack.h"
+
+// Allocation and mutation recorder (vm->recorder). While vm_run executes,
+// every allocation, pointer store and root change is appended to a compact
+// binary trace, which gcsim replays against other heap policies offline.
+//
+// Trace format: RecorderHeader, then events of one tag byte followed by
+// unsigned LEB128 varints:
+//
+//   REC_ALLOC   type, size            the object gets the next id (from 1)
+//   REC_FIELD   obj, field, target    field = pair/closure slot or vector index
+//   REC_MEMORY  slot, target          memory[slot] stored by STORE
+//   REC_STACK   slot, target          operand stack slot changed
+//   REC_DEPTH   sp + 1                operand stack depth changed
+//   REC_GC                            the VM ran a collection here
+//   REC_END
+//
+// obj and target are references: 0 for a non-object value, otherwise the
+// distance back from the next id (1 = the newest object), so links to
+// recent objects take a byte. Stack roots are compared at each instruction
+// boundary, memory roots and fields recorded at the store. Objects are
+// identified by address, so the heap must not move them (no vm->immix).
+// Scratch pairs and region objects are not recorded, and neither are the
+// heap objects only they hold; vm --record turns off escape rewriting and
+// bypasses regions so that every object is on the heap.
+
+#define RECORDER_MAGIC "GCTRACE1"
+#define RECORDER_VERSION 1
+#define RECORDER_BUFFER 65536
+
+#define REC_END    0
+#define REC_ALLOC  1
+#define REC_FIELD  2
+#define REC_MEMORY 3
+#define REC_STACK  4
+#define REC_DEPTH  5
+#define REC_GC     6
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} RecorderHeader;
+
+typedef struct Recorder {
+    FILE *fp;
+    unsigned char buffer[RECORDER_BUFFER];
+    size_t used;
+    uint32_t next_id;           // Id of the next allocation
+
+    // Address -> id of the object living there (open addressing; a reused
+    // address simply takes the new id)
+    Obj **keys;
+    uint32_t *ids;
+    size_t capacity;            // Always a power of two
+    size_t count;
+
+    uint32_t stack[STACK_SIZE]; // Stack roots as last written
+    int sp;
+
+    long events;
+    long bytes;                 // Written so far, header included
+} Recorder;
+
+// NULL if the file cannot be created
+Recorder *recorder_open(const char *path);
+// Writes REC_END and closes the file; returns 0 if everything was written
+int recorder_close(Recorder *rec);
+
+void recorder_alloc(Recorder *rec, Obj *obj, size_t size);
+void recorder_field(Recorder *rec, Obj *obj, int field, Value value);
+void recorder_memory(Recorder *rec, int slot, Value value);
+void recorder_gc(Recorder *rec);
+// Records the stack slots changed since the last call (once per instruction)
+void recorder_sync_stack(Recorder *rec, Stack *stack);
+
+#endif
@@ -0,0 +1,288 @@
+#include "region.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGION_ALIGN 8
+
+static size_t aligned_size(size_t size){
+    return (size + REGION_ALIGN - 1) & ~(size_t)(REGION_ALIGN - 1);
+}
+
+void region_init(Region *region){
+    memset(region, 0, sizeof(Region));
+}
+
+void region_destroy(Region *region){
+    RegionChunk *chunk = region->chunks;
+    while(chunk){
+        RegionChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    region->chunks = NULL;
+}
+
+void region_begin(VM *vm){
+    vm->region.depth++;
+}
+
+// Frees every chunk but one of the standard size, which the next region
+// starts in
+static void region_release(Region *region){
+    RegionChunk *kept = NULL;
+    RegionChunk *chunk = region->chunks;
+    while(chunk){
+        RegionChunk *next = chunk->next;
+        if(!kept && chunk->size == REGION_CHUNK_BYTES){
+            kept = chunk;
+            kept->next = NULL;
+            kept->used = 0;
+        }
+        else free(chunk);
+        chunk = next;
+    }
+    region->chunks = kept;
+    if(region->bytes > region->peak_bytes) region->peak_bytes = region->bytes;
+    region->bytes = 0;
+    region->regions++;
+}
+
+int region_end(VM *vm){
+    Region *region = &vm->region;
+    if(region->depth > 1){
+        region->depth--;
+        return 0;
+    }
+    for(int i = 0; i <= vm->stack.sp; i++){
+        Value *slot = &vm->stack.data[i];
+        if(slot->type == VAL_OBJ && (slot->as.obj->flags & OBJ_FLAG_LOCAL)){
+            if(region_barrier(vm, &slot->as.obj->as.pair.left) != 0 ||
+               region_barrier(vm, &slot->as.obj->as.pair.right) != 0) return -1;
+        }
+        else if(region_barrier(vm, slot) != 0) return -1;
+    }
+    region_release(region);
+    region->depth = 0;
+    return 0;
+}
+
+Obj *region_alloc(Region *region, ObjType type, size_t size){
+    size = aligned_size(size);
+    RegionChunk *chunk = region->chunks;
+    if(!chunk || chunk->size - chunk->used < size){
+        size_t chunk_size = size > REGION_CHUNK_BYTES ? size : REGION_CHUNK_BYTES;
+        chunk = (RegionChunk*)malloc(sizeof(RegionChunk) + chunk_size);
+        if(!chunk) return NULL;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        chunk->next = region->chunks;
+        region->chunks = chunk;
+    }
+    Obj *obj = (Obj*)(chunk->data + chunk->used);
+    chunk->used += size;
+    region->bytes += size;
+    region->allocated++;
+
+    obj->type = type;
+    obj->marked = 0;
+    obj->site = SITE_NONE;
+    obj->flags = OBJ_FLAG_REGION;
+    obj->next = NULL;
+    return obj;
+}
+
+void region_for_each(Region *region, void (*visit)(Obj *obj, void *arg), void *arg){
+    for(RegionChunk *chunk = region->chunks; chunk; chunk = chunk->next){
+        size_t offset = 0;
+        while(offset < chunk->used){
+            Obj *obj = (Obj*)(chunk->data + offset);
+            offset += aligned_size(object_size(obj));
+            visit(obj, arg);
+        }
+    }
+}
+
+// The heap copy of a promoted region object, else obj itself
+static Obj *forwarded(Obj *obj){
+    const int promoted = OBJ_FLAG_REGION | OBJ_FLAG_FORWARDED;
+    return obj && (obj->flags & promoted) == promoted ? obj->next : obj;
+}
+
+static void forward_value(Value *value){
+    if(value->type == VAL_OBJ) value->as.obj = forwarded(value->as.obj);
+}
+
+static void forward_fields(Obj *obj, void *arg){
+    (void)arg;
+    switch(obj->type){
+        case OBJ_PAIR:
+            forward_value(&obj->as.pair.left);
+            forward_value(&obj->as.pair.right);
+            break;
+        case OBJ_CLOSURE:
+            obj->as.closure.function = forwarded(obj->as.closure.function);
+            obj->as.closure.env = forwarded(obj->as.closure.env);
+            break;
+        case OBJ_VECTOR:
+            for(int i = 0; i < obj->as.vector.length; i++){
+                forward_value(&obj->as.vector.items[i]);
+            }
+            break;
+        case OBJ_TABLE:
+            obj->as.table.entries = forwarded(obj->as.table.entries);
+            obj->as.table.old = forwarded(obj->as.table.old);
+            break;
+        default:
+            break;
+    }
+}
+
+// Region objects reachable from the one being promoted; Obj.marked
+// (otherwise unused in a region) says an object is already listed
+typedef struct {
+    Obj **objects;
+    int count;
+    int capacity;
+} Promotion;
+
+static void promotion_add(Promotion *p, Obj *obj){
+    if(!obj || (obj->flags & (OBJ_FLAG_REGION | OBJ_FLAG_FORWARDED)) != OBJ_FLAG_REGION) return;
+    if(obj->marked) return;
+    if(p->count == p->capacity){
+        int capacity = p->capacity ? p->capacity * 2 : 64;
+        Obj **grown = (Obj**)realloc(p->objects, capacity * sizeof(Obj*));
+        if(!grown){
+            printf("Out of memory\n");
+            exit(1);
+        }
+        p->objects = grown;
+        p->capacity = capacity;
+    }
+    obj->marked = 1;
+    p->objects[p->count++] = obj;
+}
+
+static void promotion_add_value(Promotion *p, Value value){
+    if(value.type == VAL_OBJ) promotion_add(p, value.as.obj);
+}
+
+// A heap object of the same type and size, fields not yet filled in
+static Obj *new_copy(VM *vm, Obj *obj){
+    switch(obj->type){
+        case OBJ_PAIR: return new_pair(vm, make_int_value(0), make_int_value(0));
+        case OBJ_FUNCTION: return new_function(vm, obj->as.function.address, obj->as.function.arity);
+        case OBJ_CLOSURE: return new_closure(vm, NULL, NULL);
+        case OBJ_VECTOR: return new_vector(vm, obj->as.vector.length);
+        case OBJ_BYTES: return new_bytes(vm, obj->as.bytes.length);
+        case OBJ_TABLE: return new_table(vm);
+        default: return NULL;   // Weak refs and ephemerons never live in a region
+    }
+}
+
+static void set_field(VM *vm, Obj *copy, int field, Value *slot, Value value){
+    *slot = value;
+    gc_write_barrier(vm, copy, value);
+    if(vm->recorder && value.type == VAL_OBJ) recorder_field(vm->recorder, copy, field, value);
+}
+
+// Copies the fields of a promoted object, pointing them at heap copies
+static void fill_copy(VM *vm, Obj *obj){
+    Obj *copy = obj->next;
+    switch(obj->type){
+        case OBJ_PAIR:
+            forward_fields(obj, NULL);
+            set_field(vm, copy, 0, &copy->as.pair.left, obj->as.pair.left);
+            set_field(vm, copy, 1, &copy->as.pair.right, obj->as.pair.right);
+            break;
+        case OBJ_CLOSURE:
+            forward_fields(obj, NULL);
+            copy->as.closure.function = obj->as.closure.function;
+            copy->as.closure.env = obj->as.closure.env;
+            if(copy->as.closure.function) gc_write_barrier(vm, copy, make_obj_value(copy->as.closure.function));
+            if(copy->as.closure.env) gc_write_barrier(vm, copy, make_obj_value(copy->as.closure.env));
+            break;
+        case OBJ_VECTOR:
+            forward_fields(obj, NULL);
+            for(int i = 0; i < obj->as.vector.length; i++){
+                set_field(vm, copy, i, &copy->as.vector.items[i], obj->as.vector.items[i]);
+            }
+            break;
+        case OBJ_BYTES:
+            memcpy(copy->as.bytes.data, obj->as.bytes.data, obj->as.bytes.length);
+            break;
+        case OBJ_TABLE:
+            forward_fields(obj, NULL);
+            copy->as.table = obj->as.table;
+            if(copy->as.table.entries) gc_write_barrier(vm, copy, make_obj_value(copy->as.table.entries));
+            if(copy->as.table.old) gc_write_barrier(vm, copy, make_obj_value(copy->as.table.old));
+            break;
+        default:
+            break;
+    }
+}
+
+int region_promote(VM *vm, Value *value){
+    Region *region = &vm->region;
+    Promotion p = {NULL, 0, 0};
+    promotion_add_value(&p, *value);
+    for(int i = 0; i < p.count; i++){
+        Obj *obj = p.objects[i];
+        switch(obj->type){
+            case OBJ_PAIR:
+                promotion_add_value(&p, obj->as.pair.left);
+                promotion_add_value(&p, obj->as.pair.right);
+                break;
+            case OBJ_CLOSURE:
+                promotion_add(&p, obj->as.closure.function);
+                promotion_add(&p, obj->as.closure.env);
+                break;
+            case OBJ_VECTOR:
+                for(int j = 0; j < obj->as.vector.length; j++){
+                    promotion_add_value(&p, obj->as.vector.items[j]);
+                }
+                break;
+            case OBJ_TABLE:
+                promotion_add(&p, obj->as.table.entries);
+                promotion_add(&p, obj->as.table.old);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // All copies first: an emergency GC in between finds them through
+    // Obj.next of the originals, and their fields do not point anywhere yet
+    region->bypass++;
+    int copied = 0;
+    for(; copied < p.count; copied++){
+        Obj *copy = new_copy(vm, p.objects[copied]);
+        if(!copy) break;
+        p.objects[copied]->flags |= OBJ_FLAG_FORWARDED;
+        p.objects[copied]->next = copy;
+    }
+    region->bypass--;
+    for(int i = 0; i < p.count; i++) p.objects[i]->marked = 0;
+    if(copied < p.count){
+        // The copies made so far are garbage
+        for(int i = 0; i < copied; i++){
+            p.objects[i]->flags &= ~OBJ_FLAG_FORWARDED;
+            p.objects[i]->next = NULL;
+        }
+        free(p.objects);
+        return -1;
+    }
+    for(int i = 0; i < p.count; i++) fill_copy(vm, p.objects[i]);
+
+    // Everything that may point into the region now points at the copies
+    for(int i = 0; i <= vm->stack.sp; i++) forward_value(&vm->stack.data[i]);
+    if(vm->scratch){
+        for(int i = 0; i < vm->local_pairs->sites; i++) forward_fields(&vm->scratch[i], NULL);
+    }
+    region_for_each(region, forward_fields, NULL);
+    forward_value(value);
+    region->promoted += p.count;
+    free(p.objects);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+#include "object.h"
+
+// Allocation regions for request-scoped work (REGION_BEGIN / REGION_END).
+//
+// While a region is open, objects are bump-allocated from malloc'd chunks
+// instead of the GC heap, and the outermost REGION_END frees them all at
+// once: nothing is marked, swept or freed one by one. A REGION_BEGIN inside
+// an open region joins it. Weak refs and ephemerons still go to the heap,
+// since the collector must find them to clear them.
+//
+// Only the operand stack, scratch pairs and other region objects may point
+// at a region object. Storing one anywhere else (STORE, SET_LEFT/SET_RIGHT
+// or ARRAY_SET into a heap object, NEW_WEAK, NEW_EPHEMERON) goes through
+// region_barrier(), which promotes it: the object and every region object
+// it reaches are copied to the heap, and the stack, scratch pairs and
+// region are rewritten to point at the copies. REGION_END promotes what is
+// still on the stack the same way, so results outlive the region.
+//
+// A collection while a region is open scans the fields of every region
+// object as roots, without marking the region objects themselves. The old
+// copy of a promoted object stays in the region with OBJ_FLAG_FORWARDED
+// and Obj.next set to the heap copy, which it keeps alive until REGION_END.
+
+#define REGION_CHUNK_BYTES 65536    // Bump chunk size; bigger objects get their own
+
+typedef struct RegionChunk {
+    struct RegionChunk *next;
+    size_t used;
+    size_t size;            // Bytes in data[]
+    unsigned char data[];
+} RegionChunk;
+
+typedef struct Region {
+    int depth;              // Open REGION_BEGINs; 0 = no region
+    int bypass;             // Allocations go to the heap (promotion, CONS_SHARED)
+    RegionChunk *chunks;    // Newest first; one is kept for the next region
+    long bytes;             // Allocated in the open region
+    // Totals over the VM's lifetime
+    long regions;           // Regions released
+    long allocated;         // Objects allocated in regions
+    long promoted;          // Objects copied to the heap
+    long peak_bytes;        // Largest region released
+} Region;
+
+struct VM;
+
+void region_init(Region *region);
+void region_destroy(Region *region);
+void region_begin(struct VM *vm);
+
+// Leaves one level of region. The outermost level promotes the region
+// objects on the stack and frees the rest. Returns -1, with the region left
+// open, if the heap has no room for the promoted objects.
+int region_end(struct VM *vm);
+
+// NULL when out of memory
+Obj *region_alloc(Region *region, ObjType type, size_t size);
+
+// Copies *value (a region object) and the region objects it reaches to the
+// heap and rewrites every reference to them. Returns -1 if the heap limit
+// was hit; nothing has changed then.
+int region_promote(struct VM *vm, Value *value);
+
+// Calls visit on every object of the open region
+void region_for_each(Region *region, void (*visit)(Obj *obj, void *arg), void *arg);
+
+// Store barrier for a value about to go where region objects may not
+static inline int region_barrier(struct VM *vm, Value *value){
+    if(value->type != VAL_OBJ || !(value->as.obj->flags & OBJ_FLAG_REGION)) return 0;
+    return region_promote(vm, value);
+}
+
+#endif
@@ -0,0 +1,324 @@
+#include "snapshot.h"
+#include "vm.h"
+#include "heap.h"
+#include "immix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Obj* -> id map, open addressing on the pointer bits
+typedef struct {
+    Obj **keys;
+    uint32_t *ids;
+    size_t mask;
+} IdMap;
+
+static size_t hash_ptr(Obj *obj){
+    uintptr_t p = (uintptr_t)obj;
+    p ^= p >> 17;
+    p *= 0xed5ad4bbu;
+    p ^= p >> 11;
+    return (size_t)p;
+}
+
+static int idmap_init(IdMap *map, int count){
+    size_t cap = 16;
+    while(cap < (size_t)count * 2) cap <<= 1;
+    map->keys = (Obj**)calloc(cap, sizeof(Obj*));
+    map->ids = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    map->mask = cap - 1;
+    return (map->keys && map->ids) ? 0 : -1;
+}
+
+static void idmap_put(IdMap *map, Obj *obj, uint32_t id){
+    size_t i = hash_ptr(obj) & map->mask;
+    while(map->keys[i]) i = (i + 1) & map->mask;
+    map->keys[i] = obj;
+    map->ids[i] = id;
+}
+
+static uint32_t idmap_get(IdMap *map, Obj *obj){
+    size_t i = hash_ptr(obj) & map->mask;
+    while(map->keys[i]){
+        if(map->keys[i] == obj) return map->ids[i];
+        i = (i + 1) & map->mask;
+    }
+    return UINT32_MAX;
+}
+
+static void add_edge(IdMap *map, Obj *target, uint32_t *edges, uint32_t *count){
+    if(!target) return;
+    uint32_t id = idmap_get(map, target);
+    if(id != UINT32_MAX) edges[(*count)++] = id;
+}
+
+// A root, and the id of its target once the objects are numbered
+typedef struct {
+    uint8_t kind;
+    uint32_t slot;
+    Obj *target;
+    uint32_t id;
+} Root;
+
+// What the snapshot holds, gathered before anything is written
+typedef struct {
+    Obj **objects;          // In id order
+    uint32_t count;
+    uint32_t capacity;
+    Root *roots;
+    uint32_t root_count;
+    uint32_t root_capacity;
+    uint32_t region_slot;
+    int failed;             // Out of memory
+} Dump;
+
+static void add_object(Obj *obj, void *arg){
+    Dump *d = (Dump*)arg;
+    if(d->count == d->capacity){
+        uint32_t capacity = d->capacity ? d->capacity * 2 : 1024;
+        Obj **objects = (Obj**)realloc(d->objects, capacity * sizeof(Obj*));
+        if(!objects){
+            d->failed = 1;
+            return;
+        }
+        d->objects = objects;
+        d->capacity = capacity;
+    }
+    d->objects[d->count++] = obj;
+}
+
+static void add_root(Dump *d, uint8_t kind, uint32_t slot, Obj *target){
+    if(!target || (target->flags & OBJ_FLAG_REGION)) return;
+    if(d->root_count == d->root_capacity){
+        uint32_t capacity = d->root_capacity ? d->root_capacity * 2 : 256;
+        Root *roots = (Root*)realloc(d->roots, capacity * sizeof(Root));
+        if(!roots){
+            d->failed = 1;
+            return;
+        }
+        d->roots = roots;
+        d->root_capacity = capacity;
+    }
+    Root *root = &d->roots[d->root_count++];
+    root->kind = kind;
+    root->slot = slot;
+    root->target = target;
+}
+
+// Like mark_root (gc.c): a scratch pair stands for its fields, and region
+// objects are reported through the region
+static void add_value_root(Dump *d, uint8_t kind, uint32_t slot, Value value){
+    if(value.type != VAL_OBJ || !value.as.obj) return;
+    Obj *obj = value.as.obj;
+    if(obj->flags & OBJ_FLAG_LOCAL){
+        add_value_root(d, kind, slot, obj->as.pair.left);
+        add_value_root(d, kind, slot, obj->as.pair.right);
+    }
+    else add_root(d, kind, slot, obj);
+}
+
+// The heap objects a region object holds, as the collector marks them
+static void add_region_roots(Obj *obj, void *arg){
+    Dump *d = (Dump*)arg;
+    uint32_t slot = d->region_slot++;
+    if(obj->flags & OBJ_FLAG_FORWARDED) add_root(d, SNAPSHOT_ROOT_REGION, slot, obj->next);
+    switch(obj->type){
+        case OBJ_PAIR:
+            add_value_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.pair.left);
+            add_value_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.pair.right);
+            break;
+        case OBJ_CLOSURE:
+            add_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.closure.function);
+            add_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.closure.env);
+            break;
+        case OBJ_VECTOR:
+            for(int i = 0; i < obj->as.vector.length; i++){
+                add_value_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.vector.items[i]);
+            }
+            break;
+        case OBJ_TABLE:
+            add_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.table.entries);
+            add_root(d, SNAPSHOT_ROOT_REGION, slot, obj->as.table.old);
+            break;
+        default:
+            break;
+    }
+}
+
+// The roots the collector marks from for vm
+static void gather_roots(VM *vm, Dump *d){
+    for(int i=0;i<=vm->stack.sp;i++){
+        add_value_root(d, SNAPSHOT_ROOT_STACK, (uint32_t)i, vm->stack.data[i]);
+    }
+    for(int i=0;i<MEM_SIZE;i++){
+        if(vm->valid[i]) add_value_root(d, SNAPSHOT_ROOT_MEMORY, (uint32_t)i, vm->memory[i]);
+    }
+    for(int i = vm->finalize_head; i < vm->finalize_queue.count; i++){
+        add_root(d, SNAPSHOT_ROOT_FINALIZE, (uint32_t)i, vm->finalize_queue.entries[i].obj);
+    }
+    if(vm->region.depth > 0) region_for_each(&vm->region, add_region_roots, d);
+    if(vm->constants){
+        for(int i = 0; i < vm->constant_pool->count; i++){
+            add_root(d, SNAPSHOT_ROOT_CONSTANT, (uint32_t)i, vm->constants[i]);
+        }
+    }
+}
+
+// Every object, then every root the collector would mark from
+static void gather(VM *vm, Dump *d){
+    // Small (young, then mature) objects first, then the large-object space
+    Obj *lists[3] = {vm->heap_head, vm->mature_head, vm->large_head};
+    for(int l = 0; l < 3; l++){
+        for(Obj *obj = lists[l]; obj; obj = obj->next) add_object(obj, d);
+    }
+    if(vm->immix) immix_for_each(vm->immix, add_object, d);
+    if(vm->shared){
+        // Every attached VM's roots, as for a shared collection
+        heap_for_each(vm->shared, add_object, d);
+        for(int i = 0; i < vm->shared->mutator_count; i++) gather_roots(vm->shared->mutators[i], d);
+    }
+    else gather_roots(vm, d);
+}
+
+static void dump_free(Dump *d){
+    free(d->objects);
+    free(d->roots);
+}
+
+int heap_snapshot_write(VM *vm, const char *path){
+    Dump dump;
+    memset(&dump, 0, sizeof(dump));
+    // Keeps other VMs from refilling TLABs or collecting meanwhile
+    if(vm->shared) pthread_mutex_lock(&vm->shared->lock);
+    gather(vm, &dump);
+    if(vm->shared) pthread_mutex_unlock(&vm->shared->lock);
+    if(dump.failed){
+        dump_free(&dump);
+        return -1;
+    }
+    IdMap map;
+    if(idmap_init(&map, (int)dump.count) != 0){
+        free(map.keys);
+        free(map.ids);
+        dump_free(&dump);
+        return -1;
+    }
+    for(uint32_t id = 0; id < dump.count; id++) idmap_put(&map, dump.objects[id], id);
+
+    FILE *fp = fopen(path, "wb");
+    if(!fp){
+        perror("failed to open snapshot file");
+        free(map.keys);
+        free(map.ids);
+        dump_free(&dump);
+        return -1;
+    }
+
+    // A root outside the dumped objects would point nowhere
+    uint32_t roots = 0;
+    for(uint32_t i = 0; i < dump.root_count; i++){
+        dump.roots[i].id = idmap_get(&map, dump.roots[i].target);
+        if(dump.roots[i].id != UINT32_MAX) dump.roots[roots++] = dump.roots[i];
+    }
+    dump.root_count = roots;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.object_count = dump.count;
+    header.root_count = dump.root_count;
+    fwrite(&header, sizeof(header), 1, fp);
+
+    uint32_t *edges = NULL;
+    uint32_t edge_capacity = 0;
+    for(uint32_t id = 0; id < dump.count; id++){
+        Obj *obj = dump.objects[id];
+        uint8_t type = (uint8_t)obj->type;
+        int32_t site = obj->site;
+        uint32_t size = (uint32_t)object_size(obj);
+        uint32_t edge_count = 0;
+
+        // Vectors can have any number of out-edges
+        uint32_t needed = obj->type == OBJ_VECTOR ? (uint32_t)obj->as.vector.length : 2;
+        if(needed > edge_capacity){
+            uint32_t *grown = (uint32_t*)realloc(edges, needed * sizeof(uint32_t));
+            if(!grown){
+                free(edges);
+                free(map.keys);
+                free(map.ids);
+                dump_free(&dump);
+                fclose(fp);
+                return -1;
+            }
+            edges = grown;
+            edge_capacity = needed;
+        }
+
+        switch(obj->type){
+            case OBJ_PAIR:
+                if(obj->as.pair.left.type == VAL_OBJ)
+                    add_edge(&map, obj->as.pair.left.as.obj, edges, &edge_count);
+                if(obj->as.pair.right.type == VAL_OBJ)
+                    add_edge(&map, obj->as.pair.right.as.obj, edges, &edge_count);
+                break;
+            case OBJ_FUNCTION:
+                break;
+            case OBJ_CLOSURE:
+                add_edge(&map, obj->as.closure.function, edges, &edge_count);
+                add_edge(&map, obj->as.closure.env, edges, &edge_count);
+                break;
+            case OBJ_WEAK:
+                // Weak edges retain nothing
+                break;
+            case OBJ_EPHEMERON:
+                if(obj->as.ephemeron.value.type == VAL_OBJ)
+                    add_edge(&map, obj->as.ephemeron.value.as.obj, edges, &edge_count);
+                break;
+            case OBJ_VECTOR:
+                for(int i = 0; i < obj->as.vector.length; i++){
+                    if(obj->as.vector.items[i].type == VAL_OBJ)
+                        add_edge(&map, obj->as.vector.items[i].as.obj, edges, &edge_count);
+                }
+                break;
+            case OBJ_BYTES:
+                break;
+            case OBJ_TABLE:
+                add_edge(&map, obj->as.table.entries, edges, &edge_count);
+                add_edge(&map, obj->as.table.old, edges, &edge_count);
+                break;
+            case OBJ_STRING:
+                break;
+        }
+
+        fwrite(&type, sizeof(type), 1, fp);
+        fwrite(&site, sizeof(site), 1, fp);
+        fwrite(&size, sizeof(size), 1, fp);
+        fwrite(&edge_count, sizeof(edge_count), 1, fp);
+        fwrite(edges, sizeof(uint32_t), edge_count, fp);
+    }
+
+    for(uint32_t i = 0; i < dump.root_count; i++){
+        Root *root = &dump.roots[i];
+        fwrite(&root->kind, sizeof(root->kind), 1, fp);
+        fwrite(&root->slot, sizeof(root->slot), 1, fp);
+        fwrite(&root->id, sizeof(root->id), 1, fp);
+    }
+
+    free(edges);
+    free(map.keys);
+    free(map.ids);
+    dump_free(&dump);
+    int failed = ferror(fp);
+    fclose(fp);
+    return failed ? -1 : 0;
+}
+
+int heap_snapshot_next(VM *vm){
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.%d.snap",
+             vm->snapshot_prefix ? vm->snapshot_prefix : "heap", vm->snapshot_seq++);
+    int result = heap_snapshot_write(vm, path);
+    if(result == 0) printf("Heap snapshot written to %s\n", path);
+    return result;
+}
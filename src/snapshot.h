@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+// Binary heap snapshot format (native byte order):
+//
+//   SnapshotHeader
+//   object_count x { uint8 type, int32 site, uint32 size, uint32 edge_count,
+//                    edge_count x uint32 target id }
+//   root_count   x { uint8 kind, uint32 slot, uint32 target id }
+//
+// Object ids are positions in the heap lists at the time of the dump, then
+// in the Immix blocks, or the shared heap's pages and large-object space. Every edge and root id
+// is below object_count. A shared heap's snapshot has the roots of every
+// attached VM.
+
+#define SNAPSHOT_MAGIC "GCSNAP01"
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_ROOT_STACK    0
+#define SNAPSHOT_ROOT_MEMORY   1
+#define SNAPSHOT_ROOT_FINALIZE 2    // Slot: finalization queue entry
+#define SNAPSHOT_ROOT_REGION   3    // Slot: region object, in region_for_each order
+#define SNAPSHOT_ROOT_CONSTANT 4    // Slot: CONST operand
+
+// Scratch pairs and region objects are not heap objects: the heap objects
+// their fields hold are roots instead, as the collector treats them.
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t object_count;
+    uint32_t root_count;
+    uint32_t reserved;
+} SnapshotHeader;
+
+struct VM;
+
+// Write the complete object graph and root set. Returns 0 on success.
+int heap_snapshot_write(struct VM *vm, const char *path);
+
+// Write to "<vm->snapshot_prefix>.<n>.snap" with an increasing n
+int heap_snapshot_next(struct VM *vm);
+
+// A snapshot read back (snapshot_read.c, no VM needed)
+typedef struct {
+    uint32_t n;             // Objects; node n is the virtual root
+    uint8_t *type;
+    int32_t *site;
+    uint32_t *size;
+    uint32_t *edge_start;   // CSR adjacency over n + 1 nodes
+    uint32_t *edges;        // The roots are the edges of node n
+    uint32_t root_count;
+} SnapshotGraph;
+
+// Returns 0 on success, -1 with a message on stderr when the file cannot
+// be read or is not a valid snapshot (bad magic, truncated, ids out of range)
+int snapshot_load(const char *path, SnapshotGraph *graph);
+void snapshot_graph_free(SnapshotGraph *graph);
+
+#endif
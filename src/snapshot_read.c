@@ -0,0 +1,95 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int read_exact(FILE *fp, void *buf, size_t size){
+    return size == 0 || fread(buf, size, 1, fp) == 1;
+}
+
+static int grow_edges(SnapshotGraph *graph, size_t *cap, size_t needed){
+    if(needed <= *cap) return 0;
+    size_t grown = *cap;
+    while(grown < needed) grown *= 2;
+    uint32_t *edges = (uint32_t*)realloc(graph->edges, grown * sizeof(uint32_t));
+    if(!edges) return -1;
+    graph->edges = edges;
+    *cap = grown;
+    return 0;
+}
+
+// Reads the objects and roots; returns the error message, or NULL
+static const char *read_graph(FILE *fp, SnapshotGraph *graph){
+    SnapshotHeader h;
+    if(!read_exact(fp, &h, sizeof(h))) return "Truncated snapshot";
+    if(memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAPSHOT_VERSION)
+        return "Not a heap snapshot (bad magic or version)";
+
+    uint32_t n = h.object_count;
+    graph->n = n;
+    graph->root_count = h.root_count;
+    graph->type = (uint8_t*)calloc(n ? n : 1, sizeof(uint8_t));
+    graph->site = (int32_t*)calloc(n ? n : 1, sizeof(int32_t));
+    graph->size = (uint32_t*)calloc(n ? n : 1, sizeof(uint32_t));
+    graph->edge_start = (uint32_t*)calloc((size_t)n + 2, sizeof(uint32_t));
+    size_t cap = 1024, used = 0;
+    graph->edges = (uint32_t*)calloc(cap, sizeof(uint32_t));
+    if(!graph->type || !graph->site || !graph->size || !graph->edge_start || !graph->edges)
+        return "Out of memory";
+
+    for(uint32_t i = 0; i < n; i++){
+        uint32_t edge_count;
+        if(!read_exact(fp, &graph->type[i], sizeof(uint8_t)) ||
+           !read_exact(fp, &graph->site[i], sizeof(int32_t)) ||
+           !read_exact(fp, &graph->size[i], sizeof(uint32_t)) ||
+           !read_exact(fp, &edge_count, sizeof(uint32_t))) return "Truncated snapshot";
+        graph->edge_start[i] = (uint32_t)used;
+        if(grow_edges(graph, &cap, used + edge_count) != 0) return "Out of memory";
+        if(!read_exact(fp, &graph->edges[used], edge_count * sizeof(uint32_t)))
+            return "Truncated snapshot";
+        for(uint32_t e = 0; e < edge_count; e++){
+            if(graph->edges[used + e] >= n) return "Corrupt snapshot: edge to a missing object";
+        }
+        used += edge_count;
+    }
+
+    // Roots become the out-edges of the virtual root node
+    graph->edge_start[n] = (uint32_t)used;
+    for(uint32_t i = 0; i < h.root_count; i++){
+        uint8_t kind;
+        uint32_t slot, id;
+        if(!read_exact(fp, &kind, sizeof(kind)) || !read_exact(fp, &slot, sizeof(slot)) ||
+           !read_exact(fp, &id, sizeof(id))) return "Truncated snapshot";
+        if(id >= n) return "Corrupt snapshot: root of a missing object";
+        if(grow_edges(graph, &cap, used + 1) != 0) return "Out of memory";
+        graph->edges[used++] = id;
+    }
+    graph->edge_start[n + 1] = (uint32_t)used;
+    return NULL;
+}
+
+int snapshot_load(const char *path, SnapshotGraph *graph){
+    memset(graph, 0, sizeof(SnapshotGraph));
+    FILE *fp = fopen(path, "rb");
+    if(!fp){
+        perror(path);
+        return -1;
+    }
+    const char *error = read_graph(fp, graph);
+    fclose(fp);
+    if(error){
+        fprintf(stderr, "%s: %s\n", path, error);
+        snapshot_graph_free(graph);
+        return -1;
+    }
+    return 0;
+}
+
+void snapshot_graph_free(SnapshotGraph *graph){
+    free(graph->type);
+    free(graph->site);
+    free(graph->size);
+    free(graph->edge_start);
+    free(graph->edges);
+    memset(graph, 0, sizeof(SnapshotGraph));
+}
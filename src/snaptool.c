@@ -0,0 +1,290 @@
+/* Offline analyzer for heap snapshots written by the VM (see snapshot.h).
+ *
+ *   snaptool summary heap.0.snap         types, sites, largest retainers
+ *   snaptool diff heap.0.snap heap.1.snap  growth per type and site
+ *
+ * Retained sizes come from the dominator tree of the object graph, rooted
+ * at a virtual node that points to every root. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snapshot.h"
+
+#define TYPE_NAMES 9
+static const char *type_names[TYPE_NAMES] = {"pair", "function", "closure", "weak", "ephemeron", "vector", "bytes", "table", "string"};
+
+typedef struct {
+    int type;
+    int32_t site;
+    long count;
+    long bytes;
+    long count_b;           // Second snapshot (diff only)
+    long bytes_b;
+} Group;
+
+static void die(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n ? n : 1, size);
+    if (!p) die("Out of memory");
+    return p;
+}
+
+static void load_snapshot(const char *path, SnapshotGraph *s) {
+    if (snapshot_load(path, s) != 0) exit(1);
+}
+
+/* Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm".
+   Fills idom (UINT32_MAX for unreachable nodes) and returns the number of
+   reachable nodes; order[] receives them in reverse postorder. */
+static uint32_t dominators(SnapshotGraph *s, uint32_t *idom, uint32_t *order) {
+    uint32_t nodes = s->n + 1, root = s->n;
+    uint32_t *post = xcalloc(nodes, sizeof(uint32_t));     /* postorder number + 1 */
+    uint32_t *stack = xcalloc(nodes, sizeof(uint32_t));
+    uint32_t *cursor = xcalloc(nodes, sizeof(uint32_t));
+    uint32_t *postorder = xcalloc(nodes, sizeof(uint32_t));
+    uint8_t *seen = xcalloc(nodes, 1);
+
+    /* Iterative DFS for the postorder */
+    uint32_t sp = 0, reached = 0;
+    stack[sp++] = root;
+    seen[root] = 1;
+    cursor[root] = s->edge_start[root];
+    while (sp) {
+        uint32_t v = stack[sp - 1];
+        if (cursor[v] < s->edge_start[v + 1]) {
+            uint32_t w = s->edges[cursor[v]++];
+            if (!seen[w]) {
+                seen[w] = 1;
+                cursor[w] = s->edge_start[w];
+                stack[sp++] = w;
+            }
+        } else {
+            postorder[reached] = v;
+            post[v] = ++reached;
+            sp--;
+        }
+    }
+    for (uint32_t i = 0; i < reached; i++) order[i] = postorder[reached - 1 - i];
+
+    /* Predecessor lists (reachable nodes only) */
+    uint32_t *pred_start = xcalloc(nodes + 1, sizeof(uint32_t));
+    for (uint32_t v = 0; v < nodes; v++) {
+        if (!seen[v]) continue;
+        for (uint32_t e = s->edge_start[v]; e < s->edge_start[v + 1]; e++) pred_start[s->edges[e] + 1]++;
+    }
+    for (uint32_t v = 0; v < nodes; v++) pred_start[v + 1] += pred_start[v];
+    uint32_t *preds = xcalloc(pred_start[nodes], sizeof(uint32_t));
+    uint32_t *fill = xcalloc(nodes, sizeof(uint32_t));
+    for (uint32_t v = 0; v < nodes; v++) {
+        if (!seen[v]) continue;
+        for (uint32_t e = s->edge_start[v]; e < s->edge_start[v + 1]; e++) {
+            uint32_t w = s->edges[e];
+            preds[pred_start[w] + fill[w]++] = v;
+        }
+    }
+
+    for (uint32_t v = 0; v < nodes; v++) idom[v] = UINT32_MAX;
+    idom[root] = root;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint32_t i = 1; i < reached; i++) {
+            uint32_t b = order[i];
+            uint32_t new_idom = UINT32_MAX;
+            for (uint32_t p = pred_start[b]; p < pred_start[b + 1]; p++) {
+                uint32_t q = preds[p];
+                if (idom[q] == UINT32_MAX) continue;
+                if (new_idom == UINT32_MAX) {
+                    new_idom = q;
+                    continue;
+                }
+                uint32_t f1 = q, f2 = new_idom;
+                while (f1 != f2) {
+                    while (post[f1] < post[f2]) f1 = idom[f1];
+                    while (post[f2] < post[f1]) f2 = idom[f2];
+                }
+                new_idom = f1;
+            }
+            if (idom[b] != new_idom) {
+                idom[b] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+
+    free(post);
+    free(stack);
+    free(cursor);
+    free(postorder);
+    free(seen);
+    free(pred_start);
+    free(preds);
+    free(fill);
+    return reached;
+}
+
+static const char *type_name(int type) {
+    return (type >= 0 && type < TYPE_NAMES) ? type_names[type] : "?";
+}
+
+static void site_name(int32_t site, char *out, size_t size) {
+    if (site == -1) snprintf(out, size, "-");
+    else if (site == -2) snprintf(out, size, "native");
+    else snprintf(out, size, "pc %d", site);
+}
+
+static Group *find_group(Group **groups, int *count, int *cap, int type, int32_t site) {
+    for (int i = 0; i < *count; i++) {
+        if ((*groups)[i].type == type && (*groups)[i].site == site) return &(*groups)[i];
+    }
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 32;
+        *groups = realloc(*groups, sizeof(Group) * (size_t)*cap);
+        if (!*groups) die("Out of memory");
+    }
+    Group *g = &(*groups)[(*count)++];
+    memset(g, 0, sizeof(*g));
+    g->type = type;
+    g->site = site;
+    return g;
+}
+
+static int by_bytes_desc(const void *a, const void *b) {
+    const Group *x = a, *y = b;
+    long dx = x->bytes_b - x->bytes, dy = y->bytes_b - y->bytes;
+    if (labs(dx) != labs(dy)) return labs(dx) < labs(dy) ? 1 : -1;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static void summary(const char *path) {
+    SnapshotGraph s;
+    load_snapshot(path, &s);
+
+    uint32_t *idom = xcalloc(s.n + 1, sizeof(uint32_t));
+    uint32_t *order = xcalloc(s.n + 1, sizeof(uint32_t));
+    uint32_t reached = dominators(&s, idom, order);
+
+    uint64_t *retained = xcalloc(s.n + 1, sizeof(uint64_t));
+    uint64_t total = 0, reachable_bytes = 0;
+    for (uint32_t v = 0; v < s.n; v++) {
+        retained[v] = s.size[v];
+        total += s.size[v];
+    }
+    for (uint32_t i = reached; i-- > 1;) {
+        uint32_t v = order[i];
+        reachable_bytes += s.size[v];
+        retained[idom[v]] += retained[v];
+    }
+
+    printf("Snapshot %s\n", path);
+    printf("  Objects:            %u (%llu bytes)\n", s.n, (unsigned long long)total);
+    printf("  Roots:              %u\n", s.root_count);
+    printf("  Reachable:          %u objects (%llu bytes)\n",
+           reached - 1, (unsigned long long)reachable_bytes);
+    printf("  Unreachable:        %u objects (%llu bytes, garbage at dump time)\n",
+           s.n - (reached - 1), (unsigned long long)(total - reachable_bytes));
+
+    Group *groups = NULL;
+    int count = 0, cap = 0;
+    for (uint32_t v = 0; v < s.n; v++) {
+        Group *g = find_group(&groups, &count, &cap, s.type[v], s.site[v]);
+        g->count++;
+        g->bytes += s.size[v];
+    }
+    for (int i = 0; i < count; i++) {
+        groups[i].count_b = groups[i].count;
+        groups[i].bytes_b = groups[i].bytes;
+        groups[i].count = 0;
+        groups[i].bytes = 0;
+    }
+    qsort(groups, (size_t)count, sizeof(Group), by_bytes_desc);
+    printf("\nBy type and allocation site:\n");
+    printf("  %-10s %-10s %12s %14s\n", "type", "site", "objects", "bytes");
+    for (int i = 0; i < count; i++) {
+        char site[32];
+        site_name(groups[i].site, site, sizeof(site));
+        printf("  %-10s %-10s %12ld %14ld\n", type_name(groups[i].type), site,
+               groups[i].count_b, groups[i].bytes_b);
+    }
+    free(groups);
+
+    /* Largest retainers: objects dominated only by the virtual root, i.e.
+       the top level of the dominator tree. Everything else is nested in one. */
+    printf("\nLargest retainers (retained size from the dominator tree):\n");
+    printf("  %-10s %-10s %-10s %14s\n", "object", "type", "site", "retained");
+    for (int shown = 0; shown < 10; shown++) {
+        uint32_t best = UINT32_MAX;
+        for (uint32_t i = 1; i < reached; i++) {
+            uint32_t v = order[i];
+            if (idom[v] != s.n || retained[v] == 0) continue;
+            if (best == UINT32_MAX || retained[v] > retained[best]) best = v;
+        }
+        if (best == UINT32_MAX) break;
+        char site[32];
+        site_name(s.site[best], site, sizeof(site));
+        printf("  #%-9u %-10s %-10s %14llu\n", best, type_name(s.type[best]), site,
+               (unsigned long long)retained[best]);
+        retained[best] = 0;
+    }
+
+    free(idom);
+    free(order);
+    free(retained);
+    snapshot_graph_free(&s);
+}
+
+static void diff(const char *path_a, const char *path_b) {
+    SnapshotGraph a, b;
+    load_snapshot(path_a, &a);
+    load_snapshot(path_b, &b);
+
+    Group *groups = NULL;
+    int count = 0, cap = 0;
+    for (uint32_t v = 0; v < a.n; v++) {
+        Group *g = find_group(&groups, &count, &cap, a.type[v], a.site[v]);
+        g->count++;
+        g->bytes += a.size[v];
+    }
+    for (uint32_t v = 0; v < b.n; v++) {
+        Group *g = find_group(&groups, &count, &cap, b.type[v], b.site[v]);
+        g->count_b++;
+        g->bytes_b += b.size[v];
+    }
+    qsort(groups, (size_t)count, sizeof(Group), by_bytes_desc);
+
+    printf("Diff %s -> %s\n", path_a, path_b);
+    printf("  Objects: %u -> %u (%+ld)\n\n", a.n, b.n, (long)b.n - (long)a.n);
+    printf("  %-10s %-10s %10s %10s %10s %14s\n", "type", "site", "before", "after", "delta", "delta bytes");
+    for (int i = 0; i < count; i++) {
+        Group *g = &groups[i];
+        if (g->count == g->count_b) continue;
+        char site[32];
+        site_name(g->site, site, sizeof(site));
+        printf("  %-10s %-10s %10ld %10ld %+10ld %+14ld\n", type_name(g->type), site,
+               g->count, g->count_b, g->count_b - g->count, g->bytes_b - g->bytes);
+    }
+
+    free(groups);
+    snapshot_graph_free(&a);
+    snapshot_graph_free(&b);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "summary") == 0) {
+        summary(argv[2]);
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+        diff(argv[2], argv[3]);
+        return 0;
+    }
+    fprintf(stderr, "Usage: %s summary <file.snap>\n", argv[0]);
+    fprintf(stderr, "       %s diff <before.snap> <after.snap>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,224 @@
+#include "table.h"
+#include "vm.h"
+#include <stdint.h>
+
+static const Value FREE_KEY = {VAL_OBJ, {.obj = NULL}};
+
+static int bucket_count(Obj *entries){
+    return entries->as.vector.length / 2;
+}
+
+static Value *bucket(Obj *entries, int i){
+    return &entries->as.vector.items[2 * i];
+}
+
+static int is_free(Value key){
+    return key.type == VAL_OBJ && !key.as.obj;
+}
+
+// Strings are interned: equal ones are the same object
+static int same_key(Value a, Value b){
+    if(a.type != b.type) return 0;
+    return a.type == VAL_OBJ ? a.as.obj == b.as.obj : a.as.i == b.as.i;
+}
+
+static int home_of(Value key, int buckets){
+    uint32_t h = key.type == VAL_OBJ ? key.as.obj->as.string.hash : (uint32_t)key.as.i;
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+    return (int)(h & (uint32_t)(buckets - 1));
+}
+
+// Buckets between key's home and i
+static int distance(Value key, int i, int buckets){
+    return (i - home_of(key, buckets)) & (buckets - 1);
+}
+
+static void set_item(struct VM *vm, Obj *entries, int index, Value value){
+    entries->as.vector.items[index] = value;
+    gc_write_barrier(vm, entries, value);
+    if(vm->recorder) recorder_field(vm->recorder, entries, index, value);
+}
+
+static void set_bucket(struct VM *vm, Obj *entries, int i, Value key, Value value){
+    set_item(vm, entries, 2 * i, key);
+    set_item(vm, entries, 2 * i + 1, value);
+}
+
+static void set_link(struct VM *vm, Obj *table, int field, Obj **slot, Obj *target){
+    *slot = target;
+    if(!target) return;
+    gc_write_barrier(vm, table, make_obj_value(target));
+    if(vm->recorder) recorder_field(vm->recorder, table, field, make_obj_value(target));
+}
+
+// entries must not hold key yet
+static void insert(struct VM *vm, Obj *entries, Value key, Value value){
+    int buckets = bucket_count(entries);
+    int i = home_of(key, buckets);
+    int dist = 0;
+    for(;;){
+        Value *b = bucket(entries, i);
+        if(is_free(b[0])){
+            set_bucket(vm, entries, i, key, value);
+            return;
+        }
+        int d = distance(b[0], i, buckets);
+        if(d < dist){
+            // The poorer entry takes the bucket; carry on with the richer
+            Value k = b[0], v = b[1];
+            set_bucket(vm, entries, i, key, value);
+            key = k;
+            value = v;
+            dist = d;
+        }
+        i = (i + 1) & (buckets - 1);
+        dist++;
+    }
+}
+
+static int find(Obj *entries, Value key){
+    int buckets = bucket_count(entries);
+    int i = home_of(key, buckets);
+    for(int dist = 0; ; dist++){
+        Value *b = bucket(entries, i);
+        // Any entry of key would sit before one closer to its home
+        if(is_free(b[0]) || distance(b[0], i, buckets) < dist) return -1;
+        if(same_key(b[0], key)) return i;
+        i = (i + 1) & (buckets - 1);
+    }
+}
+
+static void remove_at(struct VM *vm, Obj *entries, int i){
+    int buckets = bucket_count(entries);
+    for(;;){
+        int next = (i + 1) & (buckets - 1);
+        Value *b = bucket(entries, next);
+        if(is_free(b[0]) || distance(b[0], next, buckets) == 0) break;
+        set_bucket(vm, entries, i, b[0], b[1]);
+        i = next;
+    }
+    set_bucket(vm, entries, i, FREE_KEY, make_int_value(0));
+}
+
+// Buckets of `old` below `migrated` (counted from `start`) are moved and
+// empty; a run never wraps past `start`. Tombstones do not end a search.
+static int find_old(Obj *table, Value key){
+    Obj *old = table->as.table.old;
+    int buckets = bucket_count(old);
+    int start = table->as.table.start;
+    int from = (home_of(key, buckets) - start) & (buckets - 1);
+    if(from < table->as.table.migrated) from = table->as.table.migrated;
+    for(int n = from; n < buckets; n++){
+        int i = (start + n) & (buckets - 1);
+        Value *b = bucket(old, i);
+        if(is_free(b[0])){
+            if(b[1].as.i == 0) return -1;
+            continue;
+        }
+        if(same_key(b[0], key)) return i;
+    }
+    return -1;
+}
+
+// Moves up to steps buckets of `old` into `entries`
+static void migrate(struct VM *vm, Obj *table, int steps){
+    Obj *old = table->as.table.old;
+    if(!old) return;
+    int buckets = bucket_count(old);
+    while(steps-- > 0 && table->as.table.migrated < buckets){
+        int i = (table->as.table.start + table->as.table.migrated) & (buckets - 1);
+        Value *b = bucket(old, i);
+        if(!is_free(b[0])) insert(vm, table->as.table.entries, b[0], b[1]);
+        set_bucket(vm, old, i, FREE_KEY, make_int_value(0));
+        table->as.table.migrated++;
+    }
+    if(table->as.table.migrated == buckets) table->as.table.old = NULL;
+}
+
+// Installs an empty vector of `buckets` buckets; the current one, if any,
+// starts migrating. -1 when out of memory.
+static int grow(struct VM *vm, Value *args, int buckets){
+    // A table on the heap may not point into a region
+    int bypass = !(args[0].as.obj->flags & OBJ_FLAG_REGION);
+    if(bypass) vm->region.bypass++;
+    Obj *entries = new_vector(vm, 2 * buckets);
+    if(bypass) vm->region.bypass--;
+    if(!entries) return -1;
+    for(int i = 0; i < buckets; i++) entries->as.vector.items[2 * i] = FREE_KEY;
+
+    Obj *table = args[0].as.obj;    // Reloaded: the allocation may collect
+    Obj *old = table->as.table.entries;
+    set_link(vm, table, 0, &table->as.table.entries, entries);
+    set_link(vm, table, 1, &table->as.table.old, old);
+    table->as.table.migrated = 0;
+    table->as.table.start = 0;
+    if(old){
+        while(!is_free(bucket(old, table->as.table.start)[0])) table->as.table.start++;
+    }
+    return 0;
+}
+
+int table_get(Obj *table, Value key, Value *value){
+    Obj *entries = table->as.table.entries;
+    if(!entries) return 0;
+    int i = find(entries, key);
+    if(i >= 0){
+        *value = bucket(entries, i)[1];
+        return 1;
+    }
+    if(table->as.table.old && (i = find_old(table, key)) >= 0){
+        *value = bucket(table->as.table.old, i)[1];
+        return 1;
+    }
+    return 0;
+}
+
+int table_put(struct VM *vm, Value *args){
+    Obj *table = args[0].as.obj;
+    migrate(vm, table, TABLE_MIGRATE_STEP);
+    if(table->as.table.entries){
+        int i = find(table->as.table.entries, args[1]);
+        if(i >= 0){
+            set_item(vm, table->as.table.entries, 2 * i + 1, args[2]);
+            return 0;
+        }
+        if(table->as.table.old && (i = find_old(table, args[1])) >= 0){
+            // Moves to `entries` below
+            set_bucket(vm, table->as.table.old, i, FREE_KEY, make_int_value(1));
+            table->as.table.count--;
+        }
+    }
+
+    if(!table->as.table.entries){
+        if(grow(vm, args, TABLE_MIN_BUCKETS) != 0) return -1;
+    }
+    else{
+        int buckets = bucket_count(table->as.table.entries);
+        if((table->as.table.count + 1) * 100 > buckets * TABLE_LOAD_PERCENT){
+            // Never two vectors migrating at once
+            if(table->as.table.old) migrate(vm, table, bucket_count(table->as.table.old));
+            if(grow(vm, args, buckets * 2) != 0) return -1;
+        }
+    }
+    table = args[0].as.obj;
+    insert(vm, table->as.table.entries, args[1], args[2]);
+    table->as.table.count++;
+    return 0;
+}
+
+int table_delete(struct VM *vm, Obj *table, Value key){
+    migrate(vm, table, TABLE_MIGRATE_STEP);
+    if(!table->as.table.entries) return 0;
+    int i = find(table->as.table.entries, key);
+    if(i >= 0) remove_at(vm, table->as.table.entries, i);
+    else if(table->as.table.old && (i = find_old(table, key)) >= 0){
+        set_bucket(vm, table->as.table.old, i, FREE_KEY, make_int_value(1));
+    }
+    else return 0;
+    table->as.table.count--;
+    return 1;
+}
@@ -0,0 +1,44 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "object.h"
+
+// Native hash tables (OBJ_TABLE): TABLE_NEW, TABLE_GET, TABLE_PUT,
+// TABLE_DELETE and TABLE_SIZE.
+//
+// The table object only holds counters. Its buckets live in an OBJ_VECTOR
+// of 2 * buckets Values (key, value), so the collector traces, moves and
+// frees them like any vector. Buckets use Robin Hood open addressing: an
+// insert takes over the bucket of any entry that is closer to its home
+// than the new one, which keeps probe runs short, and a delete shifts the
+// rest of its run back instead of leaving a tombstone. A free bucket's key
+// is an object Value with a NULL pointer. Keys are ints or strings, which
+// hash by their cached content hash (intern.h); an object's address is no
+// hash key, since the Immix heap moves objects.
+//
+// Growing is incremental, so a big table never rehashes in one go. Past
+// TABLE_LOAD_PERCENT, a vector with twice the buckets becomes `entries`
+// and the full one `old`. Every later put or delete moves
+// TABLE_MIGRATE_STEP buckets of `old` across, and lookups search both.
+// Migration walks `old` from a bucket that was empty (`start`), so no
+// probe run wraps past the buckets already moved; a delete in `old`
+// leaves a tombstone (free key, value 1).
+
+#define TABLE_MIN_BUCKETS 8
+#define TABLE_LOAD_PERCENT 75
+#define TABLE_MIGRATE_STEP 8
+
+struct VM;
+
+// The value stored under key; 0 if there is none
+int table_get(Obj *table, Value key, Value *value);
+
+// Stores args[2] under the key args[1] in the table args[0]. The three
+// stay on the stack, since growing the table may collect. Returns -1 when
+// out of memory.
+int table_put(struct VM *vm, Value *args);
+
+// Returns 1 if key was there
+int table_delete(struct VM *vm, Obj *table, Value key);
+
+#endif
@@ -1,35 +1,18 @@
 #include "vm.h"
 #include "object.h"
 #include "value.h"
+#include "heap.h"
+#include "bitmap.h"
+#include "immix.h"
+#include "snapshot.h"
+#include <string.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 // Helper to initialize VM for testing (without bytecode)
 void test_vm_init(VM *vm) {
-    init_stack(&vm->stack);
-    vm->bytecode = NULL;
-    vm->pc = 0;
-    vm->running = 1;
-    vm->rsp = -1;
-    vm->instruction_count = 0;
-    vm->heap_head = NULL;
-    vm->heap_size = 0;
-    vm->gc_threshold = 100;
-    
-    // Initialize performance statistics
-    vm->gc_stats.total_gc_calls = 0;
-    vm->gc_stats.total_objects_allocated = 0;
-    vm->gc_stats.total_objects_freed = 0;
-    vm->gc_stats.total_gc_time = 0.0;
-    vm->gc_stats.max_gc_pause = 0.0;
-    vm->gc_stats.min_gc_pause = 0.0;
-    vm->gc_stats.max_heap_size = 0;
-    vm->gc_stats.bytes_allocated = 0;
-    
-    for(int i = 0; i < 1024; i++){
-        vm->memory[i] = make_int_value(0);
-        vm->valid[i] = 0;
-    }
+    vm_init(vm, NULL);
 }
 
 // Helper to print test results
@@ -321,6 +304,1127 @@ void test_multiple_memory_objects() {
     }
 }
 
+void test_heap_census() {
+    VM vm;
+    test_vm_init(&vm);
+    vm.census = census_create(0, 1);   // no bytecode: every site is native
+    
+    printf("\n=== EXTENSION: Heap Census by Site and Type ===\n");
+    
+    Obj *env = new_pair(&vm, make_int_value(1), make_int_value(2));
+    Obj *fn = new_function(&vm, 0, 0);
+    Obj *cl = new_closure(&vm, fn, env);
+    new_pair(&vm, make_int_value(3), make_int_value(4));   // garbage
+    push(&vm.stack, make_obj_value(cl));
+    Obj *vec = new_vector(&vm, 100);    // Bytes are per object, not sizeof(Obj)
+    push(&vm.stack, make_obj_value(vec));
+    
+    gc(&vm);
+    census_print(vm.census, stdout);
+    
+    SiteStats *native = &vm.census->sites[0];
+    int passed = (vm.census->type_live[OBJ_PAIR] == 1) &&
+                 (vm.census->type_live[OBJ_FUNCTION] == 1) &&
+                 (vm.census->type_live[OBJ_CLOSURE] == 1) &&
+                 (vm.census->type_live[OBJ_VECTOR] == 1) &&
+                 (native->allocated == 5) && (native->survived == 4) &&
+                 (native->died == 1) &&
+                 (native->live_bytes == 3 * (long)sizeof(Obj) + (long)object_size(vec));
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: 1 live object per type, native site 4/5 survived\n");
+    
+    census_destroy(vm.census);
+}
+
+// Objects reachable from the virtual root of a loaded snapshot
+static uint32_t snapshot_reachable(SnapshotGraph *s) {
+    uint8_t *seen = calloc(s->n + 1, 1);
+    uint32_t *stack = malloc((s->n + 1) * sizeof(uint32_t));
+    uint32_t sp = 0, reached = 0;
+    stack[sp++] = s->n;
+    while (sp) {
+        uint32_t v = stack[--sp];
+        for (uint32_t e = s->edge_start[v]; e < s->edge_start[v + 1]; e++) {
+            uint32_t w = s->edges[e];
+            if (seen[w]) continue;
+            seen[w] = 1;
+            reached++;
+            stack[sp++] = w;
+        }
+    }
+    free(seen);
+    free(stack);
+    return reached;
+}
+
+void test_heap_snapshot() {
+    // CONST 0; POP; HALT: the string stays cached in vm->constants only
+    int program[] = {0x32, 0, 0x02, 0xff};
+    char *chars[] = {"cached"};
+    int lengths[] = {6};
+    ConstantPool pool = {1, chars, lengths};
+    VM *vm = vm_new(program);
+    vm_attach_constants(vm, &pool);
+    vm_run(vm);
+    
+    printf("\n=== EXTENSION: Heap Snapshot Round Trip ===\n");
+    
+    // memory[0] = (1 . (2 . (3 . 0))), plus one garbage pair
+    Obj *list = new_pair(vm, make_int_value(3), make_int_value(0));
+    list = new_pair(vm, make_int_value(2), make_obj_value(list));
+    list = new_pair(vm, make_int_value(1), make_obj_value(list));
+    vm->memory[0] = make_obj_value(list);
+    vm->valid[0] = 1;
+    new_pair(vm, make_int_value(0), make_int_value(0));
+    // Only held by the finalization queue, a region object and a scratch pair
+    Obj *queued = new_pair(vm, make_int_value(4), make_int_value(0));
+    finalizer_list_add(&vm->finalize_queue, (FinalizerEntry){queued, NULL, NULL});
+    Obj *held = new_pair(vm, make_int_value(5), make_int_value(0));
+    Obj *scratched = new_pair(vm, make_int_value(6), make_int_value(0));
+    region_begin(vm);
+    Obj *region_pair = new_pair(vm, make_obj_value(held), make_int_value(0));
+    Obj scratch = {0};
+    scratch.type = OBJ_PAIR;
+    scratch.flags = OBJ_FLAG_LOCAL;
+    scratch.as.pair.left = make_obj_value(scratched);
+    scratch.as.pair.right = make_int_value(0);
+    push(&vm->stack, make_obj_value(&scratch));
+    
+    int written = heap_snapshot_write(vm, "test_heap.snap") == 0;
+    SnapshotGraph s;
+    int loaded = written && snapshot_load("test_heap.snap", &s) == 0;
+    int passed = 0;
+    if (loaded) {
+        uint32_t reached = snapshot_reachable(&s);
+        printf("Objects: %u, roots: %u, reachable: %u\n", s.n, s.root_count, reached);
+        // string, 3 list pairs, garbage, queued, held, scratched
+        passed = s.n == 8 && s.root_count == 5 && reached == 7 &&
+                 (region_pair->flags & OBJ_FLAG_REGION);
+        snapshot_graph_free(&s);
+    }
+    remove("test_heap.snap");
+    
+    // An edge to an object id past the end is rejected, not followed
+    FILE *fp = fopen("test_corrupt.snap", "wb");
+    SnapshotHeader header = {0};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.object_count = 1;
+    fwrite(&header, sizeof(header), 1, fp);
+    uint8_t type = OBJ_PAIR;
+    int32_t site = -1;
+    uint32_t fields[3] = {sizeof(Obj), 1, 5};    // size, edge count, edge
+    fwrite(&type, sizeof(type), 1, fp);
+    fwrite(&site, sizeof(site), 1, fp);
+    fwrite(fields, sizeof(fields), 1, fp);
+    fclose(fp);
+    int rejected = snapshot_load("test_corrupt.snap", &s) != 0;
+    remove("test_corrupt.snap");
+    
+    printf("Result: %s\n", passed && rejected ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: all roots kept, only the garbage pair unreachable, corrupt file rejected\n");
+    
+    pop(&vm->stack);
+    region_end(vm);
+    vm->finalize_queue.count = 0;
+    vm_free(vm);
+}
+
+static void *run_vm_thread(void *arg) {
+    vm_run((VM*)arg);
+    return NULL;
+}
+
+void test_shared_heap_threads() {
+    // counter = 3000; do { NEW_PAIR(1, 2); POP; } while(--counter)
+    int program[] = {0x01, 3000, 0x30, 1,
+                     0x01, 1, 0x01, 2, 0x50, 0x02,
+                     0x31, 1, 0x01, 1, 0x11, 0x03, 0x30, 1, 0x22, 4,
+                     0xff};
+    SharedHeap *heap = heap_create();
+    VM *a = vm_new(program);
+    VM *b = vm_new(program);
+    heap_attach(heap, a);
+    heap_attach(heap, b);
+    
+    printf("\n=== EXTENSION: Shared Heap with Two Mutator Threads ===\n");
+    
+    // One object allocated by a, rooted in both VMs' memory
+    Obj *shared = new_pair(a, make_int_value(7), make_int_value(8));
+    a->memory[0] = make_obj_value(shared);
+    a->valid[0] = 1;
+    b->memory[0] = make_obj_value(shared);
+    b->valid[0] = 1;
+    
+    pthread_t ta, tb;
+    pthread_create(&ta, NULL, run_vm_thread, a);
+    pthread_create(&tb, NULL, run_vm_thread, b);
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+    long collections = heap->gc_stats.total_gc_calls;
+    
+    // a's objects become orphans; b alone keeps the shared pair alive
+    vm_free(a);
+    gc(b);
+    
+    int passed = (collections > 0) && (heap->live == 1) &&
+                 (shared->as.pair.left.as.i == 7) &&
+                 (heap->gc_stats.total_objects_freed == 6000);
+    printf("Collections during run: %ld, live after: %ld\n", collections, heap->live);
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: 6000 garbage pairs freed, shared pair survives\n");
+    
+    vm_free(b);
+    heap_destroy(heap);
+}
+
+void test_shared_heap_census_snapshot() {
+    int program[] = {0xff};
+    SharedHeap *heap = heap_create();
+    VM *vm = vm_new(program);
+    heap_attach(heap, vm);
+    vm->census = census_create(1, 1);
+    
+    printf("\n=== EXTENSION: Census and Snapshot of a Shared Heap ===\n");
+    
+    // memory[0] = (1 . (2 . 0)), memory[1] = large vector, one garbage pair
+    Obj *list = new_pair(vm, make_int_value(2), make_int_value(0));
+    list = new_pair(vm, make_int_value(1), make_obj_value(list));
+    vm->memory[0] = make_obj_value(list);
+    vm->valid[0] = 1;
+    vm->memory[1] = make_obj_value(new_vector(vm, 100));
+    vm->valid[1] = 1;
+    new_pair(vm, make_int_value(0), make_int_value(0));
+    
+    // Page objects come from the allocation bits, the vector from heap->large
+    SnapshotGraph s;
+    int loaded = heap_snapshot_write(vm, "test_shared.snap") == 0 &&
+                 snapshot_load("test_shared.snap", &s) == 0;
+    uint32_t reached = 0;
+    if (loaded) {
+        reached = snapshot_reachable(&s);
+        printf("Snapshot: %u objects, %u roots, %u reachable\n", s.n, s.root_count, reached);
+    }
+    int snapshot = loaded && s.n == 4 && s.root_count == 2 && reached == 3;
+    if (loaded) snapshot_graph_free(&s);
+    remove("test_shared.snap");
+    
+    gc(vm);
+    SiteStats *native = &vm->census->sites[1];
+    printf("Census: %ld collection(s), %ld/%ld sampled survived\n",
+           vm->census->collections, native->survived, native->allocated);
+    int census = vm->census->collections == 1 && vm->census->type_live[OBJ_PAIR] == 2 &&
+                 vm->census->type_live[OBJ_VECTOR] == 1 && native->allocated == 4 &&
+                 native->survived == 3 && native->died == 1;
+    
+    printf("Result: %s\n", snapshot && census ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: page and large objects in the snapshot and the census\n");
+    
+    census_destroy(vm->census);
+    vm->census = NULL;
+    vm_free(vm);
+    heap_destroy(heap);
+}
+
+void test_bitmap_kernels() {
+    printf("\n=== EXTENSION: SIMD Bitmap Kernels Match Scalar ===\n");
+    
+    // Full words, empty words and mixed words, with a ragged tail
+    uint64_t alloc[HEAP_PAGE_WORDS], mark[HEAP_PAGE_WORDS];
+    unsigned long long seed = 12345;
+    for (int i = 0; i < HEAP_PAGE_WORDS; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        alloc[i] = (i % 5 == 0) ? ~0ULL : (i % 7 == 0) ? 0 : seed;
+        mark[i] = alloc[i] & (seed >> 7);
+    }
+    
+    const BitmapKernels *scalar = bitmap_kernels_named("scalar");
+    const char *names[] = {"sse2", "avx2"};
+    int passed = 1, compared = 0;
+    for (int k = 0; k < 2; k++) {
+        const BitmapKernels *simd = bitmap_kernels_named(names[k]);
+        if (!simd) continue;
+        compared++;
+        
+        uint64_t a1[HEAP_PAGE_WORDS], m1[HEAP_PAGE_WORDS], a2[HEAP_PAGE_WORDS], m2[HEAP_PAGE_WORDS];
+        memcpy(a1, alloc, sizeof(alloc)); memcpy(m1, mark, sizeof(mark));
+        memcpy(a2, alloc, sizeof(alloc)); memcpy(m2, mark, sizeof(mark));
+        if (scalar->count(alloc, HEAP_PAGE_WORDS) != simd->count(alloc, HEAP_PAGE_WORDS)) passed = 0;
+        if (scalar->sweep(a1, m1, HEAP_PAGE_WORDS) != simd->sweep(a2, m2, HEAP_PAGE_WORDS)) passed = 0;
+        if (memcmp(a1, a2, sizeof(a1)) != 0 || memcmp(m1, m2, sizeof(m1)) != 0) passed = 0;
+        
+        for (int from = 0; from < HEAP_PAGE_OBJECTS; from += 37) {
+            int s1 = -1, s2 = -1;
+            int l1 = scalar->find_run(alloc, HEAP_PAGE_WORDS, from, &s1);
+            int l2 = simd->find_run(alloc, HEAP_PAGE_WORDS, from, &s2);
+            if (l1 != l2 || (l1 && s1 != s2)) passed = 0;
+        }
+    }
+    printf("SIMD kernel sets compared: %d\n", compared);
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: identical sweep, count and free-run results\n");
+}
+
+void test_deep_list_marking() {
+    VM vm;
+    test_vm_init(&vm);
+    
+    printf("\n=== EXTENSION: Mark Stack on a Million-Node List ===\n");
+    
+    // Far deeper than recursive marking could follow on the C stack
+    int length = 1000000;
+    Value head = make_int_value(0);
+    for (int i = 0; i < length; i++) {
+        head = make_obj_value(new_pair(&vm, make_int_value(i), head));
+    }
+    push(&vm.stack, head);
+    new_pair(&vm, make_int_value(0), make_int_value(0));   // garbage
+    
+    gc(&vm);
+    int prefetched = vm.heap_size;
+    vm.mark_prefetch = 0;
+    gc(&vm);
+    int plain = vm.heap_size;
+    
+    printf("Live after GC: %d (prefetch queue), %d (plain stack)\n", prefetched, plain);
+    int passed = (prefetched == length) && (plain == length);
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: all %d nodes survive, garbage pair freed\n", length);
+    
+    pop(&vm.stack);
+    gc(&vm);
+}
+
+void test_paged_heap_decay() {
+    SharedHeap *heap = heap_create();
+    VM *vm = vm_new(NULL);
+    heap_attach(heap, vm);
+    heap->decay = 1;
+    
+    printf("\n=== EXTENSION: Empty Pages Returned to the OS ===\n");
+    
+    // A 200k-node list spread over ~170 pages, rooted from memory
+    Value head = make_int_value(0);
+    for (int i = 0; i < 200000; i++) {
+        head = make_obj_value(new_pair(vm, make_int_value(i), head));
+    }
+    vm->memory[0] = head;
+    vm->valid[0] = 1;
+    gc(vm);
+    long committed_before, resident_before;
+    heap_memory_usage(heap, &committed_before, &resident_before);
+    
+    vm->valid[0] = 0;
+    gc(vm);
+    long committed_after, resident_after;
+    heap_memory_usage(heap, &committed_after, &resident_after);
+    
+    printf("Resident: %ld -> %ld bytes, pages returned: %d of %d\n",
+           resident_before, resident_after, heap->released_pages, heap->page_count);
+    int passed = (heap->live == 0) && (heap->released_pages == heap->page_count) &&
+                 (committed_after == 0) && (resident_after < resident_before / 4);
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: every page released, resident bytes drop to the page headers\n");
+    
+    vm_free(vm);
+    heap_destroy(heap);
+}
+
+void test_heap_limit_error() {
+    // TRY handler; list = 0; loop { list = NEW_PAIR(list, 1) }
+    // handler: memory[5] = error code; push 42
+    int program[] = {0x70, 9,
+                     0x01, 0,
+                     0x01, 1, 0x50, 0x20, 4,
+                     0x30, 5, 0x01, 42, 0xff};
+    int uncaught[] = {0x01, 0,
+                      0x01, 1, 0x50, 0x20, 2,
+                      0xff};
+    
+    printf("\n=== EXTENSION: Heap Limit Raises a Catchable Error ===\n");
+    
+    VM *vm = vm_new(program);
+    vm->max_heap_bytes = 100 * sizeof(Obj);
+    vm_run(vm);
+    int caught = vm->error == VM_OK && vm->stack.sp == 0 && vm->stack.data[0].as.i == 42 &&
+                 vm->memory[5].as.i == VM_ERROR_OUT_OF_MEMORY;
+    printf("Caught: code %d, heap %d objects, %ld emergency GCs\n",
+           vm->memory[5].as.i, vm->heap_size, vm->gc_stats.emergency_gcs);
+    int bounded = vm->heap_size <= 100 && vm->gc_stats.emergency_gcs >= 1;
+    vm_free(vm);
+    
+    vm = vm_new(uncaught);
+    vm->max_heap_bytes = 100 * sizeof(Obj);
+    vm_run(vm);
+    int stopped = vm->error == VM_ERROR_OUT_OF_MEMORY && !vm->running;
+    vm_free(vm);
+    
+    int passed = caught && bounded && stopped;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: handler gets the error, uncaught error stops only the VM\n");
+}
+
+// Roots: a, weak(a), weak(b), ephemeron(b -> c), ephemeron(a -> e),
+// ephemeron(e -> f). After a GC only b and c may be gone.
+static int check_weak_processing(VM *vm) {
+    Obj *a = new_pair(vm, make_int_value(1), make_int_value(0));
+    Obj *b = new_pair(vm, make_int_value(2), make_int_value(0));
+    Obj *c = new_pair(vm, make_int_value(3), make_int_value(0));
+    Obj *e = new_pair(vm, make_int_value(5), make_int_value(0));
+    Obj *f = new_pair(vm, make_int_value(6), make_int_value(0));
+    Obj *refs[6];
+    refs[0] = a;
+    refs[1] = new_weak(vm, a);
+    refs[2] = new_weak(vm, b);
+    refs[3] = new_ephemeron(vm, b, make_obj_value(c));
+    // e is reachable only through an ephemeron listed before its own
+    refs[4] = new_ephemeron(vm, e, make_obj_value(f));
+    refs[5] = new_ephemeron(vm, a, make_obj_value(e));
+    for (int i = 0; i < 6; i++) {
+        vm->memory[i] = make_obj_value(refs[i]);
+        vm->valid[i] = 1;
+    }
+    gc(vm);
+    
+    return refs[1]->as.weak.referent == a &&
+           refs[2]->as.weak.referent == NULL &&
+           refs[3]->as.ephemeron.key == NULL &&
+           refs[3]->as.ephemeron.value.type == VAL_INT &&
+           refs[5]->as.ephemeron.value.as.obj == e &&
+           refs[4]->as.ephemeron.key == e &&
+           refs[4]->as.ephemeron.value.as.obj->as.pair.left.as.i == 6;
+}
+
+void test_weak_and_ephemerons() {
+    printf("\n=== EXTENSION: Weak References and Ephemerons ===\n");
+    
+    VM *vm = vm_new(NULL);
+    int private_ok = check_weak_processing(vm) && vm->heap_size == 8 &&
+                     vm->gc_stats.weak_cleared == 2;
+    printf("Private heap: %d objects left, %ld cleared\n", vm->heap_size,
+           vm->gc_stats.weak_cleared);
+    vm_free(vm);
+    
+    SharedHeap *heap = heap_create();
+    vm = vm_new(NULL);
+    heap_attach(heap, vm);
+    int shared_ok = check_weak_processing(vm) && heap->live == 8 &&
+                    heap->gc_stats.weak_cleared == 2;
+    printf("Paged heap:   %ld objects left, %ld cleared\n", heap->live,
+           heap->gc_stats.weak_cleared);
+    vm_free(vm);
+    heap_destroy(heap);
+    
+    int passed = private_ok && shared_ok;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: dead referent and key cleared, chained ephemeron values kept\n");
+}
+
+static void count_finalized(VM *vm, Obj *obj, void *data) {
+    (void)vm;
+    // Still intact: the object and what it references were kept alive
+    *(int*)data += obj->as.pair.right.as.obj->as.pair.left.as.i;
+}
+
+void test_finalization_queue() {
+    // GC; PUSH 1; HALT
+    int program[] = {0x60, 0x01, 1, 0xff};
+    VM *vm = vm_new(program);
+    int finalized = 0;
+    
+    printf("\n=== EXTENSION: Finalizers Run After the GC Pause ===\n");
+    
+    // Two unreachable resources, each holding an inner pair worth 7
+    for (int i = 0; i < 2; i++) {
+        Obj *inner = new_pair(vm, make_int_value(7), make_int_value(0));
+        Obj *resource = new_pair(vm, make_int_value(i), make_obj_value(inner));
+        vm_register_finalizer(vm, resource, count_finalized, &finalized);
+    }
+    Obj *kept = new_pair(vm, make_int_value(0), make_int_value(0));
+    vm_register_finalizer(vm, kept, count_finalized, &finalized);
+    vm->memory[0] = make_obj_value(kept);
+    vm->valid[0] = 1;
+    
+    vm_run(vm);
+    int after_run = vm->heap_size;
+    gc(vm);
+    
+    printf("Finalized sum: %d, queued: %ld, run: %ld, heap %d -> %d\n", finalized,
+           vm->gc_stats.finalizers_queued, vm->gc_stats.finalizers_run,
+           after_run, vm->heap_size);
+    int passed = (finalized == 14) && (vm->gc_stats.finalizers_run == 2) &&
+                 (vm->gc_stats.finalize_queue_max == 2) && (after_run == 5) &&
+                 (vm->heap_size == 1) && (vm->finalizers.count == 1);
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: dead objects kept until finalized, freed by the next GC\n");
+    vm_free(vm);
+}
+
+// v = vector(3000); v[i] = pair(i, 0) for i < 3000; bytes b of 100 in v[0];
+// then GC and check that every element survived
+static int check_vectors(VM *vm) {
+    Obj *vec = new_vector(vm, 3000);
+    vm->memory[0] = make_obj_value(vec);
+    vm->valid[0] = 1;
+    for (int i = 1; i < 3000; i++) {
+        vec->as.vector.items[i] = make_obj_value(new_pair(vm, make_int_value(i), make_int_value(0)));
+    }
+    Obj *bytes = new_bytes(vm, 100);
+    bytes->as.bytes.data[99] = 0xab;
+    vec->as.vector.items[0] = make_obj_value(bytes);
+    new_vector(vm, 50);          // garbage, small
+    new_bytes(vm, 1 << 20);      // garbage, large
+    gc(vm);
+    
+    long sum = 0;
+    for (int i = 1; i < 3000; i++) sum += vec->as.vector.items[i].as.obj->as.pair.left.as.i;
+    return (vec->flags & OBJ_FLAG_LARGE) && sum == 2999L * 3000 / 2 &&
+           vec->as.vector.items[0].as.obj->as.bytes.data[99] == 0xab;
+}
+
+void test_vectors_and_bytes() {
+    // TRY oob; v = NEW_VECTOR 4; v[2] = 9; ARRAY_GET v[2] -> memory[1];
+    // ARRAY_GET v[4] raises; handler leaves the error code
+    int program[] = {0x70, 22,
+                     0x01, 4, 0x80,
+                     0x01, 2, 0x01, 9, 0x83, 0x03,
+                     0x01, 2, 0x82, 0x30, 1,
+                     0x01, 4, 0x82, 0x01, 0, 0xff,
+                     0xff};
+    
+    printf("\n=== EXTENSION: Vectors, Byte Arrays and Large Objects ===\n");
+    
+    VM *vm = vm_new(NULL);
+    int private_ok = check_vectors(vm) && vm->heap_size == 3001 &&
+                     vm->heap_bytes == 3000 * 16 + 32 + 128 + 2999 * (long)sizeof(Obj);
+    printf("Private heap: %d objects, %ld bytes\n", vm->heap_size, vm->heap_bytes);
+    vm->valid[0] = 0;
+    gc(vm);
+    private_ok = private_ok && vm->heap_size == 0 && vm->heap_bytes == 0 && !vm->large_head;
+    vm_free(vm);
+    
+    SharedHeap *heap = heap_create();
+    vm = vm_new(NULL);
+    heap_attach(heap, vm);
+    int shared_ok = check_vectors(vm) && heap->live == 3001 && heap->large_count == 2;
+    printf("Paged heap:   %ld objects, %ld in the large-object space\n", heap->live,
+           heap->large_count);
+    vm_free(vm);
+    heap_destroy(heap);
+    
+    vm = vm_new(program);
+    vm_run(vm);
+    int bytecode_ok = vm->memory[1].as.i == 9 && vm->stack.sp == 0 &&
+                      vm->stack.data[0].as.i == VM_ERROR_INDEX_OUT_OF_RANGE;
+    vm_free(vm);
+    
+    int passed = private_ok && shared_ok && bytecode_ok;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: elements traced, bytes untouched, out-of-range index raised\n");
+}
+
+void test_pointer_reversal_marking() {
+    VM *vm = vm_new(NULL);
+    vm->mark_stack_budget = 1;
+    
+    printf("\n=== EXTENSION: Constant-Space Pointer-Reversal Marking ===\n");
+    
+    // Root vector -> [200k-node list, closure over a 1000-deep pair tree, int].
+    // The list needs one stack entry at a time; the tree overflows the
+    // one-entry budget and is marked by reversal (closure, function, 2001 pairs).
+    Obj *root = new_vector(vm, 3);
+    vm->memory[0] = make_obj_value(root);
+    vm->valid[0] = 1;
+    Value list = make_int_value(0);
+    for (int i = 0; i < 200000; i++) {
+        list = make_obj_value(new_pair(vm, make_int_value(i), list));
+        new_pair(vm, make_int_value(i), make_int_value(0));      // garbage
+    }
+    root->as.vector.items[0] = list;
+    Obj *tree = new_pair(vm, make_int_value(1), make_int_value(2));
+    for (int i = 0; i < 1000; i++) {
+        tree = new_pair(vm, make_obj_value(tree), make_obj_value(new_pair(vm, make_int_value(i), make_int_value(0))));
+    }
+    Obj *closure = new_closure(vm, new_function(vm, 0, 1), tree);
+    root->as.vector.items[1] = make_obj_value(closure);
+    root->as.vector.items[2] = make_int_value(7);
+    gc(vm);
+    
+    // Every reversed field must have been restored
+    long length = 0, sum = 0;
+    for (Value v = root->as.vector.items[0]; v.type == VAL_OBJ; v = v.as.obj->as.pair.right) {
+        sum += v.as.obj->as.pair.left.as.i;
+        length++;
+    }
+    int depth = 0;
+    Obj *node = closure->as.closure.env;
+    while (node->as.pair.left.type == VAL_OBJ) {
+        node = node->as.pair.left.as.obj;
+        depth++;
+    }
+    printf("List %ld nodes, tree depth %d, %ld marked by reversal, %d objects left\n",
+           length, depth, vm->gc_stats.dsw_marked, vm->heap_size);
+    int passed = length == 200000 && sum == 199999L * 200000 / 2 && depth == 1000 &&
+                 closure->as.closure.function->type == OBJ_FUNCTION &&
+                 root->as.vector.items[2].as.i == 7 &&
+                 vm->heap_size == 1 + 200000 + 2001 + 2 &&
+                 vm->gc_stats.dsw_marked == 2003;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: same live set as stack marking, all fields restored\n");
+    vm_free(vm);
+}
+
+void test_immix_evacuation() {
+    VM *vm = vm_new(NULL);
+    vm->immix = immix_create();
+    
+    printf("\n=== EXTENSION: Immix Heap with Opportunistic Evacuation ===\n");
+    
+    // Keep every 16th pair of 20000 (in a large vector, so outside the
+    // blocks), then fill whole blocks with garbage. The first collection
+    // leaves sparse blocks and frees the garbage ones; the second evacuates
+    // the sparse blocks into the free ones.
+    Obj *keep = new_vector(vm, 1250);
+    vm->memory[0] = make_obj_value(keep);
+    vm->valid[0] = 1;
+    for (int i = 0; i < 20000; i++) {
+        Obj *pair = new_pair(vm, make_int_value(i), make_int_value(-i));
+        if (i % 16 == 0) keep->as.vector.items[i / 16] = make_obj_value(pair);
+    }
+    for (int i = 0; i < 20000; i++) {
+        new_pair(vm, make_int_value(i), make_int_value(0));
+    }
+    vm->memory[1] = make_obj_value(new_weak(vm, keep->as.vector.items[5].as.obj));
+    vm->valid[1] = 1;
+    gc(vm);
+    gc(vm);
+    
+    // Objects are read back through the roots, which now point at the copies
+    keep = vm->memory[0].as.obj;
+    int intact = 1;
+    for (int i = 0; i < 1250; i++) {
+        Obj *pair = keep->as.vector.items[i].as.obj;
+        if (pair->type != OBJ_PAIR || (pair->flags & OBJ_FLAG_FORWARDED) ||
+            pair->as.pair.left.as.i != i * 16 || pair->as.pair.right.as.i != -i * 16) intact = 0;
+    }
+    Obj *weak = vm->memory[1].as.obj;
+    int weak_ok = weak->as.weak.referent == keep->as.vector.items[5].as.obj;
+    
+    // Allocation reuses the freed blocks instead of growing the space
+    int blocks = vm->immix->block_count;
+    for (int i = 0; i < 20000; i++) {
+        new_pair(vm, make_int_value(i), make_int_value(0));
+    }
+    gc(vm);
+    printf("%ld objects evacuated, %d blocks (%d after refill), %d objects left\n",
+           vm->immix->evacuated_total, blocks, vm->immix->block_count, vm->heap_size);
+    int passed = intact && weak_ok && vm->immix->evacuated_total > 0 &&
+                 vm->immix->block_count == blocks && vm->heap_size == 1 + 1250 + 1;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: live data moved out of sparse blocks, fields and weak refs updated\n");
+    vm_free(vm);
+}
+
+void test_immix_census_snapshot() {
+    VM *vm = vm_new(NULL);
+    vm->immix = immix_create();
+    vm->census = census_create(0, 1);
+    
+    printf("\n=== EXTENSION: Census and Snapshot of an Immix Heap ===\n");
+    
+    // As above: every 16th of 20000 pairs kept, the second collection
+    // evacuates them, leaving their old copies behind in the blocks
+    Obj *keep = new_vector(vm, 1250);
+    vm->memory[0] = make_obj_value(keep);
+    vm->valid[0] = 1;
+    for (int i = 0; i < 20000; i++) {
+        Obj *pair = new_pair(vm, make_int_value(i), make_int_value(0));
+        if (i % 16 == 0) keep->as.vector.items[i / 16] = make_obj_value(pair);
+    }
+    for (int i = 0; i < 20000; i++) {
+        new_pair(vm, make_int_value(i), make_int_value(0));
+    }
+    gc(vm);
+    gc(vm);
+    new_pair(vm, make_int_value(0), make_int_value(0));    // garbage
+    
+    SiteStats *native = &vm->census->sites[0];
+    printf("Census: %ld pairs live, %ld/%ld sampled survived the last collection\n",
+           vm->census->type_live[OBJ_PAIR], native->live, native->allocated);
+    int census = vm->census->collections == 2 && vm->census->type_live[OBJ_PAIR] == 1250 &&
+                 vm->census->type_live[OBJ_VECTOR] == 1 && native->live == 1251 &&
+                 native->died == 40000 - 1250;
+    
+    SnapshotGraph s;
+    int loaded = heap_snapshot_write(vm, "test_immix.snap") == 0 &&
+                 snapshot_load("test_immix.snap", &s) == 0;
+    uint32_t reached = 0;
+    if (loaded) {
+        reached = snapshot_reachable(&s);
+        printf("Snapshot: %u objects, %u reachable, %ld evacuated\n", s.n, reached,
+               vm->immix->evacuated_total);
+    }
+    int snapshot = loaded && s.n == 1252 && reached == 1251 && vm->immix->evacuated_total > 0;
+    if (loaded) snapshot_graph_free(&s);
+    remove("test_immix.snap");
+    
+    printf("Result: %s\n", census && snapshot ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: block objects counted once, moved or not; old copies skipped\n");
+    census_destroy(vm->census);
+    vm->census = NULL;
+    vm_free(vm);
+}
+
+// Scattered list (memory[0], 300 cells) and tree (memory[1], 127 nodes),
+// evacuated by a second collection in the given order. Returns how many of
+// the 63 inner tree nodes have their children where the order puts them
+// (-1 if not everything moved); *list_placed counts list cells directly
+// followed by their successor, out of 299.
+static int check_copy_order(CopyOrder order, int *list_placed) {
+    VM *vm = vm_new(NULL);
+    vm->immix = immix_create();
+    vm->copy_order = order;
+    Obj *cells[300];
+    for (int i = 0; i < 300; i++) {
+        cells[i] = new_pair(vm, make_int_value(i), make_int_value(0));
+        for (int g = 0; g < 7; g++) new_pair(vm, make_int_value(g), make_int_value(0));
+    }
+    // Link in a scrambled order (stride 7 is coprime with 300)
+    for (int i = 0; i < 299; i++) {
+        cells[i * 7 % 300]->as.pair.right = make_obj_value(cells[(i + 1) * 7 % 300]);
+    }
+    vm->memory[0] = make_obj_value(cells[0]);
+    vm->valid[0] = 1;
+    Obj *nodes[127];
+    for (int k = 126; k >= 0; k--) {
+        Value left = make_int_value(k), right = make_int_value(0);
+        if (2 * k + 2 < 127) {
+            left = make_obj_value(nodes[2 * k + 1]);
+            right = make_obj_value(nodes[2 * k + 2]);
+        }
+        nodes[k] = new_pair(vm, left, right);
+        for (int g = 0; g < 7; g++) new_pair(vm, make_int_value(g), make_int_value(0));
+    }
+    vm->memory[1] = make_obj_value(nodes[0]);
+    vm->valid[1] = 1;
+    for (int i = 0; i < 5000; i++) new_pair(vm, make_int_value(i), make_int_value(0));
+    gc(vm);
+    gc(vm);
+    
+    // Depth order: the next cell / right child follows its parent. Breadth
+    // order: a node's two children are copied together.
+    *list_placed = 0;
+    for (Obj *cell = vm->memory[0].as.obj; cell->as.pair.right.type == VAL_OBJ; cell = cell->as.pair.right.as.obj) {
+        if ((char*)cell->as.pair.right.as.obj == (char*)cell + sizeof(Obj)) (*list_placed)++;
+    }
+    int placed = 0;
+    Obj *stack[127];
+    int sp = 0;
+    stack[sp++] = vm->memory[1].as.obj;
+    while (sp > 0) {
+        Obj *node = stack[--sp];
+        if (node->as.pair.left.type != VAL_OBJ) continue;
+        Obj *left = node->as.pair.left.as.obj, *right = node->as.pair.right.as.obj;
+        char *expected = order == COPY_ORDER_DEPTH ? (char*)node : (char*)left;
+        if ((char*)right == expected + sizeof(Obj)) placed++;
+        stack[sp++] = left;
+        stack[sp++] = right;
+    }
+    int evacuated = vm->immix->evacuated_total == 300 + 127;
+    vm_free(vm);
+    return evacuated ? placed : -1;
+}
+
+void test_copy_order() {
+    printf("\n=== EXTENSION: Locality-Preserving Copy Order ===\n");
+    
+    int depth_list, breadth_list;
+    int depth = check_copy_order(COPY_ORDER_DEPTH, &depth_list);
+    int breadth = check_copy_order(COPY_ORDER_BREADTH, &breadth_list);
+    printf("Depth order: %d/299 list tails and %d/63 right children next to their parent\n",
+           depth_list, depth);
+    printf("Breadth order: %d/63 sibling pairs adjacent\n", breadth);
+    int passed = depth_list == 299 && depth == 63 && breadth == 63;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: evacuation places objects in the selected traversal order\n");
+}
+
+void test_generational_pretenuring() {
+    VM *vm = vm_new(NULL);
+    vm->generational = 1;
+    vm->nursery_size = 512;
+    vm->pretenure = pretenure_create(0);   // Native code only: one site
+    
+    printf("\n=== EXTENSION: Generational Heap with Dynamic Pretenuring ===\n");
+    
+    // Remembered set: a promoted cell given a young pair keeps it alive
+    // through a minor collection that does not trace the mature space
+    Obj *old = new_pair(vm, make_int_value(1), make_int_value(0));
+    vm->memory[0] = make_obj_value(old);
+    vm->valid[0] = 1;
+    gc_minor(vm);
+    Obj *young = new_pair(vm, make_int_value(7), make_int_value(8));
+    old->as.pair.right = make_obj_value(young);
+    gc_write_barrier(vm, old, old->as.pair.right);
+    int remembered = vm->remembered_count == 1;
+    gc_minor(vm);
+    int kept = (old->flags & OBJ_FLAG_MATURE) && (young->flags & OBJ_FLAG_MATURE) &&
+               young->as.pair.left.as.i == 7 && vm->remembered_count == 0;
+    
+    // A long-lived list: the site survives, so it switches to the mature space
+    push(&vm->stack, make_int_value(0));
+    for (int i = 0; i < 4000; i++) {
+        Value tail = pop(&vm->stack);
+        push(&vm->stack, make_obj_value(new_pair(vm, make_int_value(i), tail)));
+        gc_collect_if_needed(vm);
+    }
+    long pretenured = vm->gc_stats.objects_pretenured;
+    int switched = vm->pretenure->decisions == 1 && vm->pretenure->sites[0].pretenured;
+    
+    // Then only garbage: the probes die young and the site switches back
+    for (int i = 0; i < 20000; i++) {
+        new_pair(vm, make_int_value(i), make_int_value(0));
+        gc_collect_if_needed(vm);
+    }
+    int reverted = vm->pretenure->reversals == 1 && !vm->pretenure->sites[0].pretenured;
+    gc(vm);
+    
+    long sum = 0;
+    for (Value v = peek(&vm->stack); v.type == VAL_OBJ; v = v.as.obj->as.pair.right) {
+        sum += v.as.obj->as.pair.left.as.i;
+    }
+    printf("%ld pretenured, %ld minor GCs, %ld promoted, %d objects left\n", pretenured,
+           vm->gc_stats.minor_gcs, vm->gc_stats.objects_promoted, vm->heap_size);
+    int passed = remembered && kept && switched && reverted && pretenured > 3000 &&
+                 sum == 3999L * 4000 / 2 && vm->heap_size == 4000 + 2;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: surviving site pretenured, reverted once it allocates garbage\n");
+    vm_free(vm);
+}
+
+static unsigned int read_varint(FILE *fp) {
+    unsigned int value = 0;
+    for (int shift = 0, byte; (byte = fgetc(fp)) != EOF; shift += 7) {
+        value |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+void test_allocation_recorder() {
+    // list = 0; n = 200; loop { list = NEW_PAIR(list, n); NEW_PAIR(7, 8) (garbage); n-- }
+    int program[] = {0x01, 0, 0x30, 0, 0x01, 200, 0x30, 1,
+                     0x31, 0, 0x31, 1, 0x50, 0x30, 0,
+                     0x01, 7, 0x01, 8, 0x50, 0x02,
+                     0x31, 1, 0x01, 1, 0x11, 0x03, 0x30, 1, 0x22, 8,
+                     0xff};
+    const char *path = "test_record.gctrace";
+    
+    printf("\n=== EXTENSION: Allocation and Mutation Recorder ===\n");
+    
+    VM *vm = vm_new(program);
+    vm->recorder = recorder_open(path);
+    vm_run(vm);
+    int closed = vm->recorder && recorder_close(vm->recorder) == 0;
+    vm->recorder = NULL;
+    gc(vm);
+    
+    // Replay: rebuild the pairs' links and the roots, then count what the
+    // roots reach at the end; the VM's heap after a final GC must match
+    enum { MAX_OBJECTS = 1024 };
+    static unsigned int left[MAX_OBJECTS], right[MAX_OBJECTS], memory[MEM_SIZE], stack[STACK_SIZE];
+    memset(left, 0, sizeof(left));
+    memset(right, 0, sizeof(right));
+    memset(memory, 0, sizeof(memory));
+    unsigned int next_id = 1, depth = 0;
+    long allocs = 0, gcs = 0;
+    int tag = EOF;
+    FILE *fp = fopen(path, "rb");
+    RecorderHeader header;
+    if (fp && fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, RECORDER_MAGIC, 8) == 0) {
+        while ((tag = fgetc(fp)) != EOF && tag != REC_END && next_id < MAX_OBJECTS) {
+            unsigned int a, b, c;
+            if (tag == REC_ALLOC) {
+                fgetc(fp);
+                read_varint(fp);
+                next_id++;
+                allocs++;
+            } else if (tag == REC_FIELD) {
+                a = read_varint(fp);
+                b = read_varint(fp);
+                c = read_varint(fp);
+                unsigned int *field = b == 0 ? left : right;
+                field[next_id - a] = c ? next_id - c : 0;
+            } else if (tag == REC_MEMORY || tag == REC_STACK) {
+                a = read_varint(fp);
+                c = read_varint(fp);
+                if (tag == REC_MEMORY) memory[a % MEM_SIZE] = c ? next_id - c : 0;
+                else stack[a % STACK_SIZE] = c ? next_id - c : 0;
+            } else if (tag == REC_DEPTH) {
+                depth = read_varint(fp);
+            } else if (tag == REC_GC) {
+                gcs++;
+            }
+        }
+    }
+    if (fp) fclose(fp);
+    remove(path);
+    
+    static unsigned char reached[MAX_OBJECTS];
+    static unsigned int work[MAX_OBJECTS];
+    memset(reached, 0, sizeof(reached));
+    int sp = 0, live = 0;
+    for (int i = 0; i < MEM_SIZE + (int)depth; i++) {
+        unsigned int id = i < MEM_SIZE ? memory[i] : stack[i - MEM_SIZE];
+        if (id && !reached[id]) { reached[id] = 1; work[sp++] = id; }
+    }
+    while (sp > 0) {
+        unsigned int id = work[--sp];
+        live++;
+        unsigned int links[2] = {left[id], right[id]};
+        for (int k = 0; k < 2; k++) {
+            if (links[k] && !reached[links[k]]) { reached[links[k]] = 1; work[sp++] = links[k]; }
+        }
+    }
+    
+    printf("%ld allocations, %ld collections recorded; %d reachable at the end, heap %d\n",
+           allocs, gcs, live, vm->heap_size);
+    int passed = closed && tag == REC_END && allocs == vm->gc_stats.total_objects_allocated &&
+                 gcs == vm->gc_stats.total_gc_calls - 1 && live == 200 && vm->heap_size == 200;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: every allocation and GC recorded, replayed roots reach the live list\n");
+    vm_free(vm);
+}
+
+void test_escape_analysis() {
+    // B = (A . 3) is only unpacked in its block, with GCs in between that
+    // must keep A alive through B's field (each time, B is never swept);
+    // C is stored, so it escapes, and A escapes into B
+    int program[] = {0x01, 1, 0x01, 2, 0x50,          // A = (1 . 2)
+                     0x01, 3, 0x50,                   // B = (A . 3)
+                     0x60, 0x60,                      // GC twice
+                     0x51, 0x51,                      // B.left.left
+                     0x01, 5, 0x01, 6, 0x50, 0x30, 0, // memory[0] = C
+                     0xff};
+    
+    printf("\n=== EXTENSION: Escape Analysis and Scratch Pairs ===\n");
+    
+    LocalPairs *pairs = escape_analyze(program, sizeof(program) / sizeof(program[0]));
+    int rewritten = pairs && pairs->candidates == 3 && pairs->sites == 1 &&
+                    program[7] == 0x59 && program[4] == 0x50 && program[16] == 0x50;
+    
+    VM *vm = vm_new(program);
+    vm_attach_local_pairs(vm, pairs);
+    vm_run(vm);
+    int ran = vm->error == VM_OK && vm->stack.sp == 0 && vm->stack.data[0].as.i == 1;
+    // A survived the GCs inside the block, B never reached the heap
+    int kept = vm->gc_stats.total_gc_calls == 2 && vm->gc_stats.total_objects_freed == 0 &&
+               vm->gc_stats.total_objects_allocated == 2;
+    gc(vm);
+    printf("%d of %d sites local, %ld objects allocated, heap %d after GC\n",
+           pairs ? pairs->sites : 0, pairs ? pairs->candidates : 0,
+           vm->gc_stats.total_objects_allocated, vm->heap_size);
+    
+    vm_free(vm);
+    local_pairs_destroy(pairs);
+    
+    // P is on the stack when an instruction that may raise runs in code
+    // with regions, so it escapes: STORE promoting a region pair, SET_LEFT,
+    // REGION_END
+    int store[] = {0x70, 16, 0x62,                    // TRY h; REGION_BEGIN
+                   0x01, 3, 0x01, 4, 0x50,            // R = (3 . 4)
+                   0x01, 7, 0x50,                     // P = (R . 7)
+                   0x03, 0x51, 0x30, 0,               // memory[0] = P.left
+                   0x52,                              // P.right
+                   0xff};                             // h: HALT
+    int set[] = {0x62, 0x01, 7, 0x01, 2, 0x50, 0x31, 0, 0x01, 5, 0x53, 0x02, 0x51, 0xff};
+    int end[] = {0x62, 0x01, 7, 0x01, 2, 0x50, 0x63, 0x51, 0xff};
+    LocalPairs *store_pairs = escape_analyze(store, sizeof(store) / sizeof(store[0]));
+    LocalPairs *set_pairs = escape_analyze(set, sizeof(set) / sizeof(set[0]));
+    LocalPairs *end_pairs = escape_analyze(end, sizeof(end) / sizeof(end[0]));
+    int raising = store_pairs && store_pairs->sites == 0 && set_pairs && set_pairs->sites == 0 &&
+                  end_pairs && end_pairs->sites == 0;
+    // With no heap room, the STORE raises into the handler
+    vm = vm_new(store);
+    vm_attach_local_pairs(vm, store_pairs);
+    vm->max_heap_bytes = 1;
+    vm_run(vm);
+    int caught = vm->stack.sp == 0 && vm->stack.data[0].as.i == VM_ERROR_OUT_OF_MEMORY &&
+                 vm->region.depth == 0;
+    vm_free(vm);
+    local_pairs_destroy(store_pairs);
+    local_pairs_destroy(set_pairs);
+    local_pairs_destroy(end_pairs);
+    
+    int passed = rewritten && ran && kept && raising && caught;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: only the block-local pair rewritten, its field kept alive by GC\n");
+}
+
+void test_region_allocation() {
+    // H is reachable only through a region pair during the first GC. R2 and
+    // its child escape through STORE; R1 is left on the stack at REGION_END.
+    int program[] = {0x01, 1, 0x01, 2, 0x50, 0x30, 0,      // memory[0] = H = (1 . 2)
+                     0x62,                                 // REGION_BEGIN
+                     0x31, 0, 0x01, 3, 0x50,               // R1 = (H . 3)
+                     0x01, 0, 0x30, 0,                     // memory[0] = 0
+                     0x60,                                 // GC
+                     0x01, 4, 0x01, 5, 0x50, 0x01, 6, 0x50, // R2 = ((4 . 5) . 6)
+                     0x30, 1,                              // memory[1] = R2
+                     0x63,                                 // REGION_END
+                     0x60,                                 // GC
+                     0x51, 0x52,                           // R1.left.right = 2
+                     0x31, 1, 0x51, 0x51, 0x10,            // + R2.left.left = 6
+                     0xff};
+    
+    printf("\n=== EXTENSION: Region Allocation and Promotion ===\n");
+    
+    VM *vm = vm_new(program);
+    vm_run(vm);
+    int ran = vm->error == VM_OK && vm->stack.sp == 0 && vm->stack.data[0].as.i == 6;
+    // Region objects are only on the heap once promoted
+    int counted = vm->region.allocated == 3 && vm->region.promoted == 3 &&
+                  vm->region.regions == 1 && vm->region.depth == 0 &&
+                  vm->gc_stats.total_objects_allocated == 4;
+    int survived = vm->gc_stats.total_objects_freed == 0;
+    gc(vm);
+    printf("%ld region objects, %ld promoted, %ld heap objects, heap %d after GC\n",
+           vm->region.allocated, vm->region.promoted,
+           vm->gc_stats.total_objects_allocated, vm->heap_size);
+    
+    int passed = ran && counted && survived && vm->heap_size == 2;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: escaping region objects copied to the heap, the rest freed with the region\n");
+    vm_free(vm);
+}
+
+void test_hash_consing() {
+    // P and Q are equal, so R = (P . 0) and S = (Q . 0) are too. The pair
+    // built inside the region still goes to the heap, dies and is pruned.
+    int program[] = {0x01, 1, 0x01, 2, 0x5a, 0x30, 0,     // memory[0] = P = (1 . 2)
+                     0x01, 1, 0x01, 2, 0x5a, 0x30, 1,     // memory[1] = Q = (1 . 2)
+                     0x31, 0, 0x01, 0, 0x5a,              // R = (P . 0)
+                     0x31, 1, 0x01, 0, 0x5a,              // S = (Q . 0)
+                     0x62, 0x01, 3, 0x01, 4, 0x5a, 0x02, 0x63, // (3 . 4), dropped
+                     0x60,                                // GC
+                     0xff};
+    int mutate[] = {0x01, 1, 0x01, 2, 0x5a, 0x01, 5, 0x53, 0xff};
+    
+    printf("\n=== EXTENSION: Hash-Consed Pairs ===\n");
+    
+    VM *vm = vm_new(program);
+    vm_run(vm);
+    Obj *p = vm->memory[0].as.obj;
+    int shared = p == vm->memory[1].as.obj && vm->stack.sp == 1 &&
+                 vm->stack.data[0].as.obj == vm->stack.data[1].as.obj &&
+                 (p->flags & OBJ_FLAG_INTERNED) && p->as.pair.right.as.i == 2;
+    ConsTable *conses = vm->conses;
+    int counted = conses && conses->lookups == 5 && conses->hits == 2 &&
+                  vm->gc_stats.total_objects_allocated == 3 && vm->region.allocated == 0;
+    int pruned = conses && conses->pruned == 1 && conses->count == 2 && vm->heap_size == 2;
+    printf("%ld lookups, %ld hits, %ld pairs allocated, %ld pruned by GC\n",
+           conses ? conses->lookups : 0, conses ? conses->hits : 0,
+           vm->gc_stats.total_objects_allocated, conses ? conses->pruned : 0);
+    vm_free(vm);
+    
+    // Shared pairs are immutable: SET_LEFT stops the VM before HALT
+    vm = vm_new(mutate);
+    vm_run(vm);
+    int refused = vm->pc == 8;
+    vm_free(vm);
+    
+    int passed = shared && counted && pruned && refused;
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: equal pairs shared, dead ones pruned, mutation refused\n");
+}
+
+void test_native_tables() {
+    // memory[0] = table; puts i -> (i . 1) for i < 100, collects, deletes
+    // the even keys, collects again, then reads the size and keys 7 and 8
+    int program[] = {0x90, 0x30, 0,                              //  0: m0 = TABLE_NEW
+                     0x01, 0, 0x30, 1,                           //  3: m1 = 0
+                     0x31, 0, 0x31, 1, 0x31, 1, 0x01, 1, 0x50,   //  7: table i (i . 1)
+                     0x92, 0x02,                                 // 16: TABLE_PUT
+                     0x31, 1, 0x01, 1, 0x10, 0x30, 1,            // 18: m1 += 1
+                     0x31, 1, 0x01, 100, 0x11, 0x22, 7,          // 25: loop while m1 != 100
+                     0x60,                                       // 32: GC
+                     0x01, 0, 0x30, 1,                           // 33: m1 = 0
+                     0x31, 0, 0x31, 1, 0x93, 0x02,               // 37: TABLE_DELETE
+                     0x31, 1, 0x01, 2, 0x10, 0x30, 1,            // 43: m1 += 2
+                     0x31, 1, 0x01, 100, 0x11, 0x22, 37,         // 50: loop while m1 != 100
+                     0x60,                                       // 57: GC
+                     0x31, 0, 0x94,                              // 58: TABLE_SIZE
+                     0x31, 0, 0x01, 7, 0x91,                     // 61: TABLE_GET 7
+                     0x31, 0, 0x01, 8, 0x91,                     // 66: TABLE_GET 8
+                     0xff};
+    
+    printf("\n=== EXTENSION: Native Hash Tables ===\n");
+    
+    // Once on the mark-sweep heap, once on Immix, where collections move
+    // the table and its bucket vectors
+    int passed = 1;
+    for(int moving = 0; moving < 2; moving++){
+        VM *vm = vm_new(program);
+        if(moving) vm->immix = immix_create();
+        vm_run(vm);
+        Obj *table = vm->memory[0].as.obj;
+        Value size = vm->stack.data[0], seven = vm->stack.data[1], eight = vm->stack.data[2];
+        int found = vm->stack.sp == 2 && size.as.i == 50 && table->as.table.count == 50 &&
+                    seven.type == VAL_OBJ && seven.as.obj->as.pair.left.as.i == 7 &&
+                    eight.type == VAL_INT && eight.as.i == 0;
+        // The 50 deleted pairs are garbage; so is every outgrown bucket vector
+        int freed = vm->gc_stats.total_objects_freed >= 50 + 4;
+        printf("%s: size %d, %d buckets, %ld objects freed\n", moving ? "immix" : "mark-sweep",
+               size.as.i, table->as.table.entries->as.vector.length / 2,
+               vm->gc_stats.total_objects_freed);
+        passed = passed && found && freed;
+        vm_free(vm);
+    }
+    
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: 50 keys left, deleted values collected, lookups intact\n");
+}
+
+void test_interned_strings() {
+    // CONST 0 twice is one object; CONST 1 is kept in memory[0]. "temp" is
+    // interned from C and never reached, so the GC prunes and sweeps it.
+    int program[] = {0x32, 0, 0x32, 0, 0x15,     // SAME "alpha" "alpha"
+                     0x32, 1, 0x30, 0,           // memory[0] = "beta"
+                     0x60,                       // GC
+                     0xff};
+    char *chars[] = {"alpha", "beta"};
+    int lengths[] = {5, 4};
+    ConstantPool pool = {2, chars, lengths};
+    
+    printf("\n=== EXTENSION: Interned Strings ===\n");
+    
+    // On Immix the collection moves the strings; the table must follow
+    int passed = 1;
+    for(int moving = 0; moving < 2; moving++){
+        VM *vm = vm_new(program);
+        if(moving) vm->immix = immix_create();
+        vm_attach_constants(vm, &pool);
+        string_intern(vm, "temp", 4);
+        vm_run(vm);
+        StringTable *strings = vm->strings;
+        Obj *alpha = vm->constants[0];
+        int same = vm->stack.sp == 0 && vm->stack.data[0].as.i == 1 &&
+                   vm->memory[0].as.obj == vm->constants[1] &&
+                   string_intern(vm, "alpha", 5) == alpha &&
+                   alpha->as.string.hash == string_hash("alpha", 5) &&
+                   strcmp(alpha->as.string.chars, "alpha") == 0;
+        int pruned = strings->pruned == 1 && strings->count == 2 && vm->heap_size == 2;
+        printf("%s: %zu strings live, %ld pruned, %d objects on the heap\n",
+               moving ? "immix" : "mark-sweep", strings->count, strings->pruned, vm->heap_size);
+        passed = passed && same && pruned;
+        vm_free(vm);
+    }
+    
+    printf("Result: %s\n", passed ? "PASS ✓" : "FAIL ✗");
+    printf("Expected: one object per string, unreachable ones pruned\n");
+}
+
 int main() {
     
     test_basic_reachability();
@@ -339,6 +1443,34 @@ int main() {
     test_memory_stored_objects();
     test_multiple_memory_objects();
     
+    printf("\n");
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("  EXTENSION TEST CASES\n");
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    
+    test_heap_census();
+    test_heap_snapshot();
+    test_shared_heap_threads();
+    test_shared_heap_census_snapshot();
+    test_bitmap_kernels();
+    test_deep_list_marking();
+    test_paged_heap_decay();
+    test_heap_limit_error();
+    test_weak_and_ephemerons();
+    test_finalization_queue();
+    test_vectors_and_bytes();
+    test_pointer_reversal_marking();
+    test_immix_evacuation();
+    test_immix_census_snapshot();
+    test_copy_order();
+    test_generational_pretenuring();
+    test_allocation_recorder();
+    test_escape_analysis();
+    test_region_allocation();
+    test_hash_consing();
+    test_native_tables();
+    test_interned_strings();
+    
     
     return 0;
 }
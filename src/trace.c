@@ -0,0 +1,99 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+Trace *trace_create(unsigned long capacity, long alloc_sample){
+    // Round capacity up to a power of two so the ring index is a mask
+    unsigned long cap = 1;
+    while(cap < capacity) cap <<= 1;
+
+    Trace *trace = (Trace*)malloc(sizeof(Trace));
+    if(!trace) return NULL;
+    trace->events = (TraceEvent*)calloc(cap, sizeof(TraceEvent));
+    if(!trace->events){
+        free(trace);
+        return NULL;
+    }
+    trace->capacity = cap;
+    trace->head = 0;
+    trace->alloc_sample = alloc_sample > 0 ? alloc_sample : TRACE_DEFAULT_ALLOC_SAMPLE;
+    trace->alloc_countdown = trace->alloc_sample;
+    trace->start_ns = now_ns();
+    return trace;
+}
+
+void trace_destroy(Trace *trace){
+    if(!trace) return;
+    free(trace->events);
+    free(trace);
+}
+
+void trace_event(Trace *trace, const char *name, char phase, int arg){
+    // Claim a slot; when the ring is full the oldest events are overwritten
+    unsigned long slot = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+    TraceEvent *ev = &trace->events[slot & (trace->capacity - 1)];
+    ev->ts_ns = now_ns() - trace->start_ns;
+    ev->name = name;
+    ev->phase = phase;
+    ev->arg = arg;
+}
+
+static void write_event(FILE *fp, const TraceEvent *ev){
+    double ts_us = ev->ts_ns / 1000.0;
+    if(strcmp(ev->name, "call") == 0){
+        // Call spans are keyed by callee address so Perfetto groups them
+        fprintf(fp, "{\"name\":\"fn@%d\",\"cat\":\"vm\",\"ph\":\"%c\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":1,\"args\":{\"callee\":%d}}",
+                ev->arg, ev->phase, ts_us, ev->arg);
+    }
+    else if(ev->phase == TRACE_COUNTER){
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"heap\",\"ph\":\"C\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":1,\"args\":{\"objects\":%d}}",
+                ev->name, ts_us, ev->arg);
+    }
+    else if(ev->phase == TRACE_INSTANT){
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"vm\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":1,\"args\":{\"value\":%d}}",
+                ev->name, ts_us, ev->arg);
+    }
+    else{
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%c\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":1,\"args\":{\"value\":%d}}",
+                ev->name, ev->phase, ts_us, ev->arg);
+    }
+}
+
+int trace_write_json(Trace *trace, const char *path){
+    FILE *fp = fopen(path, "w");
+    if(!fp){
+        perror("failed to open trace file");
+        return -1;
+    }
+
+    unsigned long head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    unsigned long first = head > trace->capacity ? head - trace->capacity : 0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                "\"args\":{\"name\":\"vm\"}}");
+    for(unsigned long i = first; i < head; i++){
+        fprintf(fp, ",\n");
+        write_event(fp, &trace->events[i & (trace->capacity - 1)]);
+    }
+    fprintf(fp, "\n]}\n");
+
+    if(head > trace->capacity){
+        fprintf(stderr, "trace: ring buffer wrapped, dropped %lu oldest events\n",
+                head - trace->capacity);
+    }
+    fclose(fp);
+    return 0;
+}
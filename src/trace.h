@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Chrome trace_event recorder (open the output in ui.perfetto.dev or
+// chrome://tracing). Events are appended to a fixed-size ring buffer while
+// the VM runs and serialized to JSON only when the trace is flushed.
+
+#define TRACE_DEFAULT_CAPACITY 65536   // events kept (power of two)
+#define TRACE_DEFAULT_ALLOC_SAMPLE 256 // heap counter every N allocations
+
+// Trace phases, as defined by the trace_event format
+#define TRACE_BEGIN   'B'
+#define TRACE_END     'E'
+#define TRACE_COUNTER 'C'
+#define TRACE_INSTANT 'i'
+
+typedef struct {
+    long long ts_ns;     // Monotonic timestamp in nanoseconds
+    const char *name;    // Static string, never freed
+    char phase;          // One of the TRACE_* phases
+    int arg;             // Callee address, counter value, ...
+} TraceEvent;
+
+typedef struct Trace {
+    TraceEvent *events;
+    unsigned long capacity;         // Always a power of two
+    unsigned long head;             // Next write slot (updated atomically)
+    long alloc_sample;              // Emit a heap counter every N allocations
+    long alloc_countdown;           // Owned by the VM thread
+    long long start_ns;             // Timestamps are relative to this
+} Trace;
+
+Trace *trace_create(unsigned long capacity, long alloc_sample);
+void trace_destroy(Trace *trace);
+
+// Record one event. Lock-free, so safe to call from the VM's own thread
+// and its signal handlers. A trace belongs to one VM thread: events carry
+// a fixed tid and the allocation countdown is not atomic.
+void trace_event(Trace *trace, const char *name, char phase, int arg);
+
+// Write the buffered events as a trace_event JSON file. Returns 0 on success.
+int trace_write_json(Trace *trace, const char *path);
+
+#endif
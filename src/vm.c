@@ -1,42 +1,115 @@
 #include "vm.h"
 #include<stdio.h>
+#include<stdlib.h>
 #include "value.h"
 #include "object.h"
+#include "snapshot.h"
+#include "heap.h"
+#include "immix.h"
+#include "opcodes.h"
 
-#define OP_PUSH 0x01
-#define OP_POP 0x02
-#define OP_DUP 0x03
-#define OP_ADD 0x10
-#define OP_SUB 0x11
-#define OP_MUL 0x12
-#define OP_DIV 0x13
-#define OP_CMP 0x14
-#define OP_HALT 0xff
-#define OP_JMP  0x20
-#define OP_JZ   0x21
-#define OP_JNZ  0x22
-#define OP_STORE 0x30
-#define OP_LOAD  0x31
-#define OP_CALL 0x40
-#define OP_RET 0x41
-#define OP_NEW_PAIR 0x50    // New: create a pair from top two stack values
-#define OP_PAIR_LEFT 0x51   // New: get left value from pair
-#define OP_PAIR_RIGHT 0x52  // New: get right value from pair
-#define OP_SET_LEFT 0x53    // New: set left value of pair
-#define OP_SET_RIGHT 0x54   // New: set right value of pair
-#define OP_GC 0x60          // New: explicit GC trigger
-
+const char *vm_opcode_name(int opcode){
+    switch(opcode){
+        case OP_PUSH: return "PUSH";
+        case OP_POP: return "POP";
+        case OP_DUP: return "DUP";
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_CMP: return "CMP";
+        case OP_SAME: return "SAME";
+        case OP_HALT: return "HALT";
+        case OP_JMP: return "JMP";
+        case OP_JZ: return "JZ";
+        case OP_JNZ: return "JNZ";
+        case OP_STORE: return "STORE";
+        case OP_LOAD: return "LOAD";
+        case OP_CONST: return "CONST";
+        case OP_CALL: return "CALL";
+        case OP_RET: return "RET";
+        case OP_NEW_PAIR: return "NEW_PAIR";
+        case OP_PAIR_LEFT: return "PAIR_LEFT";
+        case OP_PAIR_RIGHT: return "PAIR_RIGHT";
+        case OP_SET_LEFT: return "SET_LEFT";
+        case OP_SET_RIGHT: return "SET_RIGHT";
+        case OP_NEW_WEAK: return "NEW_WEAK";
+        case OP_NEW_EPHEMERON: return "NEW_EPHEMERON";
+        case OP_WEAK_GET: return "WEAK_GET";
+        case OP_EPHEMERON_VALUE: return "EPHEMERON_VALUE";
+        case OP_NEW_LOCAL_PAIR: return "NEW_LOCAL_PAIR";
+        case OP_CONS_SHARED: return "CONS_SHARED";
+        case OP_GC: return "GC";
+        case OP_SNAPSHOT: return "SNAPSHOT";
+        case OP_REGION_BEGIN: return "REGION_BEGIN";
+        case OP_REGION_END: return "REGION_END";
+        case OP_NEW_VECTOR: return "NEW_VECTOR";
+        case OP_NEW_BYTES: return "NEW_BYTES";
+        case OP_ARRAY_GET: return "ARRAY_GET";
+        case OP_ARRAY_SET: return "ARRAY_SET";
+        case OP_ARRAY_LEN: return "ARRAY_LEN";
+        case OP_TABLE_NEW: return "TABLE_NEW";
+        case OP_TABLE_GET: return "TABLE_GET";
+        case OP_TABLE_PUT: return "TABLE_PUT";
+        case OP_TABLE_DELETE: return "TABLE_DELETE";
+        case OP_TABLE_SIZE: return "TABLE_SIZE";
+        case OP_TRY: return "TRY";
+        case OP_END_TRY: return "END_TRY";
+        default: return "?";
+    }
+}
 
 void vm_init(VM *vm,int *bytecode){
     init_stack(&vm->stack);
     vm->bytecode = bytecode;
+    vm->local_pairs = NULL;
+    vm->scratch = NULL;
+    region_init(&vm->region);
+    vm->conses = NULL;
+    vm->strings = NULL;
+    vm->constant_pool = NULL;
+    vm->constants = NULL;
     vm->pc = 0;
     vm->running = 1;
     vm->rsp = -1;
     vm->instruction_count = 0;
     vm->heap_head = NULL;
+    vm->large_head = NULL;
     vm->heap_size = 0;
+    vm->heap_bytes = 0;
     vm->gc_threshold = 100;
+    vm->mark_prefetch = MARK_PREFETCH_DEPTH;
+    vm->mark_stack_budget = 0;
+    vm->copy_order = COPY_ORDER_BREADTH;
+    vm->generational = 0;
+    vm->mature_head = NULL;
+    vm->young_size = 0;
+    vm->mature_size = 0;
+    vm->nursery_size = GEN_NURSERY_OBJECTS;
+    vm->major_threshold = GEN_NURSERY_OBJECTS * 4;
+    vm->remembered = NULL;
+    vm->remembered_count = 0;
+    vm->remembered_capacity = 0;
+    vm->pretenure = NULL;
+    vm->max_heap_bytes = 0;
+    vm->try_depth = 0;
+    vm->error = VM_OK;
+    vm->finalizers = (FinalizerList){NULL, 0, 0};
+    vm->finalize_queue = (FinalizerList){NULL, 0, 0};
+    vm->finalize_head = 0;
+    vm->in_finalizer = 0;
+    vm->trace = NULL;
+    vm->profiler = NULL;
+    vm->census = NULL;
+    vm->recorder = NULL;
+    vm->immix = NULL;
+    vm->shared = NULL;
+    vm->tlab_cursor = NULL;
+    vm->tlab_limit = NULL;
+    vm->mutator_running = 0;
+    vm->snapshot_prefix = NULL;
+    vm->snapshot_seq = 0;
+    vm->snapshot_requested = 0;
     
     // Initialize performance statistics
     vm->gc_stats.total_gc_calls = 0;
@@ -47,6 +120,18 @@ void vm_init(VM *vm,int *bytecode){
     vm->gc_stats.min_gc_pause = 0.0;
     vm->gc_stats.max_heap_size = 0;
     vm->gc_stats.bytes_allocated = 0;
+    vm->gc_stats.emergency_gcs = 0;
+    vm->gc_stats.failed_allocations = 0;
+    vm->gc_stats.weak_cleared = 0;
+    vm->gc_stats.dsw_marked = 0;
+    vm->gc_stats.finalizers_queued = 0;
+    vm->gc_stats.finalizers_run = 0;
+    vm->gc_stats.finalize_queue_max = 0;
+    vm->gc_stats.total_finalize_time = 0.0;
+    vm->gc_stats.minor_gcs = 0;
+    vm->gc_stats.objects_promoted = 0;
+    vm->gc_stats.objects_pretenured = 0;
+    vm->gc_stats.remembered_max = 0;
     
     for(int i=0;i<MEM_SIZE;i++){
         vm->memory[i] = make_int_value(0); //clear the memory with Value type
@@ -54,15 +139,132 @@ void vm_init(VM *vm,int *bytecode){
     }
 }
 
+// A VM owns nothing global: its heap, roots and instrumentation hang off the
+// struct, so any number of VMs can run concurrently on different threads.
+VM *vm_new(int *bytecode){
+    VM *vm = (VM*)malloc(sizeof(VM));
+    if(!vm) return NULL;
+    vm_init(vm, bytecode);
+    return vm;
+}
+
+void vm_free(VM *vm){
+    if(!vm) return;
+    finalizer_list_free(&vm->finalizers);
+    finalizer_list_free(&vm->finalize_queue);
+    free(vm->scratch);
+    region_destroy(&vm->region);
+    cons_table_destroy(vm->conses);
+    string_table_destroy(vm->strings);
+    free(vm->constants);
+    if(vm->shared){
+        // Objects may be reachable from other VMs; the next sweep decides
+        heap_detach(vm);
+        free(vm);
+        return;
+    }
+    Obj *lists[3] = {vm->heap_head, vm->mature_head, vm->large_head};
+    for(int i = 0; i < 3; i++){
+        Obj *obj = lists[i];
+        while(obj){
+            Obj *next = obj->next;
+            free_object(vm, obj);
+            obj = next;
+        }
+    }
+    vm->heap_head = NULL;
+    vm->mature_head = NULL;
+    vm->large_head = NULL;
+    vm->heap_size = 0;
+    free(vm->remembered);
+    pretenure_destroy(vm->pretenure);
+    immix_destroy(vm->immix);
+    free(vm);
+}
+
+const char *vm_error_name(VMError error){
+    switch(error){
+        case VM_OK: return "no error";
+        case VM_ERROR_OUT_OF_MEMORY: return "out of memory";
+        case VM_ERROR_INDEX_OUT_OF_RANGE: return "index out of range";
+        default: return "unknown error";
+    }
+}
+
+void vm_raise(VM *vm, VMError error){
+    if(vm->try_depth == 0){
+        printf("Runtime error: %s\n", vm_error_name(error));
+        vm->error = error;
+        vm->running = 0;
+        return;
+    }
+    TryFrame *frame = &vm->try_stack[--vm->try_depth];
+    if(vm->trace){
+        for(int i = vm->rsp; i > frame->rsp; i--){
+            trace_event(vm->trace, "call", TRACE_END, vm->call_targets[i]);
+        }
+    }
+    vm->stack.sp = frame->sp;
+    vm->rsp = frame->rsp;
+    // Regions opened inside the TRY end with it. If the heap has no room
+    // for what they leave on the stack, the region stays open instead.
+    while(vm->region.depth > frame->region_depth){
+        if(region_end(vm) != 0) break;
+    }
+    push(&vm->stack, make_int_value(error));
+    vm->pc = frame->handler;
+}
+
+// Region barrier (region.h) for storing the top of the stack into the
+// object at container_slot. Runs before either is popped, so both stay
+// rooted if promotion collects. Returns 0 if it raised out of memory.
+static int store_barrier(VM *vm, int container_slot){
+    Value container = vm->stack.data[container_slot];
+    if(container.type != VAL_OBJ || (container.as.obj->flags & (OBJ_FLAG_LOCAL | OBJ_FLAG_REGION))){
+        return 1;
+    }
+    if(region_barrier(vm, &vm->stack.data[vm->stack.sp]) == 0) return 1;
+    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+    return 0;
+}
+
+// Element count of a vector or byte array; 0 if val is neither
+static int array_length(Value val, int *length){
+    if(val.type != VAL_OBJ) return 0;
+    if(val.as.obj->type == OBJ_VECTOR) *length = val.as.obj->as.vector.length;
+    else if(val.as.obj->type == OBJ_BYTES) *length = val.as.obj->as.bytes.length;
+    else return 0;
+    return 1;
+}
+
+static int is_table(Value val){
+    return val.type == VAL_OBJ && val.as.obj->type == OBJ_TABLE;
+}
+
+// Ints, and strings by their cached hash (table.h)
+static int is_table_key(Value val){
+    return val.type == VAL_INT || val.as.obj->type == OBJ_STRING;
+}
+
 void vm_run(VM *vm){
+    if(vm->shared) heap_enter(vm);
     while(vm->running){
         int instruction = vm->bytecode[vm->pc++];
         vm->instruction_count++;
+        if(vm->profiler) profile_instruction(vm->profiler, vm, vm->pc - 1, instruction);
+        if(vm->recorder) recorder_sync_stack(vm->recorder, &vm->stack);
         
         // Trigger GC when heap size exceeds threshold
-        if(vm->heap_size >= vm->gc_threshold) {
-            gc(vm);
-            vm->gc_threshold = vm->heap_size * 2 + 100; // Grow threshold
+        gc_collect_if_needed(vm);
+
+        if(vm->snapshot_requested){
+            vm->snapshot_requested = 0;
+            heap_snapshot_next(vm);
+        }
+
+        // Finalizers run here, in small batches, not in the GC pause
+        if(vm->finalize_head < vm->finalize_queue.count){
+            vm_run_finalizers(vm, FINALIZER_BATCH);
         }
         
         switch(instruction){
@@ -116,6 +318,15 @@ void vm_run(VM *vm){
                 else push(&vm->stack,make_int_value(0));
                 break;
             }
+            case OP_SAME:{
+                // Strings are interned, so equal strings are the same object
+                Value b = pop(&vm->stack);
+                Value a = pop(&vm->stack);
+                int same = a.type == b.type &&
+                           (a.type == VAL_OBJ ? a.as.obj == b.as.obj : a.as.i == b.as.i);
+                push(&vm->stack, make_int_value(same));
+                break;
+            }
             case OP_HALT:{
                 vm->running = 0;
                 break;
@@ -139,6 +350,11 @@ void vm_run(VM *vm){
             }
             case OP_STORE:{
                 int index = vm->bytecode[vm->pc++];
+                // Memory outlives any region
+                if(vm->stack.sp >= 0 && region_barrier(vm, &vm->stack.data[vm->stack.sp]) != 0){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
                 Value top = pop(&vm->stack);
                 if(index>=MEM_SIZE){
                     printf("Memory Overflow\n");
@@ -147,6 +363,7 @@ void vm_run(VM *vm){
                 }
                 vm->memory[index] = top;  // Store the whole Value (int or object)
                 vm->valid[index] = 1;
+                if(vm->recorder) recorder_memory(vm->recorder, index, top);
                 break;
             }
             case OP_LOAD:{
@@ -160,14 +377,35 @@ void vm_run(VM *vm){
                 push(&vm->stack, value);
                 break;
             }
+            case OP_CONST:{
+                int index = vm->bytecode[vm->pc++];
+                const ConstantPool *pool = vm->constant_pool;
+                if(!pool || index < 0 || index >= pool->count){
+                    printf("Runtime error: no constant %d\n", index);
+                    vm->running = 0;
+                    break;
+                }
+                if(!vm->constants[index]){
+                    Obj *string = string_intern(vm, pool->chars[index], pool->lengths[index]);
+                    if(!string){
+                        vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                        break;
+                    }
+                    vm->constants[index] = string;
+                }
+                push(&vm->stack, make_obj_value(vm->constants[index]));
+                break;
+            }
             case OP_CALL:{
                 int address = vm->bytecode[vm->pc++];
-                if(vm->rsp>=RET_STACK_SIZE){
+                if(vm->rsp>=RET_STACK_SIZE-1){
                     printf("Return Stack Overflow\n");
                     vm->running = 0;
                     break;
                 }
                 vm->ret_stack[++vm->rsp] = vm->pc;
+                vm->call_targets[vm->rsp] = address;
+                if(vm->trace) trace_event(vm->trace, "call", TRACE_BEGIN, address);
                 vm->pc = address;
                 break;
             }
@@ -177,14 +415,56 @@ void vm_run(VM *vm){
                     vm->running = 0;
                     break;
                 }
+                if(vm->trace) trace_event(vm->trace, "call", TRACE_END, vm->call_targets[vm->rsp]);
                 vm->pc = vm->ret_stack[vm->rsp--];
                 break;
             }
             case OP_NEW_PAIR:{
-                // Pop right, then left from stack
-                Value right = pop(&vm->stack);
-                Value left = pop(&vm->stack);
+                // Left and right stay on the stack while allocating: under
+                // a heap limit the allocation may run an emergency GC
+                if(vm->stack.sp < 1){
+                    pop(&vm->stack);
+                    pop(&vm->stack);
+                }
+                Value right = vm->stack.data[vm->stack.sp];
+                Value left = vm->stack.data[vm->stack.sp - 1];
                 Obj *pair = new_pair(vm, left, right);
+                if(!pair){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                vm->stack.sp -= 2;
+                push(&vm->stack, make_obj_value(pair));
+                break;
+            }
+            case OP_NEW_LOCAL_PAIR:{
+                // A NEW_PAIR whose pair never leaves its basic block
+                // (escape.c): no allocation, so no GC and no error
+                Obj *pair = &vm->scratch[vm->local_pairs->slot_of[vm->pc - 1]];
+                pair->as.pair.right = pop(&vm->stack);
+                pair->as.pair.left = pop(&vm->stack);
+                push(&vm->stack, make_obj_value(pair));
+                break;
+            }
+            case OP_CONS_SHARED:{
+                if(vm->stack.sp < 1){
+                    pop(&vm->stack);
+                    pop(&vm->stack);
+                }
+                // Hash-consed pairs live on the heap, outside any region
+                if(region_barrier(vm, &vm->stack.data[vm->stack.sp - 1]) != 0 ||
+                   region_barrier(vm, &vm->stack.data[vm->stack.sp]) != 0){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                Value right = vm->stack.data[vm->stack.sp];
+                Value left = vm->stack.data[vm->stack.sp - 1];
+                Obj *pair = cons_shared(vm, left, right);
+                if(!pair){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                vm->stack.sp -= 2;
                 push(&vm->stack, make_obj_value(pair));
                 break;
             }
@@ -219,6 +499,7 @@ void vm_run(VM *vm){
                 break;
             }
             case OP_SET_LEFT:{
+                if(vm->stack.sp >= 1 && !store_barrier(vm, vm->stack.sp - 1)) break;
                 Value new_val = pop(&vm->stack);
                 Value pair_val = pop(&vm->stack);
                 if(pair_val.type != VAL_OBJ){
@@ -231,11 +512,19 @@ void vm_run(VM *vm){
                     vm->running = 0;
                     break;
                 }
+                if(pair_val.as.obj->flags & OBJ_FLAG_INTERNED){
+                    printf("Runtime error: SET_LEFT on a hash-consed pair\n");
+                    vm->running = 0;
+                    break;
+                }
                 pair_val.as.obj->as.pair.left = new_val;
+                gc_write_barrier(vm, pair_val.as.obj, new_val);
+                if(vm->recorder) recorder_field(vm->recorder, pair_val.as.obj, 0, new_val);
                 push(&vm->stack, pair_val); // Push pair back
                 break;
             }
             case OP_SET_RIGHT:{
+                if(vm->stack.sp >= 1 && !store_barrier(vm, vm->stack.sp - 1)) break;
                 Value new_val = pop(&vm->stack);
                 Value pair_val = pop(&vm->stack);
                 if(pair_val.type != VAL_OBJ){
@@ -248,17 +537,272 @@ void vm_run(VM *vm){
                     vm->running = 0;
                     break;
                 }
+                if(pair_val.as.obj->flags & OBJ_FLAG_INTERNED){
+                    printf("Runtime error: SET_RIGHT on a hash-consed pair\n");
+                    vm->running = 0;
+                    break;
+                }
                 pair_val.as.obj->as.pair.right = new_val;
+                gc_write_barrier(vm, pair_val.as.obj, new_val);
+                if(vm->recorder) recorder_field(vm->recorder, pair_val.as.obj, 1, new_val);
                 push(&vm->stack, pair_val); // Push pair back
                 break;
             }
+            case OP_NEW_WEAK:{
+                // The referent stays on the stack while allocating. Weak
+                // refs live on the heap, so it cannot be a region object.
+                if(vm->stack.sp >= 0 && region_barrier(vm, &vm->stack.data[vm->stack.sp]) != 0){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                Value target = peek(&vm->stack);
+                if(target.type != VAL_OBJ){
+                    printf("Runtime error: NEW_WEAK expects object\n");
+                    vm->running = 0;
+                    break;
+                }
+                Obj *weak = new_weak(vm, target.as.obj);
+                if(!weak){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                vm->stack.sp--;
+                push(&vm->stack, make_obj_value(weak));
+                break;
+            }
+            case OP_NEW_EPHEMERON:{
+                if(vm->stack.sp < 1){
+                    pop(&vm->stack);
+                    pop(&vm->stack);
+                }
+                // Ephemerons live on the heap: promote region key and value
+                if(region_barrier(vm, &vm->stack.data[vm->stack.sp - 1]) != 0 ||
+                   region_barrier(vm, &vm->stack.data[vm->stack.sp]) != 0){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                Value value = vm->stack.data[vm->stack.sp];
+                Value key = vm->stack.data[vm->stack.sp - 1];
+                if(key.type != VAL_OBJ){
+                    printf("Runtime error: NEW_EPHEMERON expects object key\n");
+                    vm->running = 0;
+                    break;
+                }
+                Obj *eph = new_ephemeron(vm, key.as.obj, value);
+                if(!eph){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                vm->stack.sp -= 2;
+                push(&vm->stack, make_obj_value(eph));
+                break;
+            }
+            case OP_WEAK_GET:{
+                Value val = pop(&vm->stack);
+                if(val.type != VAL_OBJ ||
+                   (val.as.obj->type != OBJ_WEAK && val.as.obj->type != OBJ_EPHEMERON)){
+                    printf("Runtime error: WEAK_GET expects weak reference or ephemeron\n");
+                    vm->running = 0;
+                    break;
+                }
+                Obj *target = val.as.obj->type == OBJ_WEAK ? val.as.obj->as.weak.referent
+                                                           : val.as.obj->as.ephemeron.key;
+                push(&vm->stack, target ? make_obj_value(target) : make_int_value(0));
+                break;
+            }
+            case OP_EPHEMERON_VALUE:{
+                Value val = pop(&vm->stack);
+                if(val.type != VAL_OBJ || val.as.obj->type != OBJ_EPHEMERON){
+                    printf("Runtime error: EPHEMERON_VALUE expects ephemeron\n");
+                    vm->running = 0;
+                    break;
+                }
+                push(&vm->stack, val.as.obj->as.ephemeron.value);
+                break;
+            }
+            case OP_NEW_VECTOR:
+            case OP_NEW_BYTES:{
+                Value length = pop(&vm->stack);
+                if(length.type != VAL_INT){
+                    printf("Runtime error: %s expects integer length\n", vm_opcode_name(instruction));
+                    vm->running = 0;
+                    break;
+                }
+                if(length.as.i < 0){
+                    vm_raise(vm, VM_ERROR_INDEX_OUT_OF_RANGE);
+                    break;
+                }
+                Obj *array = instruction == OP_NEW_VECTOR ? new_vector(vm, length.as.i)
+                                                          : new_bytes(vm, length.as.i);
+                if(!array){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                push(&vm->stack, make_obj_value(array));
+                break;
+            }
+            case OP_ARRAY_GET:{
+                Value index = pop(&vm->stack);
+                Value array = pop(&vm->stack);
+                int length;
+                if(!array_length(array, &length) || index.type != VAL_INT){
+                    printf("Runtime error: ARRAY_GET expects array and integer index\n");
+                    vm->running = 0;
+                    break;
+                }
+                if(index.as.i < 0 || index.as.i >= length){
+                    vm_raise(vm, VM_ERROR_INDEX_OUT_OF_RANGE);
+                    break;
+                }
+                Obj *obj = array.as.obj;
+                if(obj->type == OBJ_VECTOR) push(&vm->stack, obj->as.vector.items[index.as.i]);
+                else push(&vm->stack, make_int_value(obj->as.bytes.data[index.as.i]));
+                break;
+            }
+            case OP_ARRAY_SET:{
+                if(vm->stack.sp >= 2 && !store_barrier(vm, vm->stack.sp - 2)) break;
+                Value new_val = pop(&vm->stack);
+                Value index = pop(&vm->stack);
+                Value array = pop(&vm->stack);
+                int length;
+                if(!array_length(array, &length) || index.type != VAL_INT){
+                    printf("Runtime error: ARRAY_SET expects array and integer index\n");
+                    vm->running = 0;
+                    break;
+                }
+                if(index.as.i < 0 || index.as.i >= length){
+                    vm_raise(vm, VM_ERROR_INDEX_OUT_OF_RANGE);
+                    break;
+                }
+                Obj *obj = array.as.obj;
+                if(obj->type == OBJ_VECTOR){
+                    obj->as.vector.items[index.as.i] = new_val;
+                    gc_write_barrier(vm, obj, new_val);
+                    if(vm->recorder) recorder_field(vm->recorder, obj, index.as.i, new_val);
+                }
+                else if(new_val.type == VAL_INT) obj->as.bytes.data[index.as.i] = (unsigned char)new_val.as.i;
+                else{
+                    printf("Runtime error: ARRAY_SET on bytes expects integer\n");
+                    vm->running = 0;
+                    break;
+                }
+                push(&vm->stack, array); // Push array back
+                break;
+            }
+            case OP_ARRAY_LEN:{
+                Value array = pop(&vm->stack);
+                int length;
+                if(!array_length(array, &length)){
+                    printf("Runtime error: ARRAY_LEN expects vector or bytes\n");
+                    vm->running = 0;
+                    break;
+                }
+                push(&vm->stack, make_int_value(length));
+                break;
+            }
+            case OP_TABLE_NEW:{
+                Obj *table = new_table(vm);
+                if(!table){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                push(&vm->stack, make_obj_value(table));
+                break;
+            }
+            case OP_TABLE_GET:
+            case OP_TABLE_DELETE:{
+                Value key = pop(&vm->stack);
+                Value table = pop(&vm->stack);
+                if(!is_table(table) || !is_table_key(key)){
+                    printf("Runtime error: %s expects table and int or string key\n", vm_opcode_name(instruction));
+                    vm->running = 0;
+                    break;
+                }
+                if(instruction == OP_TABLE_DELETE){
+                    table_delete(vm, table.as.obj, key);
+                    push(&vm->stack, table);
+                    break;
+                }
+                Value value;
+                push(&vm->stack, table_get(table.as.obj, key, &value) ? value : make_int_value(0));
+                break;
+            }
+            case OP_TABLE_PUT:{
+                if(vm->stack.sp >= 2 && !store_barrier(vm, vm->stack.sp - 2)) break;
+                if(vm->stack.sp < 2){
+                    pop(&vm->stack);
+                    pop(&vm->stack);
+                    pop(&vm->stack);
+                    break;
+                }
+                // Table, key and value stay on the stack while the table
+                // grows, so a collection sees (and updates) them
+                Value *args = &vm->stack.data[vm->stack.sp - 2];
+                if(!is_table(args[0]) || !is_table_key(args[1])){
+                    printf("Runtime error: TABLE_PUT expects table and int or string key\n");
+                    vm->running = 0;
+                    break;
+                }
+                if(table_put(vm, args) != 0){
+                    vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                    break;
+                }
+                vm->stack.sp -= 2;
+                break;
+            }
+            case OP_TABLE_SIZE:{
+                Value table = pop(&vm->stack);
+                if(!is_table(table)){
+                    printf("Runtime error: TABLE_SIZE expects table\n");
+                    vm->running = 0;
+                    break;
+                }
+                push(&vm->stack, make_int_value(table.as.obj->as.table.count));
+                break;
+            }
             case OP_GC:{
                 gc(vm);
                 break;
             }
+            case OP_SNAPSHOT:{
+                heap_snapshot_next(vm);
+                break;
+            }
+            case OP_REGION_BEGIN:{
+                region_begin(vm);
+                break;
+            }
+            case OP_REGION_END:{
+                if(vm->region.depth == 0){
+                    printf("Runtime error: REGION_END without REGION_BEGIN\n");
+                    vm->running = 0;
+                    break;
+                }
+                if(region_end(vm) != 0) vm_raise(vm, VM_ERROR_OUT_OF_MEMORY);
+                break;
+            }
+            case OP_TRY:{
+                int handler = vm->bytecode[vm->pc++];
+                if(vm->try_depth >= TRY_STACK_SIZE){
+                    printf("Try Stack Overflow\n");
+                    vm->running = 0;
+                    break;
+                }
+                TryFrame *frame = &vm->try_stack[vm->try_depth++];
+                frame->handler = handler;
+                frame->sp = vm->stack.sp;
+                frame->rsp = vm->rsp;
+                frame->region_depth = vm->region.depth;
+                break;
+            }
+            case OP_END_TRY:{
+                if(vm->try_depth > 0) vm->try_depth--;
+                break;
+            }
             default:
                printf("Unknown Instruction %d\n",instruction);
                vm->running = 0;
         }
     }
+    if(vm->shared) heap_leave(vm);
 }
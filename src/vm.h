@@ -3,9 +3,27 @@
 
 #include "stack.h"
 #include "object.h"
+#include "trace.h"
+#include "profile.h"
+#include "census.h"
+#include "finalize.h"
+#include "pretenure.h"
+#include "recorder.h"
+#include "escape.h"
+#include "region.h"
+#include "cons.h"
+#include "table.h"
+#include "intern.h"
+
+struct SharedHeap;
+struct ImmixSpace;
 
 #define MEM_SIZE 1024
 #define RET_STACK_SIZE 1024
+#define TRY_STACK_SIZE 64
+#define MARK_FIFO_SIZE 16         // Longest marking prefetch queue (power of two)
+#define MARK_PREFETCH_DEPTH 8     // Default queue length; 0 disables prefetching
+#define GEN_NURSERY_OBJECTS 4096  // Generational heap: young objects per minor collection
 
 // Performance statistics structure
 typedef struct {
@@ -17,36 +35,154 @@ typedef struct {
     double min_gc_pause;           // Shortest GC pause (seconds)
     int max_heap_size;             // Peak heap size
     long bytes_allocated;          // Total bytes allocated
+    long emergency_gcs;            // Collections forced by the heap limit
+    long failed_allocations;       // Allocations refused after an emergency GC
+    long weak_cleared;             // Weak refs and ephemerons cleared
+    long dsw_marked;               // Objects marked by pointer reversal
+    long finalizers_queued;        // Dead finalizable objects queued
+    long finalizers_run;           // Finalizers executed
+    int finalize_queue_max;        // Deepest the finalization queue got
+    double total_finalize_time;    // Time in finalizers, outside GC pauses
+    long minor_gcs;                // Generational heap: nursery-only collections
+    long objects_promoted;         // Young objects that survived into the mature space
+    long objects_pretenured;       // Allocated straight into the mature space
+    int remembered_max;            // Largest remembered set at a minor collection
 } GCStats;
 
+// Errors raised inside the VM. TRY installs a handler that receives the
+// error code on the stack; an uncaught error stops the VM (not the process)
+// and is left in vm->error.
+typedef enum {
+    VM_OK = 0,
+    VM_ERROR_OUT_OF_MEMORY = 1,        // Heap limit reached even after an emergency GC
+    VM_ERROR_INDEX_OUT_OF_RANGE = 2    // Vector/bytes index or length out of range
+} VMError;
+
+// Where evacuation (vm->immix) puts the objects it copies
+typedef enum {
+    COPY_ORDER_BREADTH = 0,   // An object's children are copied together when
+                              // it is scanned, so siblings end up adjacent
+    COPY_ORDER_DEPTH = 1      // Copied when popped off the mark stack, right
+                              // field first: a list tail lands next to its cell
+} CopyOrder;
+
+typedef struct {
+    int handler;        // pc of the handler
+    int sp;             // Operand stack depth to restore
+    int rsp;            // Call depth to restore
+    int region_depth;   // Region nesting to restore (regions opened since end)
+} TryFrame;
+
 typedef struct VM{
     Stack stack;
     int *bytecode;
+    // Escape analysis (escape.h): NEW_LOCAL_PAIR at pc fills
+    // scratch[local_pairs->slot_of[pc]] instead of allocating
+    const LocalPairs *local_pairs;
+    Obj *scratch;
+    Region region;      // REGION_BEGIN/REGION_END allocation region (region.h)
+    ConsTable *conses;  // CONS_SHARED pairs (cons.h); NULL until first used
+    StringTable *strings;   // Interned strings (intern.h); NULL until first used
+    const ConstantPool *constant_pool;  // CONST operands (intern.h); may be NULL
+    Obj **constants;    // Interned constant_pool entries, NULL until first CONST
     int pc;
     int running; // is vm running?
     Value memory[MEM_SIZE];        // Changed from int to Value!
     int valid[MEM_SIZE]; // is the current value stored is valid or not
     int ret_stack[RET_STACK_SIZE];
+    int call_targets[RET_STACK_SIZE]; // Callee address of each active frame
     int rsp;
     long instruction_count;
 
     Obj *heap_head;
-    int heap_size;      // Current number of objects on heap
+    Obj *large_head;    // Large-object space: objects of LARGE_OBJECT_BYTES and up
+    int heap_size;      // Current number of objects on heap (both lists)
+    long heap_bytes;    // Bytes those objects occupy
     int gc_threshold;   // Trigger GC when heap_size reaches this
+    int mark_prefetch;  // Marking prefetch queue length (MARK_PREFETCH_DEPTH)
+    int mark_stack_budget; // Mark stack entries before marking falls back to
+                           // pointer reversal (constant space); 0 = unlimited
+    CopyOrder copy_order;  // Placement of evacuated objects (Immix heap only)
+    long max_heap_bytes; // Heap ceiling, 0 = unlimited. With a limit, any
+                         // allocation may collect, so C callers must keep
+                         // their objects rooted across allocations.
+
+    TryFrame try_stack[TRY_STACK_SIZE];
+    int try_depth;
+    VMError error;      // Uncaught error that stopped the VM
+
+    // Generational mode (private malloc heap only). heap_head is then the
+    // nursery; survivors of a minor collection move to mature_head, which
+    // only major collections (gc()) sweep. Large objects count as mature.
+    int generational;
+    Obj *mature_head;
+    int young_size;         // Objects on heap_head
+    int mature_size;        // Objects on mature_head and large_head
+    int nursery_size;       // Minor collection when young_size reaches this
+    int major_threshold;    // Major collection when mature_size reaches this
+    Obj **remembered;       // Mature objects written with young pointers
+    int remembered_count;
+    int remembered_capacity;
+    Pretenure *pretenure;   // Per-site pretenuring (NULL = everything starts young)
+
+    // Finalization (finalize.h)
+    FinalizerList finalizers;       // Registered objects, not yet found dead
+    FinalizerList finalize_queue;   // Dead objects awaiting their finalizer (roots)
+    int finalize_head;              // First entry of finalize_queue not yet run
+    int in_finalizer;
     
     // Performance tracking
     GCStats gc_stats;
+    Trace *trace;       // Optional trace_event recorder (NULL = disabled)
+    Profiler *profiler; // Optional bytecode profiler (NULL = disabled)
+    Census *census;     // Optional allocation-site census (NULL = disabled)
+    Recorder *recorder; // Optional allocation/mutation recorder (NULL = disabled)
+
+    // Mark-region heap (immix.h) for objects below LARGE_OBJECT_BYTES;
+    // NULL = one malloc per object. Only for private heaps.
+    struct ImmixSpace *immix;
+
+    // Shared heap (heap.h); NULL when the VM owns a private malloc heap
+    struct SharedHeap *shared;
+    Obj *tlab_cursor;       // Thread-local allocation buffer: free slots
+    Obj *tlab_limit;        // [tlab_cursor, tlab_limit) in one heap page
+    int mutator_running;    // Inside vm_run, so counted by safepoints
+
+    // Heap snapshots (SNAPSHOT opcode, heap_snapshot_next() or a signal)
+    const char *snapshot_prefix;
+    int snapshot_seq;
+    volatile int snapshot_requested;  // Set asynchronously, e.g. by SIGUSR1
 }VM;
 
 void vm_init(VM *vm,int *bytecode);
+VM *vm_new(int *bytecode);   // Heap-allocated, initialized VM (NULL if out of memory)
+void vm_free(VM *vm);        // Frees every object on the VM's heap, then the VM
 void vm_run(VM *vm);
 void gc(VM *vm); // GC entry point
+void gc_minor(VM *vm); // Nursery-only collection (generational mode; else gc())
+// Generational write barrier: call after storing value into a field of obj
+void gc_write_barrier(VM *vm, Obj *obj, Value value);
+void gc_collect_if_needed(VM *vm); // Collect once heap_size reaches gc_threshold
 void mark_roots(VM *vm);
+const char *vm_opcode_name(int opcode);
+void vm_raise(VM *vm, VMError error);   // Unwind to the innermost TRY, or stop
+const char *vm_error_name(VMError error);
 
-// Object allocation
+// Object allocation (NULL when the heap limit is hit even after an emergency GC)
 Obj *new_pair(VM *vm, Value left, Value right);
 Obj *new_function(VM *vm, int address, int arity);
 Obj *new_closure(VM *vm, Obj *function, Obj *env);
+Obj *new_weak(VM *vm, Obj *referent);
+Obj *new_ephemeron(VM *vm, Obj *key, Value value);
+Obj *new_vector(VM *vm, int length);    // Elements start as int 0
+Obj *new_bytes(VM *vm, int length);     // Zero-filled
+Obj *new_table(VM *vm);                 // Empty; see table.h
+// Not interned: use string_intern() (intern.h)
+Obj *new_string(VM *vm, const char *chars, int length, unsigned int hash);
+void free_object(VM *vm, Obj *obj);
+size_t object_size(Obj *obj);           // Bytes occupied, header included
+// malloc below LARGE_OBJECT_BYTES, a private mapping at or above it
+Obj *alloc_object_memory(size_t size);
 
 // Performance reporting
 void print_gc_stats(VM *vm);
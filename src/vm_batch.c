@@ -0,0 +1,213 @@
+/* Batch driver: runs many bytecode programs on a pool of worker threads,
+ * one private VM (and heap, and collector) per job.
+ *
+ *   ./vm_batch -j 8 --repeat 16 benchmark/fib.bc benchmark/tree_build.bc
+ *
+ * Jobs are (program, repeat) pairs handed out through an atomic counter,
+ * so workers never block on each other. Reports per-program results and
+ * the aggregate throughput; compare wall time against a -j 1 run for the
+ * real speedup.
+ *
+ * With --shared every VM is attached to one SharedHeap (heap.h): workers
+ * allocate from thread-local buffers and stop together at safepoints for
+ * each collection, instead of each running its own private collector.
+ *
+ * --max-heap BYTES caps every private heap (or, with --shared, the shared
+ * one); a job that runs out of memory fails without stopping the batch. */
+
+#include "vm.h"
+#include "loader.h"
+#include "heap.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_THREADS 256
+
+typedef struct {
+    const char *path;
+    int *bytecode;
+    int code_size;
+    LocalPairs *local_pairs;    // Escape analysis, shared; scratch pairs are per VM
+    ConstantPool *constants;    // Shared too; each VM interns its own strings
+} Program;
+
+typedef struct {
+    int program;
+    double seconds;
+    long instructions;
+    long gc_calls;
+    int result;
+    int ok;
+} Job;
+
+typedef struct {
+    Program *programs;
+    Job *jobs;
+    int job_count;
+    int next_job;        // Claimed with an atomic fetch-and-add
+    SharedHeap *heap;    // NULL: one private heap per VM
+    long max_heap;       // Per-VM heap ceiling for private heaps, 0 = none
+} Batch;
+
+static double now_seconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg){
+    Batch *batch = (Batch*)arg;
+    for(;;){
+        int index = __atomic_fetch_add(&batch->next_job, 1, __ATOMIC_RELAXED);
+        if(index >= batch->job_count) break;
+
+        Job *job = &batch->jobs[index];
+        Program *program = &batch->programs[job->program];
+        VM *vm = vm_new(program->bytecode);
+        if(!vm) continue;
+        if(vm_attach_local_pairs(vm, program->local_pairs) != 0 ||
+           vm_attach_constants(vm, program->constants) != 0){
+            vm_free(vm);
+            continue;
+        }
+        if(batch->heap && heap_attach(batch->heap, vm) != 0){
+            vm_free(vm);
+            continue;
+        }
+        if(!batch->heap) vm->max_heap_bytes = batch->max_heap;
+
+        double start = now_seconds();
+        vm_run(vm);
+        job->seconds = now_seconds() - start;
+        job->instructions = vm->instruction_count;
+        job->gc_calls = vm->gc_stats.total_gc_calls;
+        job->result = vm->stack.sp >= 0 ? vm->stack.data[vm->stack.sp].as.i : 0;
+        job->ok = vm->error == VM_OK;
+        vm_free(vm);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    int threads = 4;
+    int repeat = 1;
+    int shared = 0;
+    long max_heap = 0;
+    int first_program = argc;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--shared") == 0) shared = 1;
+        else if(strcmp(argv[i], "--max-heap") == 0 && i + 1 < argc) max_heap = atol(argv[++i]);
+        else{
+            first_program = i;
+            break;
+        }
+    }
+    if(first_program >= argc){
+        printf("Usage: %s [-j threads] [--repeat N] [--shared] [--max-heap BYTES] prog.bc...\n", argv[0]);
+        return 1;
+    }
+    if(threads < 1) threads = 1;
+    if(threads > MAX_THREADS) threads = MAX_THREADS;
+    if(repeat < 1) repeat = 1;
+
+    int program_count = argc - first_program;
+    Program *programs = (Program*)calloc(program_count, sizeof(Program));
+    Batch batch;
+    batch.job_count = program_count * repeat;
+    batch.jobs = (Job*)calloc(batch.job_count, sizeof(Job));
+    batch.programs = programs;
+    batch.next_job = 0;
+    batch.heap = shared ? heap_create() : NULL;
+    batch.max_heap = max_heap;
+    if(!programs || !batch.jobs || (shared && !batch.heap)){
+        printf("Out of memory\n");
+        return 1;
+    }
+    if(batch.heap) batch.heap->max_bytes = max_heap;
+
+    // Bytecode is read-only during execution, so VMs share one copy
+    for(int p = 0; p < program_count; p++){
+        programs[p].path = argv[first_program + p];
+        programs[p].bytecode = load_bytecode(programs[p].path, &programs[p].code_size);
+        if(!programs[p].bytecode) return 1;
+        programs[p].local_pairs = escape_analyze(programs[p].bytecode, programs[p].code_size);
+        programs[p].constants = load_constants(programs[p].path);
+    }
+    for(int j = 0; j < batch.job_count; j++){
+        batch.jobs[j].program = j % program_count;
+    }
+
+    pthread_t tids[MAX_THREADS];
+    double start = now_seconds();
+    for(int t = 0; t < threads; t++){
+        if(pthread_create(&tids[t], NULL, worker, &batch) != 0){
+            threads = t;
+            break;
+        }
+    }
+    if(threads == 0) worker(&batch);
+    for(int t = 0; t < threads; t++){
+        pthread_join(tids[t], NULL);
+    }
+    double wall = now_seconds() - start;
+
+    printf("%-24s %6s %12s %14s %8s %10s\n", "program", "runs", "avg ms", "instructions", "GCs", "result");
+    double busy = 0.0;
+    long total_instructions = 0;
+    int failed = 0;
+    for(int p = 0; p < program_count; p++){
+        int runs = 0;
+        double seconds = 0.0;
+        Job *last = NULL;
+        for(int j = p; j < batch.job_count; j += program_count){
+            if(!batch.jobs[j].ok){
+                failed++;
+                continue;
+            }
+            runs++;
+            seconds += batch.jobs[j].seconds;
+            total_instructions += batch.jobs[j].instructions;
+            last = &batch.jobs[j];
+        }
+        busy += seconds;
+        const char *name = strrchr(programs[p].path, '/');
+        name = name ? name + 1 : programs[p].path;
+        if(last){
+            printf("%-24s %6d %12.2f %14ld %8ld %10d\n", name, runs, seconds / runs * 1e3,
+                   last->instructions, last->gc_calls, last->result);
+        }
+    }
+
+    printf("\nThreads:             %d\n", threads ? threads : 1);
+    printf("Jobs:                %d (%d failed)\n", batch.job_count, failed);
+    printf("Wall time:           %.3f s\n", wall);
+    printf("Throughput:          %.1f jobs/s, %.1f M instructions/s\n",
+           batch.job_count / wall, total_instructions / wall / 1e6);
+    printf("Job time / wall:     %.2fx\n", wall > 0 ? busy / wall : 0.0);
+    if(batch.heap){
+        GCStats *stats = &batch.heap->gc_stats;
+        printf("Shared heap:         %d pages, %ld collections, %.3f s GC, max pause %.3f ms\n",
+               batch.heap->page_count, stats->total_gc_calls, stats->total_gc_time,
+               stats->max_gc_pause * 1e3);
+        long committed, resident;
+        heap_memory_usage(batch.heap, &committed, &resident);
+        printf("Heap memory:         %.1f MB committed, %.1f MB resident, %ld pages returned\n",
+               committed / 1048576.0, resident / 1048576.0, batch.heap->pages_returned);
+        heap_destroy(batch.heap);
+    }
+
+    for(int p = 0; p < program_count; p++){
+        local_pairs_destroy(programs[p].local_pairs);
+        constant_pool_destroy(programs[p].constants);
+        free(programs[p].bytecode);
+    }
+    free(programs);
+    free(batch.jobs);
+    return failed ? 1 : 0;
+}